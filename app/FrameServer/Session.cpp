@@ -6,6 +6,220 @@ using namespace std;
 namespace imqs {
 namespace frameserver {
 
+FramePool::~FramePool() {
+	for (auto buf : FreeList)
+		free(buf);
+}
+
+void* FramePool::Alloc(size_t bytes) {
+	{
+		lock_guard<mutex> lock(Lock);
+		if (bytes == BufSize && FreeList.size() != 0) {
+			void* buf = FreeList.back();
+			FreeList.pop_back();
+			return buf;
+		}
+	}
+	return imqs_malloc_or_die(bytes);
+}
+
+void FramePool::Free(void* buf, size_t bytes) {
+	if (!buf)
+		return;
+	lock_guard<mutex> lock(Lock);
+	if (bytes != BufSize) {
+		// The resolution has changed, so the old buffers are no longer useful
+		for (auto b : FreeList)
+			free(b);
+		FreeList.clear();
+		BufSize = bytes;
+	}
+	if (FreeList.size() >= MaxFree) {
+		free(buf);
+		return;
+	}
+	FreeList.push_back(buf);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+Session::~Session() {
+	{
+		lock_guard<mutex> lock(Lock);
+		DecoderExit = true;
+	}
+	DecoderWake.notify_all();
+	if (Decoder.joinable())
+		Decoder.join();
+	FlushRing();
+}
+
+Error Session::ReadFrame(int64_t micros, int width, int height, DecodedFrame& frame, bool& seekFailed) {
+	unique_lock<mutex> lock(Lock);
+	seekFailed = false;
+
+	if (width != RingWidth || height != RingHeight)
+		FlushRing();
+	else if (Ring.size() == 0 && DecoderBusy)
+		WaitForDecoder(lock); // The frame that the decoder is busy with is most likely the one we want
+
+	// Discard ring frames that are before the requested time. If the requested time is
+	// inside the ring, then this leaves the requested frame at the front of the ring.
+	// The ring only contains frames after LastServedTime, so a request for a time before
+	// that is a backwards seek, which we treat as a miss.
+	bool inRing = Ring.size() != 0 && (micros == -1 || (micros > LastServedTime && micros <= Ring.back().Time + 1));
+	if (inRing && micros != -1) {
+		// The +1 is for rounding of the frame time to whole microseconds
+		while (Ring.front().Time + 1 < micros) {
+			Pool.Free(Ring.front().Buf, Ring.front().Bytes());
+			Ring.pop_front();
+		}
+	}
+
+	if (inRing) {
+		frame = Ring.front();
+		Ring.pop_front();
+	} else {
+		// Cache miss. Cancel the decoder by throwing away everything it has done, and seek.
+		FlushRing();
+		WaitForDecoder(lock);
+		if (micros != -1) {
+			auto err = Video.SeekToMicrosecond(micros, video::SeekFlagAny);
+			if (!err.OK()) {
+				seekFailed = true;
+				return Error::Fmt("Seek to %v microseconds failed: %v", micros, err.Message());
+			}
+			DecoderEOF = false;
+		}
+		auto err = DecodeInto(width, height, frame);
+		if (!err.OK())
+			return err;
+	}
+
+	LastServedTime = frame.Time;
+	RingWidth      = width;
+	RingHeight     = height;
+
+	if (!DecoderStarted) {
+		DecoderStarted = true;
+		Decoder        = thread([this] { DecoderThread(); });
+	}
+	lock.unlock();
+	DecoderWake.notify_all();
+	return Error();
+}
+
+void Session::ReleaseFrame(DecodedFrame& frame) {
+	Pool.Free(frame.Buf, frame.Bytes());
+	frame.Buf = nullptr;
+}
+
+video::VideoStreamInfo Session::VideoInfo() {
+	unique_lock<mutex> lock(Lock);
+	WaitForDecoder(lock);
+	return Video.GetVideoStreamInfo();
+}
+
+std::unique_lock<std::mutex> Session::AcquireVideo() {
+	unique_lock<mutex> lock(Lock);
+	FlushRing();
+	WaitForDecoder(lock);
+	// We don't know where the caller is going to leave the decoder, so the next ReadFrame
+	// without a time is served from wherever that is, and it restarts the decode-ahead.
+	LastServedTime = -1;
+	DecoderEOF     = false;
+	RingWidth      = 0;
+	RingHeight     = 0;
+	return lock;
+}
+
+// Assume Lock is held (via AcquireVideo)
+// Only Video builds the frame index. The extra decoders copy it once it's ready.
+std::vector<video::VideoFile*> Session::BatchDecoders(size_t n) {
+	while (ExtraDecoders.size() + 1 < n) {
+		auto vid           = unique_ptr<video::VideoFile>(new video::VideoFile());
+		vid->UseFrameIndex = false;
+		auto err           = vid->OpenFile(Video.GetFilename());
+		if (!err.OK())
+			break;
+		ExtraDecoders.push_back(move(vid));
+	}
+	vector<video::VideoFile*> decoders = {&Video};
+	for (size_t i = 0; i < ExtraDecoders.size() && decoders.size() < n; i++) {
+		ExtraDecoders[i]->CopyIndexFrom(Video);
+		decoders.push_back(ExtraDecoders[i].get());
+	}
+	return decoders;
+}
+
+void Session::DecoderThread() {
+	unique_lock<mutex> lock(Lock);
+	while (true) {
+		DecoderWake.wait(lock, [&] { return DecoderExit || (!DecoderEOF && VideoWaiters == 0 && RingWidth != 0 && Ring.size() < RingSize); });
+		if (DecoderExit)
+			break;
+
+		// Reserve the slot, and decode without holding the lock
+		int      width      = RingWidth;
+		int      height     = RingHeight;
+		uint64_t generation = RingGeneration;
+		DecoderBusy         = true;
+		lock.unlock();
+
+		DecodedFrame frame;
+		auto         err = DecodeInto(width, height, frame);
+
+		lock.lock();
+		DecoderBusy = false;
+		if (generation != RingGeneration) {
+			// The ring was discarded while we were decoding, so this frame is no longer wanted
+			ReleaseFrame(frame);
+		} else if (!err.OK()) {
+			// EOF, or a decode error. Either way, we stop until the next seek. The next synchronous
+			// decode will surface the error to the client.
+			DecoderEOF = true;
+		} else {
+			Ring.push_back(frame);
+		}
+		// Wake up anybody in WaitForDecoder
+		DecoderWake.notify_all();
+	}
+}
+
+// Assume Lock is held. Wait for the decoder to finish the frame that it is busy with, so that the
+// caller can use Video. The decoder won't start another frame until the caller releases Lock.
+void Session::WaitForDecoder(std::unique_lock<std::mutex>& lock) {
+	VideoWaiters++;
+	DecoderWake.wait(lock, [&] { return !DecoderBusy; });
+	VideoWaiters--;
+}
+
+// Assume Lock is held
+void Session::FlushRing() {
+	for (auto& f : Ring)
+		Pool.Free(f.Buf, f.Bytes());
+	Ring.clear();
+	RingGeneration++;
+}
+
+// Assume the caller has exclusive use of Video. This is either the decoder thread while DecoderBusy
+// is set, or somebody holding Lock after WaitForDecoder.
+Error Session::DecodeInto(int width, int height, DecodedFrame& frame) {
+	frame.Width  = width;
+	frame.Height = height;
+	frame.Buf    = Pool.Alloc(frame.Bytes());
+	auto err     = Video.DecodeFrameRGBA(width, height, frame.Buf, frame.Stride());
+	if (!err.OK()) {
+		Pool.Free(frame.Buf, frame.Bytes());
+		frame.Buf = nullptr;
+		return err;
+	}
+	frame.Time = Video.LastFrameTimeMicrosecond();
+	return Error();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
 SessionStore::SessionStore(std::string rootPath, uberlog::Logger* log) : RootPath(rootPath), Log(log) {
 }
 
@@ -3,13 +3,94 @@
 namespace imqs {
 namespace frameserver {
 
+// A decoded RGBA frame
+struct DecodedFrame {
+	void*   Buf    = nullptr;
+	int     Width  = 0;
+	int     Height = 0;
+	int64_t Time   = 0; // Frame time in microseconds
+
+	int    Stride() const { return Width * 4; }
+	size_t Bytes() const { return (size_t) Height * (size_t) Stride(); }
+};
+
+// A pool of equally sized frame buffers, so that we don't hit the heap for every frame.
+// If the requested size changes, then all free buffers are discarded.
+class FramePool {
+public:
+	size_t MaxFree = 32; // Maximum number of free buffers that we hold on to
+
+	~FramePool();
+	void* Alloc(size_t bytes);
+	void  Free(void* buf, size_t bytes);
+
+private:
+	std::mutex         Lock;
+	size_t             BufSize = 0;
+	std::vector<void*> FreeList;
+};
+
 // A session is a single video that one client is busy streaming
 // If there are training labels associated with the video, then they
 // are read during initial load.
+//
+// Every session has a background decoder, which fills a small ring of frames ahead of
+// the most recently requested frame, at the most recently requested resolution.
+// Sequential playback is served straight out of the ring. A request that lands outside
+// of the ring, or asks for a different resolution, discards the ring and seeks.
+// The decoder reserves a ring slot while holding Lock, but decodes the frame without it, so
+// that requests which are served from the ring don't wait on the decoder. Anybody else who
+// wants to use Video must hold Lock, and wait for DecoderBusy to clear (see WaitForDecoder).
+// Discarding the ring bumps RingGeneration, which tells the decoder to throw away the frame
+// that it is busy with, instead of publishing it.
 class Session {
 public:
-	video::VideoFile   Video;
+	video::VideoFile   Video; // You must hold Lock when using Video directly (see AcquireVideo)
 	train::VideoLabels Labels;
+	size_t             RingSize = 8; // Number of frames to decode ahead
+
+	~Session();
+
+	// Read the frame at the given time, or the next frame if micros is -1.
+	// Return the frame to the pool with ReleaseFrame, once you're done with it.
+	// If the error came from seeking to micros, then seekFailed is set, because that is most likely bad input.
+	Error ReadFrame(int64_t micros, int width, int height, DecodedFrame& frame, bool& seekFailed);
+	void  ReleaseFrame(DecodedFrame& frame);
+
+	// Returns the video's stream information, read under Lock
+	video::VideoStreamInfo VideoInfo();
+
+	// Lock Video for direct use by the caller. This discards the decode-ahead ring, because
+	// the caller is going to move the decoder's position.
+	std::unique_lock<std::mutex> AcquireVideo();
+
+	// Return up to n decoders that are open on this session's video, for decoding a batch in parallel.
+	// The first decoder is Video. The others are opened on first use, and kept for the life of the session.
+	// You must be holding the lock returned by AcquireVideo.
+	std::vector<video::VideoFile*> BatchDecoders(size_t n);
+
+private:
+	std::mutex               Lock;
+	std::condition_variable  DecoderWake;
+	std::thread              Decoder;
+	bool                     DecoderStarted = false;
+	bool                     DecoderExit    = false;
+	bool                     DecoderEOF     = false; // Decoder hit the end of the video (or an error), so it has stopped
+	bool                     DecoderBusy    = false; // Decoder is decoding a frame, without holding Lock
+	int                      VideoWaiters   = 0;     // Number of threads waiting in WaitForDecoder. The decoder doesn't start a new frame while this is non-zero.
+	std::deque<DecodedFrame> Ring;                   // Frames that have been decoded ahead of LastServedTime
+	uint64_t                 RingGeneration = 0;     // Incremented whenever the ring is discarded
+	int                      RingWidth      = 0;     // Resolution of the frames in the ring
+	int                      RingHeight     = 0;
+	int64_t                  LastServedTime = -1;    // Time of the last frame that was returned by ReadFrame
+	FramePool                Pool;
+
+	std::vector<std::unique_ptr<video::VideoFile>> ExtraDecoders; // See BatchDecoders
+
+	void  DecoderThread();
+	void  WaitForDecoder(std::unique_lock<std::mutex>& lock);
+	void  FlushRing();
+	Error DecodeInto(int width, int height, DecodedFrame& frame);
 };
 typedef std::shared_ptr<Session> SessionPtr;
 
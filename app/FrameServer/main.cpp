@@ -137,13 +137,19 @@ static void HandleHttp(SessionStore& sessions, phttp::Response& w, phttp::Reques
 			w.SetStatusAndBody(phttp::Status410_Gone, "Session expired or invalid");
 			return;
 		}
-		nlohmann::json j;
-		j["width"]           = ses->Video.Width();
-		j["height"]          = ses->Video.Height();
-		j["seconds"]         = ses->Video.GetVideoStreamInfo().DurationSeconds();
-		j["framesPerSecond"] = ses->Video.GetVideoStreamInfo().FrameRateSeconds();
+		auto             info = ses->VideoInfo();
+		string           body;
+		io::StringWriter out(body);
+		JsonWriter       jw(&out);
+		jw.BeginObject();
+		jw.Key("width").Int(info.Width);
+		jw.Key("height").Int(info.Height);
+		jw.Key("seconds").Double(info.DurationSeconds());
+		jw.Key("framesPerSecond").Double(info.FrameRateSeconds());
+		jw.EndObject();
+		jw.Flush();
 		w.SetHeader("Content-Type", "application/json");
-		w.SetStatusAndBody(200, j.dump());
+		w.SetStatusAndBody(200, body);
 		break;
 	}
 		// frame? frameTimeMicros=1234567 width=1280 height=720 frame=1234 format=png -> returns frame
@@ -168,23 +174,24 @@ static void HandleHttp(SessionStore& sessions, phttp::Response& w, phttp::Reques
 		auto quality   = r.QueryInt("quality");
 		if (r.QueryVal("quality") == "")
 			quality = -1;
-		if (hasMicros) {
-			auto err = ses->Video.SeekToMicrosecond(micros, video::SeekFlagAny);
-			if (!err.OK()) {
-				w.SetStatusAndBody(phttp::Status400_Bad_Request, tsf::fmt("Seek to %v microseconds failed: %v", micros, err.Message()));
-				return;
-			}
+		if (!hasMicros) {
+			micros = -1;
+		} else if (micros < 0) {
+			w.SetStatusAndBody(phttp::Status400_Bad_Request, tsf::fmt("Seek to %v microseconds failed: time is negative", micros));
+			return;
 		}
-		int   stride = width * 4;
-		void* buf    = imqs_malloc_or_die(height * stride);
-		auto  err    = ses->Video.DecodeFrameRGBA(width, height, buf, stride);
+		DecodedFrame frame;
+		bool         seekFailed = false;
+		auto         err        = ses->ReadFrame(micros, width, height, frame, seekFailed);
 		if (err.OK())
-			EncodeFrame(format, buf, width, height, stride, quality, ses->Video.LastFrameTimeMicrosecond(), w);
+			EncodeFrame(format, frame.Buf, frame.Width, frame.Height, frame.Stride(), quality, frame.Time, w);
 		else if (err == ErrEOF)
 			w.SetStatusAndBody(phttp::Status200_OK, "EOF");
+		else if (seekFailed)
+			w.SetStatusAndBody(phttp::Status400_Bad_Request, err.Message());
 		else
 			w.SetStatusAndBody(phttp::Status500_Internal_Server_Error, err.Message());
-		free(buf);
+		ses->ReleaseFrame(frame);
 		break;
 	}
 	case "labels"_crc32: {
@@ -214,7 +221,8 @@ static void HandleHttp(SessionStore& sessions, phttp::Response& w, phttp::Reques
 		for (size_t i = 0; i < pairsV.size(); i += 2)
 			pairs.push_back({atoi(pairsV[i].c_str()), atoi(pairsV[i + 1].c_str())});
 		string encoded;
-		auto   err = train::ExportLabeledBatch(channelsFirst, compress, pairs, ses->Video, ses->Labels, encoded);
+		auto   lock = ses->AcquireVideo();
+		auto   err  = train::ExportLabeledBatch(channelsFirst, compress, pairs, ses->BatchDecoders(4), ses->Labels, encoded);
 		if (!err.OK()) {
 			w.SetStatusAndBody(phttp::Status500_Internal_Server_Error, err.Message());
 			return;
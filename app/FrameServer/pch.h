@@ -2,6 +2,7 @@
 #define _CRT_SECURE_NO_WARNINGS 1
 
 #include <algorithm>
+#include <deque>
 
 #include <lib/pal/pal.h>
 #include <lib/Video/Video.h>
@@ -1,80 +1,259 @@
 #include "pch.h"
 #include "Export.h"
 
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
 using namespace std;
 
 namespace imqs {
 namespace label {
 
+// The manifest lives inside the export directory, and records every link that we created,
+// so that the next export only needs to touch the links that have changed.
+static const char* ManifestName    = ".manifest";
+static const char* ManifestVersion = "imqs-label-export-1";
+
+// One symlink inside the export directory
+struct ExportLink {
+	string  Target;     // Absolute path of the photo
+	int64_t ModifiedAt; // Unix nanoseconds of the most recent change to the sample or label. Zero if unknown.
+};
+
 static Error FindAllExtensionsInPath(string dir, ohash::set<string>& allExt) {
 	auto err = os::FindFiles(dir, [&](const os::FindFileItem& item) -> bool {
 		if (item.IsDir)
 			return true;
+		if (item.Name == ManifestName)
+			return true;
 		allExt.insert(strings::tolower(path::Extension(item.Name)));
 		return true;
 	});
 	return err;
 }
 
-Error ExportWholeImages(LabelDB& db, std::string photoRoot, std::string exportDir) {
-	// Check that the export directory contains ONLY jpegs, to safeguard the user against sending
-	// the wrong path here, and we end up wiping his OS or something.
-	ohash::set<string> allExt;
-	auto               err = FindAllExtensionsInPath(exportDir, allExt);
-	if (os::IsNotExist(err))
-		err = Error();
-	else if (!err.OK())
-		return err;
-	for (auto ext : allExt) {
-		if (ext != ".jpg" && ext != ".jpeg")
-			return Error::Fmt("Unexpected file extensions (%v) found in %v. You must delete the directory manually before exporting");
+static int64_t ModifiedAt(const dba::Attrib& a, const dba::Attrib& b) {
+	auto ta = a.ToDate();
+	auto tb = b.ToDate();
+	if (ta.IsNull() && tb.IsNull())
+		return 0;
+	if (ta.IsNull())
+		return tb.UnixNano();
+	if (tb.IsNull())
+		return ta.UnixNano();
+	return std::max(ta.UnixNano(), tb.UnixNano());
+}
+
+// Returns false if there is no valid manifest, or if it was created for a different photo root
+static bool LoadManifest(string exportDir, string photoRoot, ohash::map<string, int64_t>& links) {
+	string raw;
+	if (!os::ReadWholeFile(path::Join(exportDir, ManifestName), raw).OK())
+		return false;
+	auto lines = strings::Split(raw, '\n');
+	if (lines.size() < 2 || lines[0] != ManifestVersion || lines[1] != photoRoot)
+		return false;
+	for (size_t i = 2; i < lines.size(); i++) {
+		const auto& line = lines[i];
+		if (line == "")
+			continue;
+		auto tab = line.find('\t');
+		if (tab == string::npos)
+			return false;
+		links.set(line.substr(tab + 1), AtoI64(line.c_str()));
 	}
+	return true;
+}
 
-	err = os::RemoveAll(exportDir);
-	if (!err.OK())
-		return err;
-	err = os::MkDirAll(exportDir);
+static Error SaveManifest(string exportDir, string photoRoot, const ohash::map<string, ExportLink>& links) {
+	string raw;
+	raw.reserve(links.size() * 80);
+	raw += ManifestVersion;
+	raw += "\n";
+	raw += photoRoot;
+	raw += "\n";
+	for (const auto& p : links)
+		raw += tsf::fmt("%v\t%v\n", p.second.ModifiedAt, p.first);
+	auto filename = path::Join(exportDir, ManifestName);
+	auto err      = os::WriteWholeFile(filename + ".tmp", raw);
 	if (!err.OK())
 		return err;
+	return os::Rename(filename + ".tmp", filename);
+}
 
-	dba::Tx* tx = nullptr;
-	err         = db.DB->Begin(tx);
+static Error CreateSymlink(const string& target, const string& link) {
+#ifdef _WIN32
+	return Error("Exporting symlinks is not supported on Windows");
+#else
+	if (symlink(target.c_str(), link.c_str()) == 0)
+		return Error();
+	if (errno != EEXIST)
+		return os::ErrorFrom_errno();
+	// A stale link that is not in the manifest, perhaps from an interrupted export
+	if (unlink(link.c_str()) != 0 || symlink(target.c_str(), link.c_str()) != 0)
+		return os::ErrorFrom_errno();
+	return Error();
+#endif
+}
+
+// Run f(i) for i in [0, n) on the shared IO threads, and return the first error
+static Error ParallelFor(size_t n, function<Error(size_t i)> f) {
+	atomic<bool> haveErr;
+	haveErr = false;
+	Error      firstErr;
+	std::mutex errLock;
+	auto       chunk = [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end && !haveErr; i++) {
+			auto err = f(i);
+			if (!err.OK()) {
+				lock_guard<mutex> lock(errLock);
+				if (!haveErr)
+					firstErr = err;
+				haveErr = true;
+			}
+		}
+	};
+	// These are filesystem operations, which spend most of their time blocked in the kernel
+	sync::ParallelFor(0, n, 64, chunk, sync::TaskLane::IO);
+	return firstErr;
+}
+
+Error ExportWholeImages(LabelDB& db, std::string photoRoot, std::string exportDir) {
+	auto start = time::Now();
+
+	ohash::map<string, int64_t> prev;
+	bool                        haveManifest = LoadManifest(exportDir, photoRoot, prev);
+
+	if (!haveManifest) {
+		// Check that the export directory contains ONLY jpegs, to safeguard the user against sending
+		// the wrong path here, and we end up wiping his OS or something.
+		ohash::set<string> allExt;
+		auto               err = FindAllExtensionsInPath(exportDir, allExt);
+		if (os::IsNotExist(err))
+			err = Error();
+		else if (!err.OK())
+			return err;
+		for (auto ext : allExt) {
+			if (ext != ".jpg" && ext != ".jpeg")
+				return Error::Fmt("Unexpected file extensions (%v) found in %v. You must delete the directory manually before exporting", ext, exportDir);
+		}
+
+		tsf::print("No export manifest found in %v. Exporting everything\n", exportDir);
+		err = os::RemoveAll(exportDir);
+		if (!err.OK())
+			return err;
+	}
+	auto err = os::MkDirAll(exportDir);
 	if (!err.OK())
 		return err;
-	dba::TxAutoCloser txCloser(tx);
-	auto              rows = tx->Query("SELECT sample.image_path, label.dimension, label.category FROM sample INNER JOIN label ON sample.id = label.sample_id");
-	size_t            nth  = 0;
-	for (auto row : rows) {
-		nth++;
-		string path, dim, lab;
-		err = row.Scan(path, dim, lab);
+
+	// Build the desired state of the export directory
+	ohash::map<string, ExportLink> want;
+	{
+		dba::Tx* tx = nullptr;
+		err         = db.DB->Begin(tx);
 		if (!err.OK())
 			return err;
-		auto dir = path::Join(exportDir, dim, lab);
-		err      = os::MkDirAll(dir);
+		dba::TxAutoCloser txCloser(tx);
+		auto              rows = tx->Query("SELECT sample.image_path, label.dimension, label.category, sample.modified_at, label.modified_at FROM sample INNER JOIN label ON sample.id = label.sample_id");
+		for (auto row : rows) {
+			string path = row[0].ToString();
+			string dim  = row[1].ToString();
+			string lab  = row[2].ToString();
+
+			auto shortName = path::ChangeExtension(path::Filename(path), "");
+			auto extension = path::Extension(path);
+			auto pathHash  = tsf::fmt("%08x", XXH64(path.c_str(), path.size(), 0));
+			// PhotoRoot example: /stuff/mldata
+			// path example:      2019/2019-02-27/148GOPRO/G0024551.JPG
+			// shortName:         G0024551
+			// pathHash:          deadbeefdeadbeef
+			// dir example:       /stuff/train/road_type/gravel
+			// desired output:    /stuff/train/road_type/gravel/G0024551_deadbeefdeadbeef.JPG -> /stuff/mldata/2019/2019-02-27/148GOPRO/G0024551.JPG
+			// Links are relative to exportDir.
+			auto       rel = path::Join(dim, lab, shortName + "_" + pathHash + extension);
+			ExportLink link;
+			link.Target     = path::Join(photoRoot, path);
+			link.ModifiedAt = ModifiedAt(row[3], row[4]);
+			// Multiple regions of the same image produce the same link, so keep the most recent change
+			auto existing = want.getp(rel);
+			if (!existing || existing->ModifiedAt < link.ModifiedAt)
+				want.set(rel, link);
+		}
+		if (!rows.OK())
+			return rows.Err();
+	}
+	auto queryDone = time::Now();
+
+	// Diff against the previous export. A changed modification time causes the link to be recreated.
+	vector<string> remove;
+	vector<string> create;
+	for (const auto& p : prev) {
+		auto w = want.getp(p.first);
+		if (!w || w->ModifiedAt != p.second)
+			remove.push_back(p.first);
+	}
+	for (const auto& p : want) {
+		auto old = prev.getp(p.first);
+		if (!old || *old != p.second.ModifiedAt)
+			create.push_back(p.first);
+	}
+	size_t nUnchanged = want.size() - create.size();
+
+	// If we fail half way, then the manifest no longer describes the directory, so we delete it,
+	// and the next export starts from scratch.
+	auto manifestFile = path::Join(exportDir, ManifestName);
+	if (haveManifest && (remove.size() != 0 || create.size() != 0)) {
+		err = os::Remove(manifestFile);
 		if (!err.OK())
 			return err;
-		auto shortName = path::ChangeExtension(path::Filename(path), "");
-		auto extension = path::Extension(path);
-		auto pathHash  = tsf::fmt("%08x", XXH64(path.c_str(), path.size(), 0));
-		// PhotoRoot example: /stuff/mldata
-		// path example:      2019/2019-02-27/148GOPRO/G0024551.JPG
-		// shortName:         G0024551
-		// pathHash:          deadbeefdeadbeef
-		// dir example:       /stuff/train/road_type/gravel
-		// desired output:    ln -s /stuff/mldata/2019/2019-02-27/148GOPRO/G0024551.JPG /stuff/train/road_type/gravel/G0024551_deadbeefdeadbeef.JPG
-		auto cmd = tsf::fmt("ln -s '%v' '%v'", path::Join(photoRoot, path), path::Join(dir, shortName) + "_" + pathHash + extension);
-		if (nth % 100 == 0)
-			tsf::print("%v, %v, %v\n", path, dim, lab);
-		//tsf::print("%v\n", cmd);
-		int ret = system(cmd.c_str());
-		if (ret != 0)
-			return Error::Fmt("Failed to create symlink: '%v': %d", cmd, ret);
 	}
-	if (!rows.OK())
-		return rows.Err();
+
+	err = ParallelFor(remove.size(), [&](size_t i) -> Error {
+		auto e = os::Remove(path::Join(exportDir, remove[i]));
+		if (os::IsNotExist(e))
+			return Error();
+		return e;
+	});
+	if (!err.OK())
+		return err;
+	auto removeDone = time::Now();
+
+	ohash::set<string> dirSet;
+	for (const auto& rel : create)
+		dirSet.insert(path::Dir(rel));
+	vector<string> dirs;
+	for (const auto& d : dirSet)
+		dirs.push_back(d);
+	err = ParallelFor(dirs.size(), [&](size_t i) -> Error {
+		return os::MkDirAll(path::Join(exportDir, dirs[i]));
+	});
+	if (!err.OK())
+		return err;
+	auto mkdirDone = time::Now();
+
+	err = ParallelFor(create.size(), [&](size_t i) -> Error {
+		auto link = want.getp(create[i]);
+		auto e    = CreateSymlink(link->Target, path::Join(exportDir, create[i]));
+		if (!e.OK())
+			return Error::Fmt("Failed to create symlink %v -> %v: %v", create[i], link->Target, e.Message());
+		return Error();
+	});
+	if (!err.OK())
+		return err;
+	auto linkDone = time::Now();
+
+	err = SaveManifest(exportDir, photoRoot, want);
+	if (!err.OK())
+		return err;
+	auto end = time::Now();
+
+	tsf::print("Exported %v links: %v created, %v removed, %v unchanged, %v directories\n", want.size(), create.size(), remove.size(), nUnchanged, dirs.size());
+	tsf::print("Time: query %.2fs, remove %.2fs, mkdir %.2fs, link %.2fs, manifest %.2fs, total %.2fs\n",
+	           (queryDone - start).Seconds(), (removeDone - queryDone).Seconds(), (mkdirDone - removeDone).Seconds(),
+	           (linkDone - mkdirDone).Seconds(), (end - linkDone).Seconds(), (end - start).Seconds());
 	return Error();
 }
 
 } // namespace label
-} // namespace imqs
\ No newline at end of file
+} // namespace imqs
@@ -0,0 +1,116 @@
+#include "pch.h"
+#include "ImageCache.h"
+
+using namespace std;
+
+namespace imqs {
+namespace label {
+
+Error ImageCache::Open(std::string dir, uint64_t maxBytes) {
+	auto err = os::MkDirAll(dir);
+	if (!err.OK())
+		return err;
+
+	struct File {
+		string     Name;
+		uint64_t   Size;
+		time::Time Modified;
+	};
+	vector<File> files;
+	err = os::FindFiles(dir, [&](const os::FindFileItem& item) -> bool {
+		if (item.IsDir)
+			return false;
+		if (strings::EndsWith(item.Name, ".tmp")) {
+			// Left behind by an interrupted Put
+			os::Remove(item.FullPath());
+			return true;
+		}
+		uint64_t size = 0;
+		if (os::FileLength(item.FullPath(), size).OK())
+			files.push_back({item.Name, size, item.TimeModify});
+		return true;
+	});
+	if (!err.OK())
+		return err;
+	sort(files.begin(), files.end(), [](const File& a, const File& b) { return a.Modified < b.Modified; });
+
+	lock_guard<mutex> lock(Lock);
+	Dir        = dir;
+	MaxBytes   = maxBytes;
+	TotalBytes = 0;
+	UseClock   = 0;
+	Entries.clear();
+	for (const auto& f : files) {
+		Entry e;
+		e.Size    = f.Size;
+		e.LastUse = ++UseClock;
+		Entries.set(f.Name, e);
+		TotalBytes += f.Size;
+	}
+	Evict();
+	return Error();
+}
+
+std::string ImageCache::Filename(const std::string& key) const {
+	return path::Join(Dir, key);
+}
+
+bool ImageCache::Get(const std::string& key, std::string& data) {
+	{
+		lock_guard<mutex> lock(Lock);
+		auto              e = Entries.getp(key);
+		if (!e)
+			return false;
+		e->LastUse = ++UseClock;
+	}
+	// If the file was evicted after we released the lock, then this is just a miss
+	return os::ReadWholeFile(Filename(key), data).OK();
+}
+
+Error ImageCache::Put(const std::string& key, const std::string& data) {
+	// Write to a temporary file and rename, so that a concurrent Get never sees a partial file
+	auto filename = Filename(key);
+	auto tmp      = tsf::fmt("%v.%v.tmp", filename, std::hash<std::thread::id>()(std::this_thread::get_id()));
+	auto err      = os::WriteWholeFile(tmp, data);
+	if (!err.OK())
+		return err;
+	err = os::Rename(tmp, filename);
+	if (!err.OK()) {
+		os::Remove(tmp);
+		return err;
+	}
+
+	lock_guard<mutex> lock(Lock);
+	auto              old = Entries.getp(key);
+	if (old)
+		TotalBytes -= old->Size;
+	Entry e;
+	e.Size    = data.size();
+	e.LastUse = ++UseClock;
+	Entries.set(key, e);
+	TotalBytes += e.Size;
+	Evict();
+	return Error();
+}
+
+void ImageCache::Evict() {
+	if (TotalBytes <= MaxBytes)
+		return;
+
+	vector<pair<int64_t, string>> byAge;
+	for (const auto& e : Entries)
+		byAge.push_back({e.second.LastUse, e.first});
+	sort(byAge.begin(), byAge.end());
+
+	uint64_t target = MaxBytes / 10 * 9;
+	for (const auto& old : byAge) {
+		if (TotalBytes <= target)
+			break;
+		os::Remove(Filename(old.second));
+		TotalBytes -= Entries.get(old.second).Size;
+		Entries.erase(old.second);
+	}
+}
+
+} // namespace label
+} // namespace imqs
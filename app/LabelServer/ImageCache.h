@@ -0,0 +1,35 @@
+#pragma once
+
+namespace imqs {
+namespace label {
+
+// ImageCache stores encoded image variants (eg downscaled jpegs) on disk, up to a total of MaxBytes.
+// When the cache grows beyond MaxBytes, the least recently used files are deleted, until the cache
+// is at 90% of MaxBytes. Usage history is kept in memory, and when the cache is opened, the
+// modification time of each file is used as its last use.
+// All functions are thread safe.
+class ImageCache {
+public:
+	std::string Dir;
+	uint64_t    MaxBytes = 2 * 1024 * 1024 * (uint64_t) 1024;
+
+	Error Open(std::string dir, uint64_t maxBytes);
+	bool  Get(const std::string& key, std::string& data);        // Returns false if key is not in the cache
+	Error Put(const std::string& key, const std::string& data); // key must be usable as a filename
+
+private:
+	struct Entry {
+		uint64_t Size    = 0;
+		int64_t  LastUse = 0; // Monotonic counter. Higher is more recent.
+	};
+	std::mutex                     Lock;
+	ohash::map<std::string, Entry> Entries; // Key is the cache key
+	uint64_t                       TotalBytes = 0;
+	int64_t                        UseClock   = 0;
+
+	std::string Filename(const std::string& key) const;
+	void        Evict(); // Must be called with Lock held
+};
+
+} // namespace label
+} // namespace imqs
@@ -39,6 +39,9 @@ const char* LabelDB::Migrations[] = {
     "ALTER TABLE label ADD COLUMN intensity REAL",
     "",
     "ALTER TABLE label RENAME COLUMN value TO category",
+    "",
+    "CREATE TABLE photo_dir (path TEXT PRIMARY KEY, modified_at INTEGER NOT NULL)",
+    "CREATE TABLE photo (path TEXT PRIMARY KEY, size INTEGER NOT NULL, modified_at INTEGER NOT NULL, width INTEGER NOT NULL, height INTEGER NOT NULL)",
     nullptr,
 };
 
@@ -0,0 +1,246 @@
+#include "pch.h"
+#include "PhotoIndex.h"
+
+using namespace std;
+
+namespace imqs {
+namespace label {
+
+static int64_t ToUnixNano(time::Time t) {
+	return t.IsNull() ? 0 : t.UnixNano();
+}
+
+static string JoinRel(const string& dir, const string& name) {
+	return dir == "" ? name : dir + "/" + name;
+}
+
+std::string PhotoIndex::ParentDir(const std::string& rel) {
+	auto slash = rel.rfind('/');
+	return slash == string::npos ? "" : rel.substr(0, slash);
+}
+
+bool PhotoIndex::IsPhoto(const std::string& name) {
+	auto lc = strings::tolower(name);
+	return strings::EndsWith(lc, ".jpg") || strings::EndsWith(lc, ".jpeg") || strings::EndsWith(lc, ".png");
+}
+
+// The SOF marker is almost always within the first few KB, but an EXIF thumbnail can push it out
+// to about 64KB. Only if that fails do we read the whole file.
+Error PhotoIndex::ProbePhoto(gfx::ImageIO& io, const std::string& filename, PhotoInfo& info) {
+	auto lc = strings::tolower(filename);
+	if (!strings::EndsWith(lc, ".jpg") && !strings::EndsWith(lc, ".jpeg"))
+		return Error();
+
+	os::File f;
+	auto     err = f.Open(filename);
+	if (!err.OK())
+		return err;
+	string head;
+	head.resize((size_t) min<uint64_t>(info.Size, 128 * 1024));
+	size_t len = head.size();
+	err        = f.Read(&head[0], len);
+	f.Close();
+	if (!err.OK())
+		return err;
+	err = io.LoadJpegHeader(head.data(), len, &info.Width, &info.Height);
+	if (err.OK() || len == info.Size)
+		return err;
+
+	string all;
+	err = os::ReadWholeFile(filename, all);
+	if (!err.OK())
+		return err;
+	return io.LoadJpegHeader(all.data(), all.size(), &info.Width, &info.Height);
+}
+
+Error PhotoIndex::Load(dba::Conn* db) {
+	Photos.clear();
+	Dirs.clear();
+	auto rows = db->Query("SELECT path, modified_at FROM photo_dir");
+	for (auto row : rows)
+		Dirs.set(row[0].ToString(), row[1].ToInt64());
+	if (!rows.OK())
+		return rows.Err();
+
+	rows = db->Query("SELECT path, size, modified_at, width, height FROM photo");
+	for (auto row : rows) {
+		PhotoInfo p;
+		p.Size       = (uint64_t) row[1].ToInt64();
+		p.ModifiedAt = row[2].ToInt64();
+		p.Width      = (int) row[3].ToInt64();
+		p.Height     = (int) row[4].ToInt64();
+		Photos.set(row[0].ToString(), p);
+	}
+	if (!rows.OK())
+		return rows.Err();
+	return Error();
+}
+
+Error PhotoIndex::Rescan(dba::Conn* db, std::string photoRoot) {
+	auto abs = [&](const string& rel) { return rel == "" ? photoRoot : photoRoot + "/" + rel; };
+
+	// Build the tree from the previous scan, so that we can descend through unchanged directories without listing them
+	ohash::map<string, vector<string>> childDirs;
+	ohash::map<string, vector<string>> childPhotos;
+	for (const auto& d : Dirs) {
+		if (d.first != "") {
+			auto parent = ParentDir(d.first);
+			if (!childDirs.contains(parent))
+				childDirs.insert(parent, vector<string>());
+			childDirs.getp(parent)->push_back(d.first);
+		}
+	}
+	for (const auto& p : Photos) {
+		auto parent = ParentDir(p.first);
+		if (!childPhotos.contains(parent))
+			childPhotos.insert(parent, vector<string>());
+		childPhotos.getp(parent)->push_back(p.first);
+	}
+
+	ohash::set<string>            seenDirs;
+	vector<pair<string, int64_t>> changedDirs; // New or modified directories, and their new modification time
+	vector<string>                removedPhotos;
+	vector<pair<string, int64_t>> probe; // New or modified photos, and their modification time
+
+	os::FileAttributes rootAttribs;
+	auto               err = os::Stat(photoRoot, rootAttribs);
+	if (!err.OK())
+		return err;
+
+	vector<pair<string, int64_t>> queue = {{"", ToUnixNano(rootAttribs.TimeModify)}};
+	while (queue.size() != 0) {
+		auto dir   = queue.back().first;
+		auto mtime = queue.back().second;
+		queue.pop_back();
+		seenDirs.insert(dir);
+
+		auto prev = Dirs.getp(dir);
+		if (prev && *prev == mtime) {
+			// Unchanged, so the set of entries is the same as before, but subdirectories may have changed
+			auto children = childDirs.getp(dir);
+			if (children) {
+				for (const auto& c : *children) {
+					os::FileAttributes attribs;
+					if (os::Stat(abs(c), attribs).OK() && attribs.IsDir)
+						queue.push_back({c, ToUnixNano(attribs.TimeModify)});
+				}
+			}
+			continue;
+		}
+
+		changedDirs.push_back({dir, mtime});
+		ohash::set<string> present;
+		err = os::FindFiles(abs(dir), [&](const os::FindFileItem& item) -> bool {
+			// Skip hidden directories, such as our image cache
+			if (item.IsDir) {
+				if (!strings::StartsWith(item.Name, "."))
+					queue.push_back({JoinRel(dir, item.Name), ToUnixNano(item.TimeModify)});
+				return false;
+			}
+			if (!IsPhoto(item.Name))
+				return true;
+			auto rel = JoinRel(dir, item.Name);
+			present.insert(rel);
+			auto old = Photos.getp(rel);
+			if (!old || old->ModifiedAt != ToUnixNano(item.TimeModify))
+				probe.push_back({rel, ToUnixNano(item.TimeModify)});
+			return true;
+		});
+		if (!err.OK())
+			return err;
+		auto oldPhotos = childPhotos.getp(dir);
+		if (oldPhotos) {
+			for (const auto& p : *oldPhotos) {
+				if (!present.contains(p))
+					removedPhotos.push_back(p);
+			}
+		}
+	}
+
+	// Directories that no longer exist, and their photos
+	vector<string> removedDirs;
+	for (const auto& d : Dirs) {
+		if (!seenDirs.contains(d.first)) {
+			removedDirs.push_back(d.first);
+			auto oldPhotos = childPhotos.getp(d.first);
+			if (oldPhotos)
+				removedPhotos.insert(removedPhotos.end(), oldPhotos->begin(), oldPhotos->end());
+		}
+	}
+
+	// Read file sizes and jpeg headers in parallel. This is mostly waiting on the disk, so it runs
+	// on the IO lane. Failure to read a header is not fatal, because we still want the photo to be listed.
+	vector<PhotoInfo> probed(probe.size());
+
+	auto probeChunk = [&](size_t first, size_t last) {
+		gfx::ImageIO io;
+		for (size_t i = first; i < last; i++) {
+			auto               filename = abs(probe[i].first);
+			auto&              info     = probed[i];
+			os::FileAttributes attribs;
+			info.ModifiedAt = probe[i].second;
+			if (os::Stat(filename, attribs).OK())
+				info.Size = attribs.Size;
+			ProbePhoto(io, filename, info);
+		}
+	};
+	sync::ParallelFor(0, probe.size(), 16, probeChunk, sync::TaskLane::IO);
+
+	if (changedDirs.size() == 0 && removedDirs.size() == 0 && probe.size() == 0 && removedPhotos.size() == 0)
+		return Error();
+
+	dba::Tx* tx = nullptr;
+	err         = db->Begin(tx);
+	if (!err.OK())
+		return err;
+	dba::TxAutoCloser txCloser(tx);
+	for (const auto& d : removedDirs) {
+		err = tx->Exec("DELETE FROM photo_dir WHERE path = ?", {d});
+		if (!err.OK())
+			return err;
+		Dirs.erase(d);
+	}
+	for (const auto& d : changedDirs) {
+		err = tx->Exec("INSERT OR REPLACE INTO photo_dir (path, modified_at) VALUES (?, ?)", {d.first, d.second});
+		if (!err.OK())
+			return err;
+		Dirs.set(d.first, d.second);
+	}
+	for (const auto& p : removedPhotos) {
+		err = tx->Exec("DELETE FROM photo WHERE path = ?", {p});
+		if (!err.OK())
+			return err;
+		Photos.erase(p);
+	}
+	for (size_t i = 0; i < probe.size(); i++) {
+		const auto& p = probed[i];
+		err           = tx->Exec("INSERT OR REPLACE INTO photo (path, size, modified_at, width, height) VALUES (?, ?, ?, ?, ?)",
+		                         {probe[i].first, (int64_t) p.Size, p.ModifiedAt, p.Width, p.Height});
+		if (!err.OK())
+			return err;
+		Photos.set(probe[i].first, p);
+	}
+	return tx->Commit();
+}
+
+std::vector<std::string> PhotoIndex::SortedPhotos() const {
+	vector<string> all;
+	all.reserve(Photos.size());
+	for (const auto& p : Photos)
+		all.push_back(p.first);
+	sort(all.begin(), all.end());
+	return all;
+}
+
+std::vector<std::string> PhotoIndex::SortedDirs(size_t maxDepth) const {
+	vector<string> all;
+	for (const auto& d : Dirs) {
+		if (d.first != "" && (size_t) count(d.first.begin(), d.first.end(), '/') < maxDepth)
+			all.push_back(d.first);
+	}
+	sort(all.begin(), all.end());
+	return all;
+}
+
+} // namespace label
+} // namespace imqs
@@ -0,0 +1,40 @@
+#pragma once
+
+namespace imqs {
+namespace label {
+
+// Metadata of one photo, cached in the 'photo' table
+struct PhotoInfo {
+	uint64_t Size       = 0;
+	int64_t  ModifiedAt = 0; // Unix nanoseconds
+	int      Width      = 0; // Zero if unknown (eg png, or an unreadable jpeg)
+	int      Height     = 0;
+};
+
+// PhotoIndex is a persistent index of every photo inside PhotoRoot, stored in the 'photo'
+// and 'photo_dir' tables of the label DB.
+// A rescan lists the contents of a directory only if the directory's modification time has
+// changed since the previous scan. An unchanged directory costs one stat per subdirectory.
+// Adding, removing or renaming a file changes its directory's modification time, but overwriting
+// a photo in place does not, so such a change will not be noticed.
+// The jpeg headers of new photos are read in parallel.
+// Paths are relative to PhotoRoot, and always use forward slashes. The root directory is "".
+class PhotoIndex {
+public:
+	ohash::map<std::string, PhotoInfo> Photos;
+	ohash::map<std::string, int64_t>   Dirs; // Modification time of every directory, in Unix nanoseconds
+
+	Error Load(dba::Conn* db);
+	Error Rescan(dba::Conn* db, std::string photoRoot);
+
+	std::vector<std::string> SortedPhotos() const;
+	std::vector<std::string> SortedDirs(size_t maxDepth) const; // Excludes the root directory
+
+private:
+	static std::string ParentDir(const std::string& rel);
+	static bool        IsPhoto(const std::string& name);
+	static Error       ProbePhoto(gfx::ImageIO& io, const std::string& filename, PhotoInfo& info);
+};
+
+} // namespace label
+} // namespace imqs
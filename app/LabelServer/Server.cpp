@@ -84,29 +84,12 @@ Error Server::Initialize(uberlog::Logger* log, std::string photoDir, std::string
 		photoDir.erase(photoDir.end() - 1);
 	PhotoRoot = photoDir;
 
-	Log->Info("Scanning datasets in %v", photoDir);
-
-	// Find all directories inside PhotoRoot. Each one of these is a 'dataset'
-	// We go one level deep.
-	AllDatasets.clear();
-	auto err = os::FindFiles(photoDir, [&](const os::FindFileItem& item) -> bool {
-		if (item.IsDir) {
-			auto relDir = item.FullPath().substr(photoDir.size() + 1);
-			relDir      = strings::Replace(relDir, "\\", "/");
-			auto depth  = strings::Split(relDir, '/').size();
-			//tsf::print("%-30v %v\n", relDir, item.FullPath());
-			AllDatasets.push_back(relDir);
-			return depth <= 1;
-		} else {
-			return true;
-		}
-	});
+	Log->Info("Opening database");
+	auto err = DB.Open(log, photoDir);
 	if (!err.OK())
 		return err;
-	Log->Info("Found %v datasets", AllDatasets.size());
 
-	Log->Info("Opening database");
-	err = DB.Open(log, photoDir);
+	err = LoadReportCounters();
 	if (!err.OK())
 		return err;
 
@@ -115,22 +98,32 @@ Error Server::Initialize(uberlog::Logger* log, std::string photoDir, std::string
 	if (!err.OK())
 		return err;
 
+	// Only directories that have changed since the previous run are listed
 	Log->Info("Scanning photos in %v", photoDir);
-	AllPhotos.clear();
-	err = os::FindFiles(photoDir, [&](const os::FindFileItem& item) -> bool {
-		if (!item.IsDir) {
-			auto lc = strings::tolower(item.Name);
-			if (strings::EndsWith(lc, ".jpg") || strings::EndsWith(lc, ".jpeg") || strings::EndsWith(lc, ".png")) {
-				auto relPath = item.FullPath().substr(photoDir.size() + 1);
-				AllPhotos.push_back(relPath);
-			}
-		}
-		return true;
-	});
+	err = Photos.Load(DB.DB);
 	if (!err.OK())
 		return err;
-	sort(AllPhotos.begin(), AllPhotos.end());
+	err = Photos.Rescan(DB.DB, photoDir);
+	if (!err.OK())
+		return err;
+
+	// Every directory, one or two levels deep, is a 'dataset'
+	AllDatasets = Photos.SortedDirs(2);
+	AllPhotos   = Photos.SortedPhotos();
+	Log->Info("Found %v datasets", AllDatasets.size());
 	Log->Info("Found %v photos in %v", AllPhotos.size(), photoDir);
+	UpdateListings();
+
+	PhotoSize.SizeOf = [](const string& image, const pair<int, int>& size) -> size_t { return image.size() + sizeof(size) + 64; };
+	PhotoSize.Clear();
+	for (const auto& p : Photos.Photos) {
+		if (p.second.Width != 0)
+			PhotoSize.Put(p.first, pair<int, int>(p.second.Width, p.second.Height));
+	}
+
+	err = ImgCache.Open(path::Join(photoDir, ".labelserver-cache"), ImageCacheMaxBytes);
+	if (!err.OK())
+		return err;
 
 	//err = FindRectanglesOutsideImageBounds();
 	//if (!err.OK())
@@ -146,11 +139,11 @@ void Server::ListenAndRun(int port) {
 		if (r->Path == "/api/dimensions") {
 			SendJson(w, DimensionsRaw);
 		} else if (r->Path == "/api/datasets") {
-			SendJson(w, AllDatasets);
+			ServeListing(w, r, DatasetListing);
 		} else if (r->Path == "/api/list_images") {
-			SendJson(w, AllPhotos);
+			ServeListing(w, r, PhotoListing);
 		} else if (r->Path == "/api/get_image") {
-			SendFile(w, path::SafeJoin(PhotoRoot, r->QueryVal("image")));
+			ServeImage(w, r);
 		} else if (r->Path == "/api/report") {
 			Report(w, r);
 		} else if (r->Path == "/api/solve") {
@@ -162,9 +155,10 @@ void Server::ListenAndRun(int port) {
 				w.SetStatusAndBody(500, err.Message());
 				return;
 			}
-			dba::TxAutoCloser txCloser(tx);
+			dba::TxAutoCloser       txCloser(tx);
+			vector<LabelCountDelta> deltas;
 			if (r->Path == "/api/db/set_label" && r->Method == "POST") {
-				err = ApiSetLabel(w, r, tx);
+				err = ApiSetLabel(w, r, tx, deltas);
 			} else if (r->Path == "/api/db/get_labels") {
 				err = ApiGetLabels(w, r, tx);
 			} else if (r->Path == "/api/db/get_folder_summary") {
@@ -176,6 +170,8 @@ void Server::ListenAndRun(int port) {
 
 			if (err.OK())
 				err = tx->Commit();
+			if (err.OK())
+				ApplyReportDeltas(deltas);
 
 			if (!err.OK() && w.Body == "" && w.Status == 0) {
 				w.SetStatusAndBody(500, err.Message());
@@ -191,7 +187,118 @@ void Server::ListenAndRun(int port) {
 
 void Server::SendJson(phttp::Response& w, const nlohmann::json& j) {
 	w.SetHeader("Content-Type", "application/json");
-	w.Body = j.dump(4);
+	w.Body = j.dump();
+}
+
+// Append [begin, end) to out, as a JSON array of strings
+static void WriteStringArray(vector<string>::const_iterator begin, vector<string>::const_iterator end, string& out) {
+	io::StringWriter sw(out);
+	JsonWriter       jw(&sw);
+	jw.BeginArray();
+	for (auto it = begin; it != end; it++)
+		jw.String(*it);
+	jw.EndArray();
+}
+
+// Rebuild the cached listings from AllPhotos and AllDatasets. This must be called whenever
+// either of them changes.
+void Server::UpdateListings() {
+	auto build = [](const vector<string>& items) -> shared_ptr<const Listing> {
+		auto l   = make_shared<Listing>();
+		l->Items = items;
+		WriteStringArray(items.begin(), items.end(), l->Json);
+		l->Hash  = XXH64(l->Json.data(), l->Json.size(), 0);
+
+		void*  enc    = nullptr;
+		size_t encLen = 0;
+		if (compress::zlib::Compress(l->Json.data(), l->Json.size(), enc, encLen, compress::zlib::FlagGzip | compress::zlib::FlagLevel6).OK()) {
+			l->Gzip.assign((const char*) enc, encLen);
+			free(enc);
+		}
+		return l;
+	};
+	auto photos   = build(AllPhotos);
+	auto datasets = build(AllDatasets);
+
+	lock_guard<mutex> lock(ListingLock);
+	PhotoListing   = photos;
+	DatasetListing = datasets;
+}
+
+// Serve a JSON array of strings, from a Listing.
+// Query parameters:
+//   prefix  Only return items that start with prefix
+//   offset  Skip this many items (after applying prefix)
+//   limit   Return at most this many items. Zero means no limit.
+// The number of items that match prefix (ignoring offset and limit) is returned in the X-Total-Count header.
+void Server::ServeListing(phttp::Response& w, phttp::RequestPtr r, const std::shared_ptr<const Listing>& listingRef) {
+	shared_ptr<const Listing> listing;
+	{
+		lock_guard<mutex> lock(ListingLock);
+		listing = listingRef;
+	}
+	string  prefix = r->QueryVal("prefix");
+	int64_t offset = std::max<int64_t>(0, r->QueryInt64("offset"));
+	int64_t limit  = std::max<int64_t>(0, r->QueryInt64("limit"));
+	bool    whole  = prefix == "" && offset == 0 && limit == 0;
+
+	// Items are sorted, so all of the items that match prefix are contiguous
+	const auto& items = listing->Items;
+	auto        begin = lower_bound(items.begin(), items.end(), prefix);
+	auto        end   = partition_point(begin, items.end(), [&](const string& item) { return strings::StartsWith(item, prefix); });
+	size_t      total = end - begin;
+
+	// Build a partial page up front, because its size decides whether we compress it
+	string page;
+	if (!whole) {
+		begin += std::min<size_t>(offset, total);
+		if (limit != 0 && end - begin > limit)
+			end = begin + limit;
+		WriteStringArray(begin, end, page);
+	}
+
+	// Small pages are not worth compressing
+	bool acceptGzip = r->Header("Accept-Encoding").find("gzip") != string::npos;
+	bool gzip       = acceptGzip && (whole ? listing->Gzip.size() != 0 : page.size() > 16 * 1024);
+
+	// The gzip and identity representations are different bytes, so they need different strong ETags
+	auto query = tsf::fmt("%v\n%v\n%v", prefix, offset, limit);
+	auto etag  = tsf::fmt("\"%016x-%016x%v\"", listing->Hash, XXH64(query.data(), query.size(), 0), gzip ? "-gzip" : "");
+	w.SetHeader("ETag", etag);
+	w.SetHeader("Cache-Control", "no-cache"); // Always revalidate, because the photo set can change
+	w.SetHeader("Vary", "Accept-Encoding");
+	w.SetHeader("X-Total-Count", tsf::fmt("%v", total));
+	if (r->Header("If-None-Match") == etag) {
+		w.Status = 304;
+		return;
+	}
+
+	w.SetHeader("Content-Type", "application/json");
+	if (whole) {
+		if (gzip) {
+			w.SetHeader("Content-Encoding", "gzip");
+			w.Body = listing->Gzip;
+		} else {
+			w.Body = listing->Json;
+		}
+		w.Status = 200;
+		return;
+	}
+
+	w.Body = std::move(page);
+	if (gzip) {
+		void*  enc    = nullptr;
+		size_t encLen = 0;
+		auto   err    = compress::zlib::Compress(w.Body.data(), w.Body.size(), enc, encLen, compress::zlib::FlagGzip | compress::zlib::FlagLevel1);
+		if (!err.OK()) {
+			w.SetStatusAndBody(500, err.Message());
+			return;
+		}
+		w.SetHeader("Content-Encoding", "gzip");
+		w.Body.assign((const char*) enc, encLen);
+		free(enc);
+	}
+	w.Status = 200;
 }
 
 void Server::SendFile(phttp::Response& w, std::string filename) {
@@ -211,6 +318,110 @@ void Server::SendFile(phttp::Response& w, std::string filename) {
 	}
 }
 
+// Serve a photo, optionally downscaled.
+// Query parameters:
+//   image   Path of the photo, relative to PhotoRoot
+//   width   Return the smallest variant that is at least this wide
+//   scale   Return the photo downscaled by 1/scale, where scale is 1, 2, 4 or 8
+// Downscaling uses libjpeg-turbo's scaled IDCT, so widths between the scaled sizes are rounded up.
+// Downscaled variants are kept in ImgCache, keyed by the photo's path, modification time and size,
+// so that a modified photo is never served from a stale variant. Originals are not cached.
+void Server::ServeImage(phttp::Response& w, phttp::RequestPtr r) {
+	auto image    = r->QueryVal("image");
+	auto filename = path::SafeJoin(PhotoRoot, image);
+	int  width    = r->QueryInt("width");
+	int  scale    = r->QueryInt("scale");
+
+	os::FileAttributes attribs;
+	auto               err = os::Stat(filename, attribs);
+	if (!err.OK()) {
+		w.SetStatusAndBody(404, tsf::fmt("Error reading %v: %v", filename, err.Message()));
+		return;
+	}
+
+	string ext    = strings::tolower(path::Extension(filename));
+	bool   isJpeg = ext == ".jpeg" || ext == ".jpg";
+	if (!isJpeg || width < 0 || scale < 0) {
+		width = 0;
+		scale = 0;
+	}
+
+	// Photos almost never change, but if one does, its modification time or size will change its ETag
+	auto     variant = tsf::fmt("%v\n%v\n%v\n%v\n%v", image, attribs.TimeModify.UnixNano(), attribs.Size, width, scale);
+	uint64_t hash    = XXH64(variant.data(), variant.size(), 0);
+	auto     etag    = tsf::fmt("\"%016x\"", hash);
+	w.SetHeader("ETag", etag);
+	w.SetHeader("Cache-Control", "public, max-age=604800");
+	if (r->Header("If-None-Match") == etag) {
+		w.Status = 304;
+		return;
+	}
+
+	// Originals are served straight from disk, and never go into ImgCache
+	if (width == 0 && scale <= 1) {
+		SendFile(w, filename);
+		return;
+	}
+
+	w.SetHeader("Content-Type", "image/jpeg");
+	auto cacheKey = tsf::fmt("%016x.jpeg", hash);
+	if (ImgCache.Get(cacheKey, w.Body))
+		return;
+
+	string raw;
+	err = os::ReadWholeFile(filename, raw);
+	if (!err.OK()) {
+		w.SetStatusAndBody(404, tsf::fmt("Error reading %v: %v", filename, err.Message()));
+		return;
+	}
+
+	gfx::ImageIO io;
+	if (width != 0) {
+		int fullWidth  = 0;
+		int fullHeight = 0;
+		err            = io.LoadJpegHeader(raw.data(), raw.size(), &fullWidth, &fullHeight);
+		if (!err.OK()) {
+			w.SetStatusAndBody(400, tsf::fmt("Error reading %v: %v", filename, err.Message()));
+			return;
+		}
+		scale = 1;
+		while (scale < 8 && (fullWidth + scale * 2 - 1) / (scale * 2) >= width)
+			scale *= 2;
+	} else {
+		scale = scale >= 8 ? 8 : scale >= 4 ? 4 : scale >= 2 ? 2 : 1;
+	}
+
+	if (scale == 1) {
+		// The original is the smallest variant that is wide enough. Don't copy it into the cache, where
+		// it would only evict real thumbnails. We've already read it, so we serve it as SendFile would.
+		w.Body = std::move(raw);
+		return;
+	}
+
+	int   vWidth  = 0;
+	int   vHeight = 0;
+	void* pixels  = nullptr;
+	err           = io.LoadJpegScaled(raw.data(), raw.size(), scale, vWidth, vHeight, pixels);
+	if (!err.OK()) {
+		w.SetStatusAndBody(400, tsf::fmt("Error decoding %v: %v", filename, err.Message()));
+		return;
+	}
+	void*  enc    = nullptr;
+	size_t encLen = 0;
+	err           = io.SaveJpeg(gfx::ImageFormat::RGBA, vWidth, vHeight, vWidth * 4, pixels, 85, gfx::JpegSampling::Samp420, enc, encLen);
+	free(pixels);
+	if (!err.OK()) {
+		w.SetStatusAndBody(500, tsf::fmt("Error encoding %v: %v", filename, err.Message()));
+		return;
+	}
+	w.Body.assign((const char*) enc, encLen);
+	gfx::ImageIO::FreeEncodedBuffer(gfx::ImageType::Jpeg, enc);
+
+	err = ImgCache.Put(cacheKey, w.Body);
+	if (!err.OK())
+		Log->Warn("Failed to cache %v: %v", cacheKey, err.Message());
+}
+
 // See example in readme.md
 Error Server::LoadDimensionsFile(std::string dimensionsFile) {
 	nlohmann::json j;
@@ -255,7 +466,8 @@ Error Server::LoadDimensionsFile(std::string dimensionsFile) {
 //     and is the interpretation followed by PostgreSQL, MySQL, Firebird, and Oracle.
 //     Informix and Microsoft SQL Server follow the other interpretation of the standard.
 // Return: The ID of the region.
-Error Server::ApiSetLabel(phttp::Response& w, phttp::RequestPtr r, dba::Tx* tx) {
+// deltas receives the changes to the label counts that are shown by /api/report.
+Error Server::ApiSetLabel(phttp::Response& w, phttp::RequestPtr r, dba::Tx* tx, std::vector<LabelCountDelta>& deltas) {
 	auto image     = r->QueryVal("image");
 	auto regionID  = r->QueryInt64("region_id");
 	auto region    = r->QueryVal("region");
@@ -336,6 +548,22 @@ Error Server::ApiSetLabel(phttp::Response& w, phttp::RequestPtr r, dba::Tx* tx)
 	if (!err.OK())
 		return err;
 
+	// Record the labels that we're about to replace or delete, so that we can update the report counters
+	{
+		string oldQuery = "SELECT dimension, category, author FROM label WHERE sample_id = ?";
+		if (regionMode != RegionMode::Delete)
+			oldQuery += " AND dimension = ?";
+		dba::AttribList oldParams;
+		oldParams.AddV(sampleID);
+		if (regionMode != RegionMode::Delete)
+			oldParams.AddV(dim);
+		auto rows = tx->Query(oldQuery.c_str(), oldParams.Size(), oldParams.ValuesPtr());
+		for (auto row : rows)
+			deltas.push_back({row[0].ToString(), row[1].ToString(), row[2].ToString(), -1});
+		if (!rows.OK())
+			return rows.Err();
+	}
+
 	if (regionMode == RegionMode::Delete) {
 		err = tx->Exec("DELETE FROM label WHERE sample_id = ?", {sampleID});
 		if (!err.OK())
@@ -352,6 +580,8 @@ Error Server::ApiSetLabel(phttp::Response& w, phttp::RequestPtr r, dba::Tx* tx)
 			               {sampleID, dim, category, intensity, author, time::Now()});
 		if (!err.OK())
 			return err;
+		if (!deleteThisLabel)
+			deltas.push_back({dim, category, author, 1});
 	}
 
 	w.SetHeader("Content-Type", "text/plain");
@@ -371,9 +601,7 @@ Error Server::ApiGetLabels(phttp::Response& w, phttp::RequestPtr r, dba::Tx* tx)
 		sampleQueryParams.AddV(queryImage);
 	}
 
-	string                       idList = "(";
-	auto                         rows   = tx->Query(sampleQuery.c_str(), sampleQueryParams.Size(), sampleQueryParams.ValuesPtr());
-	int64_t                      nID    = 0;
+	auto                         rows = tx->Query(sampleQuery.c_str(), sampleQueryParams.Size(), sampleQueryParams.ValuesPtr());
 	ohash::map<int64_t, int64_t> sampleIDToRegionID;
 	ohash::map<int64_t, string>  sampleIDToRegion;
 	ohash::map<int64_t, string>  sampleIDToImagePath;
@@ -388,59 +616,107 @@ Error Server::ApiGetLabels(phttp::Response& w, phttp::RequestPtr r, dba::Tx* tx)
 		sampleIDToRegionID.insert(sampleID, regionID);
 		sampleIDToRegion.insert(sampleID, region);
 		sampleIDToImagePath.insert(sampleID, imagePath);
-		idList += tsf::fmt("%v,", sampleID);
-		nID++;
 	}
 	if (!rows.OK())
 		return rows.Err();
-	if (nID != 0)
-		idList.erase(idList.end() - 1);
-	idList += ")";
 
-	if (nID == 0) {
+	if (sampleIDToImagePath.size() == 0) {
 		SendJson(w, nlohmann::json::object());
 		return Error();
 	}
 
-	string          labelQuery = tsf::fmt("SELECT sample_id, dimension, category, intensity FROM label WHERE sample_id IN %v", idList);
+	// Apply the same filter to the labels, by joining on sample, instead of building up a list of sample IDs.
+	// This keeps the SQL text constant, so that the statement is reused from the connection's statement cache.
+	// We always join, so that labels whose sample doesn't exist are excluded, just like they are from the sample maps.
+	string          labelQuery = "SELECT label.sample_id, label.dimension, label.category, label.intensity FROM label INNER JOIN sample ON sample.id = label.sample_id";
 	dba::AttribList labelQueryParams;
+	if (queryImage != "") {
+		labelQuery += " WHERE sample.image_path = ?";
+		labelQueryParams.AddV(queryImage);
+	}
 	if (queryDimension != "") {
-		labelQuery += " AND dimension = ?";
+		labelQuery += queryImage != "" ? " AND" : " WHERE";
+		labelQuery += " label.dimension = ?";
 		labelQueryParams.AddV(queryDimension);
 	}
-	nlohmann::json resp;
-	rows           = tx->Query(labelQuery.c_str(), labelQueryParams.Size(), labelQueryParams.ValuesPtr());
-	resp["images"] = nlohmann::json::object();
-	auto& jImages  = resp["images"];
+	struct LabelRow {
+		string ImagePath;
+		string RegionID;
+		string Region;
+		string Dimension;
+		string Category;
+		double Intensity = 0;
+	};
+	vector<LabelRow> labels;
+	rows = tx->Query(labelQuery.c_str(), labelQueryParams.Size(), labelQueryParams.ValuesPtr());
 	for (auto row : rows) {
-		int64_t sampleID = 0;
-		string  dim;
-		string  category;
-		double  intensity = 0;
-		auto    err       = row.Scan(sampleID, dim, category, intensity);
+		int64_t  sampleID = 0;
+		LabelRow l;
+		auto     err = row.Scan(sampleID, l.Dimension, l.Category, l.Intensity);
 		if (!err.OK())
 			return err;
-		auto imagePath  = sampleIDToImagePath.get(sampleID);
-		auto regionID64 = sampleIDToRegionID.get(sampleID);
-		auto region     = sampleIDToRegion.get(sampleID);
-		auto regionID   = tsf::fmt("%v", regionID64);
-		if (jImages.find(imagePath) == jImages.end()) {
-			jImages[imagePath] = nlohmann::json::object();
-		}
-		auto& jRegions = jImages[imagePath]["regions"];
-		if (jRegions.find(regionID) == jRegions.end() && region != "") {
-			jRegions[regionID]["region"] = region;
-		}
-		auto&          jRegion = jRegions[regionID];
-		nlohmann::json jVal;
-		jVal["category"]     = category;
-		jVal["intensity"]    = intensity;
-		jRegion["dims"][dim] = move(jVal);
+		auto imagePath = sampleIDToImagePath.getp(sampleID);
+		if (!imagePath)
+			continue;
+		l.ImagePath = *imagePath;
+		l.RegionID  = tsf::fmt("%v", sampleIDToRegionID.get(sampleID));
+		l.Region    = sampleIDToRegion.get(sampleID);
+		labels.push_back(move(l));
 	}
 	if (!rows.OK())
 		return rows.Err();
-	SendJson(w, resp);
-	return Error();
+
+	// Stream the response out, instead of building up a DOM of the whole thing. The keys of each object
+	// must be written in sorted order (as nlohmann::json would), so sort by image, region, and dimension.
+	stable_sort(labels.begin(), labels.end(), [](const LabelRow& a, const LabelRow& b) {
+		if (a.ImagePath != b.ImagePath)
+			return a.ImagePath < b.ImagePath;
+		if (a.RegionID != b.RegionID)
+			return a.RegionID < b.RegionID;
+		return a.Dimension < b.Dimension;
+	});
+	auto sameRegion = [&](size_t a, size_t b) {
+		return labels[a].ImagePath == labels[b].ImagePath && labels[a].RegionID == labels[b].RegionID;
+	};
+
+	w.SetHeader("Content-Type", "application/json");
+	w.Body.clear();
+	io::StringWriter out(w.Body);
+	JsonWriter       jw(&out);
+	jw.BeginObject();
+	jw.Key("images").BeginObject();
+	for (size_t i = 0; i < labels.size();) {
+		size_t image = i;
+		jw.Key(labels[image].ImagePath).BeginObject();
+		jw.Key("regions").BeginObject();
+		while (i < labels.size() && labels[i].ImagePath == labels[image].ImagePath) {
+			size_t region = i;
+			string regionValue;
+			jw.Key(labels[region].RegionID).BeginObject();
+			jw.Key("dims").BeginObject();
+			for (; i < labels.size() && sameRegion(i, region); i++) {
+				const auto& l = labels[i];
+				if (regionValue == "")
+					regionValue = l.Region;
+				// If a dimension is labeled more than once, the last label wins
+				if (i + 1 < labels.size() && sameRegion(i + 1, region) && labels[i + 1].Dimension == l.Dimension)
+					continue;
+				jw.Key(l.Dimension).BeginObject();
+				jw.Key("category").String(l.Category);
+				jw.Key("intensity").Double(l.Intensity);
+				jw.EndObject();
+			}
+			jw.EndObject(); // dims
+			if (regionValue != "")
+				jw.Key("region").String(regionValue);
+			jw.EndObject(); // region
+		}
+		jw.EndObject(); // regions
+		jw.EndObject(); // image
+	}
+	jw.EndObject(); // images
+	jw.EndObject();
+	return jw.Flush();
 }
 
 // Return a list of all images that contain at least one label matching the given criteria
@@ -528,22 +804,55 @@ void Server::ServeStatic(phttp::Response& w, phttp::RequestPtr r) {
 	w.Status = 200;
 }
 
-void Server::Report(phttp::Response& w, phttp::RequestPtr r) {
-	auto           rows = DB.DB->Query("SELECT count(*),min(dimension),min(category) FROM label GROUP BY dimension,category");
-	nlohmann::json jDoc;
+// Count labels once at startup. After that, ApplyReportDeltas keeps the counts up to date.
+Error Server::LoadReportCounters() {
+	lock_guard<mutex> lock(ReportLock);
+	ReportDimensions.clear();
+	ReportAuthors.clear();
+	auto rows = DB.DB->Query("SELECT count(*),min(dimension),min(category) FROM label GROUP BY dimension,category");
 	for (auto row : rows) {
-		int64_t count = 0;
-		string  dim;
-		string  category;
-		row.Scan(count, dim, category);
-		jDoc["dimensions"][dim][category]["count"] = count;
+		int64_t count    = row[0].ToInt64();
+		string  dim      = row[1].ToString();
+		string  category = row[2].ToString();
+		if (!ReportDimensions.contains(dim))
+			ReportDimensions.insert(dim, ohash::map<string, int64_t>());
+		ReportDimensions.getp(dim)->set(category, count);
 	}
-	rows = DB.DB->Query("SELECT count(*),min(author) FROM label GROUP BY author ORDER BY count(*) DESC");
-	for (auto row : rows) {
-		int64_t count = 0;
-		string  author;
-		row.Scan(count, author);
-		jDoc["authors"][author]["count"] = count;
+	if (!rows.OK())
+		return rows.Err();
+	rows = DB.DB->Query("SELECT count(*),min(author) FROM label GROUP BY author");
+	for (auto row : rows)
+		ReportAuthors.set(row[1].ToString(), row[0].ToInt64());
+	if (!rows.OK())
+		return rows.Err();
+	return Error();
+}
+
+void Server::ApplyReportDeltas(const std::vector<LabelCountDelta>& deltas) {
+	lock_guard<mutex> lock(ReportLock);
+	for (const auto& d : deltas) {
+		if (!ReportDimensions.contains(d.Dimension))
+			ReportDimensions.insert(d.Dimension, ohash::map<string, int64_t>());
+		auto categories = ReportDimensions.getp(d.Dimension);
+		categories->set(d.Category, categories->get(d.Category) + d.Delta);
+		ReportAuthors.set(d.Author, ReportAuthors.get(d.Author) + d.Delta);
+	}
+}
+
+void Server::Report(phttp::Response& w, phttp::RequestPtr r) {
+	nlohmann::json jDoc;
+	{
+		lock_guard<mutex> lock(ReportLock);
+		for (const auto& dim : ReportDimensions) {
+			for (const auto& cat : dim.second) {
+				if (cat.second > 0)
+					jDoc["dimensions"][dim.first][cat.first]["count"] = cat.second;
+			}
+		}
+		for (const auto& author : ReportAuthors) {
+			if (author.second > 0)
+				jDoc["authors"][author.first]["count"] = author.second;
+		}
 	}
 	SendJson(w, jDoc);
 }
@@ -590,24 +899,15 @@ void Server::Solve(phttp::Response& w, phttp::RequestPtr r) {
 }
 
 Error Server::GetImageSize(const std::string& image, std::pair<int, int>& size) {
-	{
-		lock_guard<mutex> lock(PhotoSizeLock);
-		if (PhotoSize.contains(image)) {
-			size = PhotoSize.get(image);
-			return Error();
-		}
-	}
-
-	gfx::ImageIO io;
-	string       fullpath = path::SafeJoin(PhotoRoot, image);
-	auto         err      = io.LoadJpegFileHeader(fullpath, &size.first, &size.second);
-	if (!err.OK())
-		return Error::Fmt("Failed to get size of %v: %v", fullpath, err.Message());
-
-	lock_guard<mutex> lock(PhotoSizeLock);
-	PhotoSize.insert(image, size);
-
-	return Error();
+	// Concurrent requests for the same image only read its header once
+	return PhotoSize.GetOrCompute(image, size, [&](pair<int, int>& sz) -> Error {
+		gfx::ImageIO io;
+		string       fullpath = path::SafeJoin(PhotoRoot, image);
+		auto         err      = io.LoadJpegFileHeader(fullpath, &sz.first, &sz.second);
+		if (!err.OK())
+			return Error::Fmt("Failed to get size of %v: %v", fullpath, err.Message());
+		return Error();
+	});
 }
 
 Error Server::DecodeRegion(const std::string& region, std::vector<gfx::Vec2d>& pts) {
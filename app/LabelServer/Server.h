@@ -1,6 +1,8 @@
 #pragma once
 
 #include "LabelDB.h"
+#include "ImageCache.h"
+#include "PhotoIndex.h"
 
 namespace imqs {
 namespace label {
@@ -16,6 +18,24 @@ public:
 	}
 };
 
+// A list that is served by /api/list_images or /api/datasets. The entire list is serialized and compressed
+// once, whenever the photo set changes. Paged and filtered requests are served from the sorted Items.
+struct Listing {
+	std::vector<std::string> Items;    // Sorted
+	std::string              Json;     // Compact JSON array of all Items
+	std::string              Gzip;     // Json, gzip compressed
+	uint64_t                 Hash = 0; // Hash of Json, which is the basis of our ETags
+};
+
+// A change in the number of labels of one (dimension, category, author), caused by set_label.
+// These are applied to the report counters after the transaction commits.
+struct LabelCountDelta {
+	std::string Dimension;
+	std::string Category;
+	std::string Author;
+	int64_t     Delta = 0;
+};
+
 // A trainable dimension
 //class Dimension {
 //public:
@@ -30,6 +50,7 @@ public:
 	std::vector<std::string> AllPhotos;
 	std::vector<std::string> AllDatasets;
 	nlohmann::json           DimensionsRaw;
+	uint64_t                 ImageCacheMaxBytes = 2 * 1024 * 1024 * (uint64_t) 1024; // Size limit of the cache of downscaled images
 	//ohash::map<std::string, Dimension> Dimensions; // Key is the name of dimension (eg road_type)
 	uberlog::Logger* Log = nullptr;
 
@@ -40,14 +61,29 @@ public:
 	static void SendFile(phttp::Response& w, std::string filename);
 
 private:
-	std::mutex                                   PhotoSizeLock; // Guards access to PhotoSize
-	ohash::map<std::string, std::pair<int, int>> PhotoSize;     // Cache of photo sizes
+	ShardedCache<std::string, std::pair<int, int>> PhotoSize{64 * 1024 * 1024}; // Cache of photo sizes. Budget is in bytes of key and value.
+
+	ImageCache ImgCache; // Downscaled images
+	PhotoIndex Photos;   // Persistent index of AllPhotos, including their dimensions
+
+	std::mutex                     ListingLock; // Guards PhotoListing and DatasetListing
+	std::shared_ptr<const Listing> PhotoListing;
+	std::shared_ptr<const Listing> DatasetListing;
+
+	std::mutex                                                ReportLock;       // Guards ReportDimensions and ReportAuthors
+	ohash::map<std::string, ohash::map<std::string, int64_t>> ReportDimensions; // dimension -> category -> number of labels
+	ohash::map<std::string, int64_t>                          ReportAuthors;    // author -> number of labels
 
 	Error      LoadDimensionsFile(std::string dimensionsFile);
-	Error      ApiSetLabel(phttp::Response& w, phttp::RequestPtr r, dba::Tx* tx);
+	void       UpdateListings();
+	void       ServeListing(phttp::Response& w, phttp::RequestPtr r, const std::shared_ptr<const Listing>& listingRef);
+	Error      LoadReportCounters();
+	void       ApplyReportDeltas(const std::vector<LabelCountDelta>& deltas);
+	Error      ApiSetLabel(phttp::Response& w, phttp::RequestPtr r, dba::Tx* tx, std::vector<LabelCountDelta>& deltas);
 	Error      ApiGetLabels(phttp::Response& w, phttp::RequestPtr r, dba::Tx* tx);
 	Error      ApiGetFolderSummary(phttp::Response& w, phttp::RequestPtr r, dba::Tx* tx);
 	void       ServeStatic(phttp::Response& w, phttp::RequestPtr r);
+	void       ServeImage(phttp::Response& w, phttp::RequestPtr r);
 	void       Report(phttp::Response& w, phttp::RequestPtr r);
 	void       Solve(phttp::Response& w, phttp::RequestPtr r);
 	Error      GetImageSize(const std::string& image, std::pair<int, int>& size);
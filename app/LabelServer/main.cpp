@@ -20,6 +20,7 @@ int main(int argc, const char** argv) {
 
 	argparse::Args args("LabelServer <photo dir> <dimensions>");
 	args.AddValue("e", "export", "Export labels to a hierarchy of folders ready to train a neural network");
+	args.AddValue("", "image-cache-mb", "Size limit of the cache of downscaled images, in megabytes", "2048");
 	if (!args.Parse(argc, argv) || args.Params.size() != 2) {
 		if (!args.WasHelpShown)
 			args.ShowHelp();
@@ -27,6 +28,7 @@ int main(int argc, const char** argv) {
 	}
 
 	imqs::label::Server s;
+	s.ImageCacheMaxBytes    = (uint64_t) AtoI64(args.Get("image-cache-mb").c_str()) * 1024 * 1024;
 	auto                err = s.Initialize(&log, args.Params[0], args.Params[1]);
 	if (!err.OK()) {
 		tsf::print("Error: %v\n", err.Message());
@@ -8,9 +8,9 @@ namespace imqs {
 namespace anno {
 
 void UI::LoadSaveThreadFunc(UI* ui) {
-	auto        lastLoad = time::Now();
-	std::string lastVideoFilename;
-	auto        reloadInterval = 60 * time::Second;
+	auto       lastLoad       = time::Now();
+	auto       reloadInterval = 60 * time::Second;
+	LabelStore store;
 
 	auto setError = [ui](std::string err) {
 		std::lock_guard<std::mutex> lock(ui->LoadSaveErrorLock);
@@ -22,36 +22,44 @@ void UI::LoadSaveThreadFunc(UI* ui) {
 		if (package) {
 			setError("");
 			if (ui->SaveQueue.compare_exchange_strong(package, nullptr)) {
-				// save last filename, so that loader knows about it
-				lastVideoFilename = package->VideoFilename;
-				for (const auto& frame : package->Labels.Frames) {
-					auto err = SaveFrameLabels(package->VideoFilename, ui->ModelName, frame);
-					if (!err.OK()) {
-						setError(tsf::fmt("Error saving labels for %v: %v", package->VideoFilename, err.Message()));
-						break; // don't try saving further frames
-					}
+				// The package tells us which video is open, so that the loader knows about it
+				Error err;
+				if (package->VideoFilename != store.GetVideoFilename()) {
+					err = store.Close();
+					if (err.OK() && package->VideoFilename != "")
+						err = store.Open(package->VideoFilename, ui->ModelName, os::HostName() + "-" + ui->UserName);
 				}
+				// The package only contains dirty frames. These are appended to the journal.
+				if (err.OK())
+					err = store.Save(package->Labels.Frames);
+				if (!err.OK())
+					setError(tsf::fmt("Error saving labels for %v: %v", package->VideoFilename, err.Message()));
 				delete package;
 			}
-		} else if (time::Now() - lastLoad > reloadInterval && lastVideoFilename != "") {
+		} else if (time::Now() - lastLoad > reloadInterval && store.IsOpen()) {
 			setError("");
 			package                = new LoadSavePackage();
-			package->VideoFilename = lastVideoFilename;
-			auto err               = LoadVideoLabels(lastVideoFilename, ui->ModelName, package->Labels);
+			package->VideoFilename = store.GetVideoFilename();
+			auto err               = store.LoadChanged(package->Labels);
 			if (!err.OK()) {
-				setError(tsf::fmt("Error loading labels for %v: %v", lastVideoFilename, err.Message()));
+				setError(tsf::fmt("Error loading labels for %v: %v", package->VideoFilename, err.Message()));
 				delete package;
 			} else {
 				// Ideally we should remove a stale doc here, but that just makes us more complicated. I don't believe it's worth the tradeoff.
 				LoadSavePackage* empty = nullptr;
-				if (!ui->LoadQueue.compare_exchange_strong(empty, package))
+				if (package->Labels.Frames.size() == 0 || !ui->LoadQueue.compare_exchange_strong(empty, package))
 					delete package;
-				lastLoad = time::Now();
 			}
+			lastLoad = time::Now();
 		} else {
 			os::Sleep(100 * time::Millisecond);
 		}
 	}
+
+	// Compact the journal into the per-frame files
+	auto err = store.Close();
+	if (!err.OK())
+		setError(tsf::fmt("Error saving labels: %v", err.Message()));
 }
 
 UI::UI(xo::DomNode* root) {
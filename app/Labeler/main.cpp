@@ -131,13 +131,13 @@ void xoMain(xo::SysWnd* wnd) {
 		ui->Render();
 }
 
-void ExportPatches(bool dirt) {
+void ExportPatches(bool dirt, imqs::train::ExportTypes type) {
 	// rsync -av /home/ben/win/t/Temp/ML/labels/ /home/ben/mldata/train/labels/
 	tsf::print("Exporting patches...\n");
 	using namespace imqs::train;
 	string model    = dirt ? "dirt" : "tar";
 	auto   taxonomy = CreateTaxonomy(dirt ? ClassifyModes::Dirt : ClassifyModes::Tar);
-	auto   err      = ExportLabeledImagePatches_Video_Bulk(ExportTypes::Jpeg, model, "/home/ben/mldata", taxonomy);
+	auto   err      = ExportLabeledImagePatches_Video_Bulk(type, model, "/home/ben/mldata", taxonomy);
 	if (!err.OK()) {
 		tsf::print("Error: %v\n", err.Message());
 		return;
@@ -155,9 +155,13 @@ int APIENTRY WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLi
 int main(int argc, char** argv) {
 	if (argc > 1) {
 		if (argc == 2 && strcmp(argv[1], "--dirt-patches") == 0) {
-			ExportPatches(true);
+			ExportPatches(true, imqs::train::ExportTypes::Jpeg);
 		} else if (argc == 2 && strcmp(argv[1], "--tar-patches") == 0) {
-			ExportPatches(false);
+			ExportPatches(false, imqs::train::ExportTypes::Jpeg);
+		} else if (argc == 2 && strcmp(argv[1], "--dirt-shards") == 0) {
+			ExportPatches(true, imqs::train::ExportTypes::Shards);
+		} else if (argc == 2 && strcmp(argv[1], "--tar-shards") == 0) {
+			ExportPatches(false, imqs::train::ExportTypes::Shards);
 		} else {
 			tsf::print("Unrecognized command\n");
 			return 1;
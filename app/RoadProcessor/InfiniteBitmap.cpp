@@ -203,28 +203,27 @@ Error InfiniteBitmap::CreateWebTiles(int zoomLevel) {
 		int64_t x = AtoI64(t.Name.substr(2, 8).c_str());
 		int64_t y = AtoI64(t.Name.substr(11, 8).c_str());
 
-		mutex loadLock;
-		bool  isLoaded     = false;
-		auto  ensureLoaded = [&]() -> Error {
-            lock_guard<mutex> lock(loadLock);
-            if (!isLoaded) {
-                auto err = Load(zoomLevel, Rect64(x * TileSize, y * TileSize, (x + 1) * TileSize, (y + 1) * TileSize), img);
-                if (!err.OK())
-                    return err;
-            }
-            return Error();
-		};
-
 		int64_t absMacroX = xOffset + x * (TileSize / webTileSize);
 		int64_t absMacroY = yOffset + y * (TileSize / webTileSize);
 
 		// native resolution
 		int nchunk = TileSize / webTileSize;
 
-		vector<Point32> chunks;
+		struct WebTile {
+			int    CX    = 0;
+			int    CY    = 0;
+			bool   Stale = false; // Missing, or older than the lz4 tile
+			string Filename;
+			string Jpeg;
+		};
+		vector<WebTile> tiles;
 		for (int cy = 0; cy < nchunk; cy++) {
 			for (int cx = 0; cx < nchunk; cx++) {
-				chunks.emplace_back(cx, cy);
+				WebTile wt;
+				wt.CX       = cx;
+				wt.CY       = cy;
+				wt.Filename = path::Join(outDir, ItoA(zoomLevel), ItoA(absMacroX + cx), tsf::fmt("%d.jpeg", absMacroY + cy));
+				tiles.push_back(std::move(wt));
 			}
 		}
 
@@ -234,43 +233,58 @@ Error InfiniteBitmap::CreateWebTiles(int zoomLevel) {
             err = newErr;
 		};
 
-		int chunks_size = chunks.size();
-#pragma omp parallel for
-		for (int i = 0; i < chunks_size; i++) {
-			{
-				// this is our equivalent of a 'break' statement, because we're not allowed to break out of an OMP loop
-				lock_guard<mutex> lock(errorLock);
-				if (!err.OK())
+		// Creating directories and writing files runs on the IO lane, and JPEG encoding runs on the CPU lane.
+		// First find the web tiles that are missing, or older than the lz4 tile.
+
+		auto findStale = [&](size_t first, size_t last) {
+			for (size_t k = first; k < last; k++) {
+				os::FileAttributes attribs;
+				if (os::Stat(tiles[k].Filename, attribs).OK() && attribs.TimeModify > t.TimeModify)
 					continue;
+				auto e = os::MkDirAll(path::Dir(tiles[k].Filename));
+				if (!e.OK()) {
+					setLockedError(e);
+					continue;
+				}
+				tiles[k].Stale = true;
 			}
-			int     cx         = chunks[i].x;
-			int     cy         = chunks[i].y;
-			int64_t absX       = absMacroX + cx;
-			int64_t absY       = absMacroY + cy;
-			string  outTileDir = path::Join(outDir, ItoA(zoomLevel), ItoA(absX));
-			auto    e          = os::MkDirAll(outTileDir);
-			if (!e.OK()) {
-				setLockedError(e);
-				continue;
-			}
-			string             outTileFile = path::Join(outTileDir, tsf::fmt("%d.jpeg", absY));
-			os::FileAttributes attribs;
-			e = os::Stat(outTileFile, attribs);
-			if (e.OK() && attribs.TimeModify > t.TimeModify) {
-				// tile already exists, and is newer than the lz4 tile
-				continue;
-			}
-			e = ensureLoaded();
-			if (!e.OK()) {
-				setLockedError(e);
-				continue;
-			}
-			auto chunk = img.Window(cx * webTileSize, cy * webTileSize, webTileSize, webTileSize);
-			e          = chunk.SaveJpeg(outTileFile, jpegQuality, jpegSampling);
-			if (!e.OK()) {
-				setLockedError(e);
-				continue;
-			}
+		};
+		sync::ParallelFor(0, tiles.size(), 1, findStale, sync::TaskLane::IO);
+		if (!err.OK())
+			return err;
+
+		bool anyStale = false;
+		for (const auto& wt : tiles)
+			anyStale = anyStale || wt.Stale;
+		if (anyStale) {
+			err = Load(zoomLevel, Rect64(x * TileSize, y * TileSize, (x + 1) * TileSize, (y + 1) * TileSize), img);
+			if (!err.OK())
+				return err;
+
+			auto encode = [&](size_t first, size_t last) {
+				for (size_t k = first; k < last; k++) {
+					if (!tiles[k].Stale)
+						continue;
+					auto chunk = img.Window(tiles[k].CX * webTileSize, tiles[k].CY * webTileSize, webTileSize, webTileSize);
+					auto e     = chunk.SaveJpegBuffer(tiles[k].Jpeg, jpegQuality, jpegSampling);
+					if (!e.OK())
+						setLockedError(e);
+				}
+			};
+			sync::ParallelFor(0, tiles.size(), 1, encode);
+			if (!err.OK())
+				return err;
+
+			auto write = [&](size_t first, size_t last) {
+				for (size_t k = first; k < last; k++) {
+					if (!tiles[k].Stale)
+						continue;
+					auto e = os::WriteWholeFile(tiles[k].Filename, tiles[k].Jpeg);
+					if (!e.OK())
+						setLockedError(e);
+				}
+			};
+			sync::ParallelFor(0, tiles.size(), 1, write, sync::TaskLane::IO);
 		}
 		if (!err.OK())
 			return err;
@@ -718,46 +718,48 @@ FlowResult OpticalFlow::Frame(Mesh& warpMesh, Frustum warpFrustum, const gfx::Im
 			dxMin          = -fineAdjust;
 			dxMax          = fineAdjust;
 		}
-		int     searchWindowSize = (dxMax - dxMin) * (dyMax - dyMin);
-		int64_t allDiffSum       = 0;
-		int     nValidCells      = validCells.size();
-		// omp parallel here takes us from 22 milliseconds to 6 milliseconds
+		int                  searchWindowSize = (dxMax - dxMin) * (dyMax - dyMin);
+		std::atomic<int64_t> allDiffSum;
+		allDiffSum = 0;
+		// Running this in parallel takes us from 22 milliseconds to 6 milliseconds
 		//auto start = time::PerformanceCounter();
-#pragma omp parallel for
-		for (int iCell = 0; iCell < nValidCells; iCell++) {
-			auto& c = validCells[iCell];
-			//Vec2f  cSrc    = warpMesh.UVimg(warpImg.Width, warpImg.Height, c.x, c.y);
-			Vec2f  cSrc    = warpMesh.At(c.x, c.y).UV;
-			Vec2f  cDst    = warpMesh.At(c.x, c.y).Pos;
-			Rect32 rect1   = MakeBoxAroundPoint((int) cSrc.x, (int) cSrc.y, MatchRadius);
-			Rect32 rect2   = MakeBoxAroundPoint((int) cDst.x, (int) cDst.y, MatchRadius);
-			int    bestSum = INT32_MAX;
-			int    bestDx  = 0;
-			int    bestDy  = 0;
-			//int64_t avgSum  = 0;
-			for (int dy = dyMin; dy <= dyMax; dy++) {
-				for (int dx = dxMin; dx <= dxMax; dx++) {
-					Rect32 r2 = rect2;
-					r2.Offset(dx, dy);
-					if (r2.x1 < 0 || r2.y1 < 0 || r2.x2 > stableImg->Width || r2.y2 > stableImg->Height) {
-						// skip invalid rectangle which is outside of stableImg
-						continue;
-					}
-					int32_t sum = (int32_t) DiffSum(*warpImg, *stableImg, rect1, r2);
-					//avgSum += sum;
-					if (sum < bestSum) {
-						bestSum = sum;
-						bestDx  = dx;
-						bestDy  = dy;
+		sync::ParallelFor(0, validCells.size(), 0, [&](size_t first, size_t last) {
+			int64_t localDiffSum = 0;
+			for (size_t iCell = first; iCell < last; iCell++) {
+				auto& c = validCells[iCell];
+				//Vec2f  cSrc    = warpMesh.UVimg(warpImg.Width, warpImg.Height, c.x, c.y);
+				Vec2f  cSrc    = warpMesh.At(c.x, c.y).UV;
+				Vec2f  cDst    = warpMesh.At(c.x, c.y).Pos;
+				Rect32 rect1   = MakeBoxAroundPoint((int) cSrc.x, (int) cSrc.y, MatchRadius);
+				Rect32 rect2   = MakeBoxAroundPoint((int) cDst.x, (int) cDst.y, MatchRadius);
+				int    bestSum = INT32_MAX;
+				int    bestDx  = 0;
+				int    bestDy  = 0;
+				//int64_t avgSum  = 0;
+				for (int dy = dyMin; dy <= dyMax; dy++) {
+					for (int dx = dxMin; dx <= dxMax; dx++) {
+						Rect32 r2 = rect2;
+						r2.Offset(dx, dy);
+						if (r2.x1 < 0 || r2.y1 < 0 || r2.x2 > stableImg->Width || r2.y2 > stableImg->Height) {
+							// skip invalid rectangle which is outside of stableImg
+							continue;
+						}
+						int32_t sum = (int32_t) DiffSum(*warpImg, *stableImg, rect1, r2);
+						//avgSum += sum;
+						if (sum < bestSum) {
+							bestSum = sum;
+							bestDx  = dx;
+							bestDy  = dy;
+						}
 					}
 				}
+				localDiffSum += bestSum;
+				// I thought this would work well, indicating patches that have good detail for matching, but it doesn't work. No idea why not.
+				//warpMesh.At(c.x, c.y).DeltaStrength = float((double) avgSum / (double) searchWindowSize) / ((float) bestSum + 0.1f);
+				warpMesh.At(c.x, c.y).Pos += Vec2f(bestDx, bestDy);
 			}
-#pragma omp atomic
-			allDiffSum += bestSum;
-			// I thought this would work well, indicating patches that have good detail for matching, but it doesn't work. No idea why not.
-			//warpMesh.At(c.x, c.y).DeltaStrength = float((double) avgSum / (double) searchWindowSize) / ((float) bestSum + 0.1f);
-			warpMesh.At(c.x, c.y).Pos += Vec2f(bestDx, bestDy);
-		}
+			allDiffSum += localDiffSum;
+		});
 		//auto duration = time::PerformanceCounter() - start;
 		//tsf::print("flow time: %v microseconds\n", duration / 1000);
 		if (debugMedianFilter) {
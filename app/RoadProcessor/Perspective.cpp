@@ -403,38 +403,39 @@ void RemovePerspective(const Image& camera, Image& flat, float z1, float zx, flo
 	// UPDATE: version 2 of the sticher looks better with lens correction on
 	bool doLensCorrection = global::Lens != nullptr;
 
-#pragma omp parallel for
-	for (int y = 0; y < flat.Height; y++) {
-		uint32_t* dst32 = (uint32_t*) flat.Data;
-		dst32 += y * flat.Width;
-		int     srcWidth = camera.Width;
-		void*   src      = camera.Data;
-		int32_t camHalfX = 256 * camera.Width / 2;
-		int32_t camHalfY = 256 * camera.Height / 2;
-		size_t  xStart   = (size_t) ceil(x1Edge + (float) y * x1Inc);
-		size_t  xEnd     = (size_t) floor(x2Edge + (float) y * x2Inc);
-		float   yM       = (float) y + originY;
-		float   xM       = originX + xStart;
-		for (size_t x = xStart; x < xEnd; x++, xM++) {
-			int32_t u, v;
-			// Flat to undistorted camera
-			FlatToCameraInt256(z1, zx, zy, xM, yM, u, v);
-			u += camHalfX;
-			v += camHalfY;
-			if (doLensCorrection) {
-				// undistorted camera to raw camera
-				uint32_t fixed = raster::ImageBilinear_RG_U16(global::LensFixedtoRaw, srcWidth, srcClampU, srcClampV, u, v);
-				u              = fixed & 0xffff;
-				v              = fixed >> 16;
-				// bring the distortion parameters up to the required 8 bits of sub-pixel precision
-				u = u << (8 - DistortSubPixelBits);
-				v = v << (8 - DistortSubPixelBits);
+	sync::ParallelFor(0, flat.Height, 0, [&](size_t yFirst, size_t yLast) {
+		for (int y = (int) yFirst; y < (int) yLast; y++) {
+			uint32_t* dst32 = (uint32_t*) flat.Data;
+			dst32 += y * flat.Width;
+			int     srcWidth = camera.Width;
+			void*   src      = camera.Data;
+			int32_t camHalfX = 256 * camera.Width / 2;
+			int32_t camHalfY = 256 * camera.Height / 2;
+			size_t  xStart   = (size_t) ceil(x1Edge + (float) y * x1Inc);
+			size_t  xEnd     = (size_t) floor(x2Edge + (float) y * x2Inc);
+			float   yM       = (float) y + originY;
+			float   xM       = originX + xStart;
+			for (size_t x = xStart; x < xEnd; x++, xM++) {
+				int32_t u, v;
+				// Flat to undistorted camera
+				FlatToCameraInt256(z1, zx, zy, xM, yM, u, v);
+				u += camHalfX;
+				v += camHalfY;
+				if (doLensCorrection) {
+					// undistorted camera to raw camera
+					uint32_t fixed = raster::ImageBilinear_RG_U16(global::LensFixedtoRaw, srcWidth, srcClampU, srcClampV, u, v);
+					u              = fixed & 0xffff;
+					v              = fixed >> 16;
+					// bring the distortion parameters up to the required 8 bits of sub-pixel precision
+					u = u << (8 - DistortSubPixelBits);
+					v = v << (8 - DistortSubPixelBits);
+				}
+				// read from raw camera
+				uint32_t color = raster::ImageBilinearRGBA(src, srcWidth, srcClampU, srcClampV, u, v);
+				dst32[x]       = color;
 			}
-			// read from raw camera
-			uint32_t color = raster::ImageBilinearRGBA(src, srcWidth, srcClampU, srcClampV, u, v);
-			dst32[x]       = color;
 		}
-	}
+	});
 }
 
 void RemovePerspective(const gfx::Image& camera, gfx::Image& flat, PerspectiveParams pp, float originX, float originY) {
@@ -23,15 +23,16 @@ namespace imqs {
 namespace roadproc {
 
 GCSStorage::~GCSStorage() {
-	IsDying = 1;
+	if (Queue)
+		Queue->Close();
 	if (WriteThread.joinable())
 		WriteThread.join();
 }
 
 Error GCSStorage::Initialize(std::string bucketName, std::string apiKey) {
-	IsDying     = 0;
 	BucketName  = bucketName;
 	APIKey      = apiKey;
+	Queue       = std::unique_ptr<BoundedQueue<CreateItem>>(new BoundedQueue<CreateItem>(MaxQueueSize));
 	WriteThread = std::thread(WriteThreadFuncWrapper, this);
 	return Error();
 }
@@ -43,24 +44,17 @@ Error GCSStorage::Create(std::string filename, FileStorageClass klass, const voi
 			return LastError;
 	}
 
-	for (int delay = 1; true; delay = min(delay + 1, 5)) {
-		QueueLock.lock();
-		if (Queue.size() < MaxQueueSize) {
-			QueueLock.unlock();
-			break;
-		}
-		tsf::print("Writer queue is full (%v). Waiting...\n", Queue.size());
-		QueueLock.unlock();
-		os::Sleep(delay * time::Second);
-	}
-
 	CreateItem ci;
 	ci.Filename = filename;
 	ci.Class    = klass;
 	ci.Data.assign((const char*) buf, len);
-	QueueLock.lock();
-	Queue.push_back(std::move(ci));
-	QueueLock.unlock();
+	if (!Queue->TryPush(std::move(ci))) {
+		tsf::print("Writer queue is full (%v). Waiting...\n", Queue->SizeApprox());
+		if (!Queue->Push(std::move(ci)))
+			return Error("GCSStorage is closed");
+	}
+
+	lock_guard<mutex> lock(LastErrorLock);
 	return LastError;
 }
 
@@ -101,24 +95,8 @@ void GCSStorage::WriteThreadFuncWrapper(GCSStorage* self) {
 
 void GCSStorage::WriteThreadFunc() {
 	http::Connection httpClient;
-	int              idle = 0;
-	while (true) {
-		if (IsDying != 0)
-			break;
-		CreateItem ci;
-		{
-			lock_guard<mutex> lock(QueueLock);
-			if (Queue.size() != 0) {
-				ci = Queue.front();
-				Queue.erase(Queue.begin());
-			}
-		}
-		// empty filename = empty queue
-		if (ci.Filename == "") {
-			os::Sleep(500 * time::Millisecond);
-			continue;
-		}
-
+	CreateItem       ci;
+	while (Queue->Pop(ci)) {
 		Error err;
 		for (int attempt = 0; attempt < 5; attempt++) {
 			err = WriteThreadFunc_WriteItem(httpClient, ci);
@@ -10,7 +10,7 @@ public:
 	std::string BucketName;
 	std::string APIKey;
 	bool        DebugMessages = true;
-	size_t      MaxQueueSize  = 200; // Once writer queue reaches this size, we stall on Create()
+	size_t      MaxQueueSize  = 200; // Once writer queue reaches this size, we stall on Create(). Must be set before Initialize(), and is rounded up to a power of 2.
 
 	~GCSStorage() override;
 
@@ -25,13 +25,11 @@ private:
 		FileStorageClass Class;
 		std::string      Data;
 	};
-	http::Connection        ReadClient;
-	std::mutex              LastErrorLock; // Guards access to LastError
-	Error                   LastError;
-	std::atomic<int32_t>    IsDying;
-	std::thread             WriteThread;
-	std::mutex              QueueLock; // Guards access to Queue
-	std::vector<CreateItem> Queue;
+	http::Connection                          ReadClient;
+	std::mutex                                LastErrorLock; // Guards access to LastError
+	Error                                     LastError;
+	std::thread                               WriteThread;
+	std::unique_ptr<BoundedQueue<CreateItem>> Queue; // Closed by the destructor, after which WriteThread uploads whatever is left, and exits
 
 	static std::string MakeFullname(std::string filename);
 	static void        WriteThreadFuncWrapper(GCSStorage* self);
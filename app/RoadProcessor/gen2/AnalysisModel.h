@@ -1,6 +1,7 @@
 #pragma once
 
 #include "PhotoJob.h"
+#include "PipelineStats.h"
 
 namespace imqs {
 namespace roadproc {
@@ -37,7 +38,8 @@ public:
 	std::string                PostNNModelVersion = "1.0.0"; // Version of the C++ code that is running after the Neural Network
 
 	// Run on input of shape BCHW, where B = BatchSize, C = 3, H = CropParams.TargetHeight, W = CropParams.TargetWidth
-	virtual Error Run(std::mutex& gpuLock, const torch::Tensor& input, const std::vector<PhotoJob*>& output) = 0;
+	// Hold gpuLock while running on the GPU. It records the time spent waiting for the GPU in the caller's stage.
+	virtual Error Run(TimedLock& gpuLock, const torch::Tensor& input, const std::vector<PhotoJob*>& output) = 0;
 
 	// Wrapper around static Load()
 	Error Load(std::string baseFilename);
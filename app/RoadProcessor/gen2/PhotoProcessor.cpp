@@ -21,6 +21,9 @@ struct PhotoAndAnalysis {
 	std::string ModelVersion;
 };
 
+// Names of the queues in between the pipeline stages, for telemetry
+static const vector<string> QueueNames = {"not_started", "downloaded", "have_road_type", "done"};
+
 struct BusyLock {
 	std::atomic<int>* Counter;
 	BusyLock(std::atomic<int>& counter) {
@@ -94,6 +97,7 @@ PhotoProcessor::PhotoProcessor() {
 	QDone.Initialize(true);
 	TotalUploaded   = 0;
 	BusyLockCounter = 0;
+	StatsInterval   = 10 * time::Second;
 
 	CloudStorage.Bucket    = "roadphoto.imqs.co.za";
 	CloudStorage.Platform  = "gcs";
@@ -120,9 +124,11 @@ int PhotoProcessor::Run(argparse::Args& args) {
 	auto           prefix   = args.Params[3];
 	auto           cloudKey = args.Params[4];
 	PhotoProcessor pp;
-	pp.BaseUrl = args.Get("server");
-	pp.RedoAll = args.Has("all");
-	auto err   = pp.RunInternal(username, password, client, prefix, cloudKey);
+	pp.BaseUrl       = args.Get("server");
+	pp.RedoAll       = args.Has("all");
+	pp.StatsFile     = args.Get("stats");
+	pp.StatsInterval = int64_t(atof(args.Get("statsinterval").c_str()) * 1000) * time::Millisecond;
+	auto err         = pp.RunInternal(username, password, client, prefix, cloudKey);
 	if (!err.OK()) {
 		tsf::print("Error: %v\n", err.Message());
 		return 1;
@@ -135,6 +141,12 @@ Error PhotoProcessor::RunInternal(string username, string password, string clien
 	StartTime     = time::Now();
 	TotalUploaded = 0;
 
+	if (StatsFile != "") {
+		auto err = Stats.Open(StatsFile);
+		if (!err.OK())
+			return err;
+	}
+
 	tsf::print("Logging in to 'Console' service\n");
 	http::Connection cx;
 	auto             err = global::Login(cx, BaseUrl, username, password, SessionCookie);
@@ -197,6 +209,9 @@ Error PhotoProcessor::RunInternal(string username, string password, string clien
 	for (int i = 0; i < NumUploadThreads; i++)
 		threads.push_back(thread([&] { UploadThread(); }));
 
+	if (StatsFile != "")
+		threads.push_back(thread([&] { MonitorThread(); }));
+
 	// wait for all queues to drain
 	while (QNotStarted.Size() != 0 || QDownloaded.Size() != 0 || QHaveRoadType.Size() != 0 || QDone.Size() != 0 || BusyLockCounter != 0) {
 		os::Sleep(50 * time::Millisecond);
@@ -215,6 +230,9 @@ Error PhotoProcessor::RunInternal(string username, string password, string clien
 	for (auto& t : threads)
 		t.join();
 
+	if (StatsFile != "")
+		Stats.Emit(QueueNames);
+
 	return Error();
 }
 
@@ -223,8 +241,10 @@ void PhotoProcessor::FetchThread() {
 	gfx::ImageIO          imgIO;
 	avir::CImageResizer<> resizer(8, 0, avir::CImageResizerParamsDef());
 
+	auto& stage = Stats.Stages[PipelineStats::Fetch];
+
 	while (!Finished) {
-		QNotStarted.SemaphoreObj().wait();
+		WaitForInput(stage, QNotStarted);
 		BusyLock busy(BusyLockCounter);
 		auto     job = QNotStarted.PopTailR();
 		if (Finished)
@@ -243,6 +263,7 @@ void PhotoProcessor::FetchThread() {
 			resp = cx.Get(url);
 			if (resp.Is200())
 				break;
+			stage.Retries++;
 			tsf::print("Failed to download '%v'. Retrying...\n");
 			os::Sleep((1 << i) * time::Second);
 		}
@@ -310,7 +331,8 @@ void PhotoProcessor::FetchThread() {
 
 		tsf::print("Decoded %4d %v\n", job->InternalID, job->PhotoURL);
 
-		PushToQueue(QDownloaded, MaxQDownloaded, job);
+		stage.Items++;
+		PushToQueue(stage, QDownloaded, MaxQDownloaded, job);
 	}
 }
 
@@ -324,15 +346,18 @@ void PhotoProcessor::RoadTypeThread() {
 	if (EnableRoadType)
 		batch = torch::empty({RoadTypeBatchSize, 3, 256, 1000});
 
+	auto& stage = Stats.Stages[PipelineStats::RoadType];
+
 	while (!Finished) {
-		QDownloaded.SemaphoreObj().wait();
+		WaitForInput(stage, QDownloaded);
 		BusyLock busy(BusyLockCounter);
 		auto     job = QDownloaded.PopTailR();
 		if (Finished)
 			break;
 
 		if (!EnableRoadType) {
-			PushToQueue(QHaveRoadType, MaxQHaveRoadType, job);
+			stage.Items++;
+			PushToQueue(stage, QHaveRoadType, MaxQHaveRoadType, job);
 			continue;
 		}
 
@@ -342,7 +367,8 @@ void PhotoProcessor::RoadTypeThread() {
 
 		if (batchJobs.size() != 0 && (batchJobs.size() == RoadTypeBatchSize || IsQueueDrained())) {
 			torch::NoGradGuard nograd;
-			GPULock.lock();
+			stage.AddBatch(batchJobs.size());
+			LockGPU(stage);
 			auto res = MRoadType.forward({batch.cuda()}).toTensor().cpu();
 			GPULock.unlock();
 			auto amax = torch::argmax(res, 1);
@@ -354,7 +380,8 @@ void PhotoProcessor::RoadTypeThread() {
 			for (size_t i = 0; i < batchJobs.size(); i++) {
 				batchJobs[i]->RoadType = (RoadTypeModel::Types) amax[i].item().toInt();
 				//tsf::print("Road Type: %v\n", (int) batchJobs[i]->RoadType);
-				PushToQueue(QHaveRoadType, MaxQHaveRoadType, batchJobs[i]);
+				stage.Items++;
+				PushToQueue(stage, QHaveRoadType, MaxQHaveRoadType, batchJobs[i]);
 			}
 			batchJobs.clear();
 		}
@@ -389,7 +416,7 @@ void PhotoProcessor::AssessmentThread_Gravel() {
 			vector<torch::Tensor> results; // one for each model
 			auto                  batchCuda = gravelBatch.cuda();
 			torch::NoGradGuard    nograd;
-			GPULock.lock();
+			LockGPU(Stats.Stages[PipelineStats::Assessment]);
 			for (auto& m : Models)
 				results.push_back(m.Model.forward({batchCuda}).toTensor());
 			GPULock.unlock();
@@ -416,9 +443,10 @@ void PhotoProcessor::AssessmentThread_Gravel() {
 void PhotoProcessor::AssessmentThread() {
 	torch::Tensor     batch = torch::empty({Model->BatchSize, 3, Model->CropParams.TargetHeight, Model->CropParams.TargetWidth});
 	vector<PhotoJob*> batchJobs; // the jobs inside this batch
+	auto&             stage = Stats.Stages[PipelineStats::Assessment];
 
 	while (!Finished) {
-		QHaveRoadType.SemaphoreObj().wait();
+		WaitForInput(stage, QHaveRoadType);
 		BusyLock busy(BusyLockCounter);
 		auto     job = QHaveRoadType.PopTailR();
 		if (Finished)
@@ -430,13 +458,17 @@ void PhotoProcessor::AssessmentThread() {
 
 		if (batchJobs.size() != 0 && (batchJobs.size() == Model->BatchSize || IsQueueDrained())) {
 			torch::NoGradGuard nograd;
-			auto               err = Model->Run(GPULock, batch, batchJobs);
+			stage.AddBatch(batchJobs.size());
+			TimedLock gpuLock(GPULock, stage.GPUWaitNS);
+			auto      err = Model->Run(gpuLock, batch, batchJobs);
 			if (!err.OK())
 				tsf::print("Error running model: %v\n", err.Message());
 
 			// send jobs to the next stage
-			for (size_t i = 0; i < batchJobs.size(); i++)
-				PushToQueue(QDone, MaxQDone, batchJobs[i]);
+			for (size_t i = 0; i < batchJobs.size(); i++) {
+				stage.Items++;
+				PushToQueue(stage, QDone, MaxQDone, batchJobs[i]);
+			}
 			batchJobs.clear();
 		}
 	}
@@ -457,9 +489,10 @@ void PhotoProcessor::UploadThread() {
 	batch["ModelVersion"] = Model->CombinedVersion();
 
 	http::Connection cx;
+	auto&            stage = Stats.Stages[PipelineStats::Upload];
 
 	while (!Finished) {
-		QDone.SemaphoreObj().wait();
+		WaitForInput(stage, QDone);
 		BusyLock busy(BusyLockCounter);
 		auto     job = QDone.PopTailR();
 		if (Finished)
@@ -470,6 +503,7 @@ void PhotoProcessor::UploadThread() {
 			err = CloudLoginIfExpired();
 			if (err.OK())
 				break;
+			stage.Retries++;
 			tsf::print("Failed to login to cloud: %v\n", err.Message());
 		}
 		if (!err.OK()) {
@@ -508,6 +542,7 @@ void PhotoProcessor::UploadThread() {
 			if (err.OK())
 				break;
 			tsf::print("Upload %v to cloud storage failed: %v\n", analysisPath, err.Message());
+			stage.Retries++;
 			if (attempt == MaxUploadAttempts) {
 				tsf::print("Giving up and aborting\n");
 				Finished = true;
@@ -530,6 +565,8 @@ void PhotoProcessor::UploadThread() {
 				req.Body = batch.dump();
 				auto res = cx.Perform(req);
 				if (res.Is200()) {
+					stage.AddBatch(batchSize);
+					stage.Items += batchSize;
 					TotalUploaded += batchSize;
 					batch["Photos"] = {};
 					batchSize       = 0;
@@ -537,6 +574,7 @@ void PhotoProcessor::UploadThread() {
 					break;
 				}
 				tsf::print("Upload failed (%v)\n", res.ToError().Message());
+				stage.Retries++;
 				if (attempt == MaxUploadAttempts) {
 					tsf::print("Giving up and aborting\n");
 					Finished = true;
@@ -604,7 +642,32 @@ Error PhotoProcessor::PublishModels() {
 	return res.ToError();
 }
 
-void PhotoProcessor::PushToQueue(TQueue<PhotoJob*>& queue, int maxQueueSize, PhotoJob* job) {
+// Periodically sample the queue depths, and emit telemetry
+void PhotoProcessor::MonitorThread() {
+	auto last = time::Now();
+	while (!Finished) {
+		size_t depths[4] = {QNotStarted.Size(), QDownloaded.Size(), QHaveRoadType.Size(), QDone.Size()};
+		Stats.SampleQueues(depths, 4);
+		if (time::Now() - last >= StatsInterval) {
+			Stats.Emit(QueueNames);
+			last = time::Now();
+		}
+		os::Sleep(100 * time::Millisecond);
+	}
+}
+
+void PhotoProcessor::WaitForInput(PipelineStage& stage, TQueue<PhotoJob*>& queue) {
+	StageTimer timer(stage.InputWaitNS);
+	queue.SemaphoreObj().wait();
+}
+
+void PhotoProcessor::LockGPU(PipelineStage& stage) {
+	StageTimer timer(stage.GPUWaitNS);
+	GPULock.lock();
+}
+
+void PhotoProcessor::PushToQueue(PipelineStage& stage, TQueue<PhotoJob*>& queue, int maxQueueSize, PhotoJob* job) {
+	StageTimer timer(stage.OutputWaitNS);
 	while (queue.Size() >= maxQueueSize) {
 		if (Finished) {
 			// This is necessary when we get cancelled. For example, if the upload thread fails too many
@@ -5,6 +5,7 @@
 #include "RoadType.h"
 #include "TarDefects.h"
 #include "CloudStorage.h"
+#include "PipelineStats.h"
 
 namespace imqs {
 namespace roadproc {
@@ -31,6 +32,10 @@ struct PhotoModel {
 // achieve maximum utilization of the GPU and CPU.
 // In order to force a pipeline flush, we send a null job down it. This is always used at the
 // end of the dataset.
+//
+// If StatsFile is set, then we emit a JSON line every StatsInterval, with per-stage throughput,
+// time blocked on input and output queues, GPU lock wait time, batch sizes, and retry counts.
+// Use this to find the bottleneck stage when tuning the thread counts, queue sizes, and batch sizes.
 class PhotoProcessor {
 public:
 	// We should only need a single thread for each neural network phase, because a single thread can
@@ -49,6 +54,8 @@ public:
 	time::Time          StartTime;                      // Time when RunInternal() started
 	std::mutex          CloudStorageLock;               // You must own this when reading or writing from CloudStorage
 	CloudStorageDetails CloudStorage;                   // Make sure you use CloudStorageLock
+	std::string         StatsFile;                      // If not empty, then write pipeline telemetry as JSON lines to this file (or "stdout")
+	time::Duration      StatsInterval;                  // Interval between telemetry reports
 
 	PhotoProcessor();
 
@@ -61,6 +68,7 @@ private:
 	std::string                SessionCookie; // Cookie on roads.imqs.co.za
 	std::mutex                 GPULock;       // Keep memory predictable by only running one model at a time
 	std::atomic<int>           BusyLockCounter;
+	PipelineStats              Stats;
 
 	//std::vector<PhotoModel>    Models;
 
@@ -84,9 +92,12 @@ private:
 	void        RoadTypeThread();
 	void        AssessmentThread();
 	void        UploadThread();
+	void        MonitorThread();
 	Error       LoadModels();
 	Error       PublishModels();
-	void        PushToQueue(TQueue<PhotoJob*>& queue, int maxQueueSize, PhotoJob* job);
+	void        PushToQueue(PipelineStage& stage, TQueue<PhotoJob*>& queue, int maxQueueSize, PhotoJob* job);
+	void        WaitForInput(PipelineStage& stage, TQueue<PhotoJob*>& queue);
+	void        LockGPU(PipelineStage& stage);
 	std::string CombinedModelVersion() const;
 	bool        IsQueueDrained();
 	Error       CloudLoginIfExpired();
@@ -0,0 +1,141 @@
+#include "pch.h"
+#include "PipelineStats.h"
+
+using namespace std;
+
+namespace imqs {
+namespace roadproc {
+
+PipelineStage::PipelineStage() {
+	Items        = 0;
+	InputWaitNS  = 0;
+	OutputWaitNS = 0;
+	GPUWaitNS    = 0;
+	Retries      = 0;
+	for (auto& b : Batches)
+		b = 0;
+}
+
+void PipelineStage::AddBatch(size_t size) {
+	Batches[std::min(size, (size_t) MaxBatchSize)]++;
+}
+
+PipelineStats::PipelineStats() {
+	Stages[Fetch].Name      = "fetch";
+	Stages[RoadType].Name   = "road_type";
+	Stages[Assessment].Name = "assessment";
+	Stages[Upload].Name     = "upload";
+	LastEmit                = time::Now();
+}
+
+PipelineStats::~PipelineStats() {
+	File.Close();
+}
+
+Error PipelineStats::Open(const std::string& filename) {
+	lock_guard<mutex> lock(Lock);
+	ToStdout = filename == "stdout";
+	if (!ToStdout) {
+		auto err = File.Create(filename);
+		if (!err.OK())
+			return err;
+	}
+	IsOpen   = true;
+	LastEmit = time::Now();
+	for (int i = 0; i < NumStages; i++)
+		Last[i] = Snapshot(Stages[i]);
+	return Error();
+}
+
+void PipelineStats::SampleQueues(const size_t* depths, size_t n) {
+	lock_guard<mutex> lock(Lock);
+	if (QueueSum.size() != n) {
+		QueueSum.resize(n, 0);
+		QueueMax.resize(n, 0);
+		QueueCur.resize(n, 0);
+	}
+	for (size_t i = 0; i < n; i++) {
+		QueueSum[i] += (double) depths[i];
+		QueueMax[i] = std::max(QueueMax[i], depths[i]);
+		QueueCur[i] = depths[i];
+	}
+	NumQueueSamples++;
+}
+
+void PipelineStats::Emit(const std::vector<std::string>& queueNames) {
+	lock_guard<mutex> lock(Lock);
+	if (!IsOpen)
+		return;
+
+	auto   now     = time::Now();
+	double elapsed = (now - LastEmit).Seconds();
+	if (elapsed <= 0)
+		return;
+
+	nlohmann::json j;
+	j["time"]     = now.Unix();
+	j["interval"] = elapsed;
+
+	auto& jstages = j["stages"];
+	for (int i = 0; i < NumStages; i++) {
+		auto  cur    = Snapshot(Stages[i]);
+		auto& prev   = Last[i];
+		auto& jstage = jstages[Stages[i].Name];
+		// Wait times are summed over all threads of a stage. For example, an input_wait_s of 20
+		// over a 10 second interval, for a stage with 4 threads, means that on average two of
+		// those threads were starved of input.
+		jstage["items"]         = cur.Items - prev.Items;
+		jstage["items_per_sec"] = (double) (cur.Items - prev.Items) / elapsed;
+		jstage["input_wait_s"]  = (double) (cur.InputWaitNS - prev.InputWaitNS) / 1e9;
+		jstage["output_wait_s"] = (double) (cur.OutputWaitNS - prev.OutputWaitNS) / 1e9;
+		jstage["gpu_wait_s"]    = (double) (cur.GPUWaitNS - prev.GPUWaitNS) / 1e9;
+		jstage["retries"]       = cur.Retries - prev.Retries;
+		jstage["total_items"]   = cur.Items;
+		jstage["total_retries"] = cur.Retries;
+
+		nlohmann::json jbatches = nlohmann::json::object();
+		for (int b = 1; b <= PipelineStage::MaxBatchSize; b++) {
+			int64_t n = cur.Batches[b] - prev.Batches[b];
+			if (n != 0)
+				jbatches[ItoA(b)] = n;
+		}
+		if (jbatches.size() != 0)
+			jstage["batch_sizes"] = jbatches;
+		prev = cur;
+	}
+
+	auto& jqueues = j["queues"];
+	for (size_t i = 0; i < queueNames.size() && i < QueueCur.size(); i++) {
+		auto& jq   = jqueues[queueNames[i]];
+		jq["cur"]  = QueueCur[i];
+		jq["max"]  = QueueMax[i];
+		jq["mean"] = NumQueueSamples == 0 ? 0.0 : QueueSum[i] / (double) NumQueueSamples;
+	}
+	for (size_t i = 0; i < QueueSum.size(); i++) {
+		QueueSum[i] = 0;
+		QueueMax[i] = 0;
+	}
+	NumQueueSamples = 0;
+	LastEmit        = now;
+
+	string line = j.dump() + "\n";
+	if (ToStdout)
+		tsf::print("%v", line);
+	else
+		File.Write(line.data(), line.size());
+}
+
+PipelineStageSnapshot PipelineStats::Snapshot(const PipelineStage& s) const {
+	PipelineStageSnapshot snap;
+	snap.Items        = s.Items;
+	snap.InputWaitNS  = s.InputWaitNS;
+	snap.OutputWaitNS = s.OutputWaitNS;
+	snap.GPUWaitNS    = s.GPUWaitNS;
+	snap.Retries      = s.Retries;
+	for (int i = 0; i <= PipelineStage::MaxBatchSize; i++)
+		snap.Batches[i] = s.Batches[i];
+	return snap;
+}
+
+} // namespace roadproc
+} // namespace imqs
@@ -0,0 +1,105 @@
+#pragma once
+
+namespace imqs {
+namespace roadproc {
+
+// Counters for a single stage of the PhotoProcessor pipeline.
+// All members are updated concurrently by the threads of a stage, so everything is atomic.
+// Times are accumulated in nanoseconds, summed over all threads of the stage.
+struct PipelineStage {
+	static const int MaxBatchSize = 16; // Batches larger than this are recorded in the final histogram bucket
+
+	std::string          Name;
+	std::atomic<int64_t> Items;                     // Number of jobs that have left this stage
+	std::atomic<int64_t> InputWaitNS;               // Time spent waiting for a job to arrive on the input queue
+	std::atomic<int64_t> OutputWaitNS;              // Time spent waiting for space on a full output queue
+	std::atomic<int64_t> GPUWaitNS;                 // Time spent waiting to acquire the GPU lock
+	std::atomic<int64_t> Retries;                   // Number of retried network operations (download, upload, login)
+	std::atomic<int64_t> Batches[MaxBatchSize + 1]; // Histogram of batch sizes. Index is the batch size.
+
+	PipelineStage();
+	void AddBatch(size_t size);
+};
+
+// A snapshot of the counters of one stage, so that we can compute deltas between reports
+struct PipelineStageSnapshot {
+	int64_t Items        = 0;
+	int64_t InputWaitNS  = 0;
+	int64_t OutputWaitNS = 0;
+	int64_t GPUWaitNS    = 0;
+	int64_t Retries      = 0;
+	int64_t Batches[PipelineStage::MaxBatchSize + 1] = {0};
+};
+
+// Measure the time between construction and destruction, and add it to a counter
+class StageTimer {
+public:
+	StageTimer(std::atomic<int64_t>& counter) : Counter(counter), Start(time::Now()) {}
+	~StageTimer() { Counter += (time::Now() - Start).Nanoseconds(); }
+
+private:
+	std::atomic<int64_t>& Counter;
+	time::Time            Start;
+};
+
+// A mutex wrapper that adds the time spent waiting to acquire the mutex to a counter.
+// It satisfies BasicLockable, so it works with std::lock_guard.
+class TimedLock {
+public:
+	TimedLock(std::mutex& lock, std::atomic<int64_t>& waitCounter) : Lock(lock), WaitCounter(waitCounter) {}
+	void lock() {
+		StageTimer timer(WaitCounter);
+		Lock.lock();
+	}
+	void unlock() { Lock.unlock(); }
+
+private:
+	std::mutex&           Lock;
+	std::atomic<int64_t>& WaitCounter;
+};
+
+// PipelineStats holds the counters of every pipeline stage, and the queue depth samples
+// in between the stages. It periodically emits one JSON object per line, so that the output
+// can be consumed by tools such as jq, or loaded into a notebook to find the bottleneck stage.
+// Every report contains the rates and wait times over the interval since the previous report.
+class PipelineStats {
+public:
+	enum Stages {
+		Fetch = 0,
+		RoadType,
+		Assessment,
+		Upload,
+		NumStages,
+	};
+
+	PipelineStage Stages[NumStages];
+
+	PipelineStats();
+	~PipelineStats();
+
+	// filename may be "stdout". Returns an error if the file cannot be created.
+	Error Open(const std::string& filename);
+
+	// Record one sample of the queue depths. Called frequently by the monitor thread.
+	void SampleQueues(const size_t* depths, size_t n);
+
+	// Write a JSON line describing the activity since the previous call to Emit
+	void Emit(const std::vector<std::string>& queueNames);
+
+private:
+	std::mutex            Lock;
+	os::File              File;
+	bool                  ToStdout = false;
+	bool                  IsOpen   = false;
+	time::Time            LastEmit;
+	PipelineStageSnapshot Last[NumStages];
+	std::vector<double>   QueueSum; // Sum of queue depth samples since the last Emit
+	std::vector<size_t>   QueueMax; // Maximum queue depth since the last Emit
+	std::vector<size_t>   QueueCur; // Most recent queue depth
+	int64_t               NumQueueSamples = 0;
+
+	PipelineStageSnapshot Snapshot(const PipelineStage& s) const;
+};
+
+} // namespace roadproc
+} // namespace imqs
@@ -17,12 +17,12 @@ TarDefectsModel::TarDefectsModel() {
 	CropParams.BottomDiscard = 150; // in case part of the car is visible in the bottom of the frame
 }
 
-Error TarDefectsModel::Run(std::mutex& gpuLock, const torch::Tensor& input, const std::vector<PhotoJob*>& output) {
-	// I haven't bothered to check whether enabling this mutex has a performance benefit, so I'm
-	// leaving it off.
-	//gpuLock.lock();
-	auto batchRes = Model.forward({input.cuda()}).toTensor();
-	//gpuLock.unlock();
+Error TarDefectsModel::Run(TimedLock& gpuLock, const torch::Tensor& input, const std::vector<PhotoJob*>& output) {
+	torch::Tensor batchRes;
+	{
+		lock_guard<TimedLock> lock(gpuLock);
+		batchRes = Model.forward({input.cuda()}).toTensor();
+	}
 
 	//tsf::print("Result size: %v\n", SizeToString(batchRes));
 	// Shape of res: [1,12,56,152]
@@ -8,7 +8,7 @@ namespace roadproc {
 class TarDefectsModel : public AnalysisModel {
 public:
 	TarDefectsModel();
-	Error Run(std::mutex& gpuLock, const torch::Tensor& input, const std::vector<PhotoJob*>& output) override;
+	Error Run(TimedLock& gpuLock, const torch::Tensor& input, const std::vector<PhotoJob*>& output) override;
 
 	void DrawDebugImage(PhotoJob* job) const;
 };
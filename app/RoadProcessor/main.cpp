@@ -202,6 +202,8 @@ int main(int argc, char** argv) {
 	auto photos = args.AddCommand("photos <username> <password> <client> <prefix> <cloud storage credentials file>", "Run the gen2 models on GoPro photos", PhotoProcessor::Run);
 	photos->AddValue("s", "server", "Server where the 'console' service runs", "https://roads.imqs.co.za");
 	photos->AddSwitch("a", "all", "Rerun analysis on all photos (otherwise only photos without analysis)");
+	photos->AddValue("", "stats", "Write pipeline telemetry as JSON lines to this file (or 'stdout')", "");
+	photos->AddValue("", "statsinterval", "Seconds between pipeline telemetry reports", "10");
 
 	if (!args.Parse(argc, (const char**) argv))
 		return 1;
@@ -1,6 +1,7 @@
 #include "pch.h"
 #include "Exporter.h"
 #include "LabelIO.h"
+#include "Shard.h"
 
 using namespace std;
 
@@ -23,7 +24,40 @@ static Error MakeClassDir(string baseDir, string className) {
 	return os::MkDirAll(classDir);
 }
 
+static void PatchFileType(ExportTypes type, gfx::ImageType& filetype, string& ext) {
+	if (type == ExportTypes::Png) {
+		filetype = gfx::ImageType::Png;
+		ext      = "png";
+	} else {
+		filetype = gfx::ImageType::Jpeg;
+		ext      = "jpeg";
+	}
+}
+
+// Add a single rectangular patch out of a frame to a shard
+static Error ShardLabeledPatch(ShardWriter& shards, const std::string& videoFilename, int64_t frameTime, const Label& patch, const gfx::Image& frameImg) {
+	auto patchTex = frameImg.Window(patch.Rect.X1, patch.Rect.Y1, patch.Rect.Width(), patch.Rect.Height());
+	return shards.Add(videoFilename, frameTime, patch, patchTex);
+}
+
+// Export a single rectangular patch out of a frame
+static Error ExportLabeledPatch(gfx::ImageIO& imgIO, ExportTypes type, const std::string& dir, int64_t frameTime, const Label& patch, const gfx::Image& frameImg) {
+	//IMQS_ASSERT(patch.Rect.Width() == dim && patch.Rect.Height() == dim);
+	gfx::ImageType filetype;
+	string         ext;
+	PatchFileType(type, filetype, ext);
+	auto filename = dir + "/" + tsf::fmt("%09d-%04d-%04d-%04d-%04d.%v", frameTime, patch.Rect.X1, patch.Rect.Y1, patch.Rect.Width(), patch.Rect.Height(), ext);
+	if (os::IsFile(filename)) {
+		// since our images are just extracts of the video, and labels are stored separately, we never have to re-export an image patch
+		return Error();
+	}
+	auto patchTex = frameImg.Window(patch.Rect.X1, patch.Rect.Y1, patch.Rect.Width(), patch.Rect.Height());
+	return SaveImageFile(imgIO, patchTex, filetype, filename);
+}
+
 Error ExportLabeledImagePatches_Frame_Rect(ExportTypes type, std::string dir, int64_t frameTime, const ImageLabels& labels, const gfx::Image& frameImg) {
+	if (type == ExportTypes::Shards)
+		return Error("Shards must be exported through a ShardWriter");
 	if (labels.Labels.size() == 0)
 		return Error();
 
@@ -36,25 +70,8 @@ Error ExportLabeledImagePatches_Frame_Rect(ExportTypes type, std::string dir, in
 	for (int i = 0; i < (int) labels.Labels.size(); i++) {
 		if (haveErr)
 			continue;
-		const auto& patch = labels.Labels[i];
-		//IMQS_ASSERT(patch.Rect.Width() == dim && patch.Rect.Height() == dim);
-		auto           patchTex = frameImg.Window(patch.Rect.X1, patch.Rect.Y1, patch.Rect.Width(), patch.Rect.Height());
-		gfx::ImageIO   imgIO;
-		gfx::ImageType filetype;
-		string         ext;
-		if (type == ExportTypes::Png) {
-			filetype = gfx::ImageType::Png;
-			ext      = "png";
-		} else {
-			filetype = gfx::ImageType::Jpeg;
-			ext      = "jpeg";
-		}
-		auto filename = dir + "/" + tsf::fmt("%09d-%04d-%04d-%04d-%04d.%v", frameTime, patch.Rect.X1, patch.Rect.Y1, patch.Rect.Width(), patch.Rect.Height(), ext);
-		if (os::IsFile(filename)) {
-			// since our images are just extracts of the video, and labels are stored separately, we never have to re-export an image patch
-			continue;
-		}
-		auto err = SaveImageFile(imgIO, patchTex, filetype, filename);
+		gfx::ImageIO imgIO;
+		auto         err = ExportLabeledPatch(imgIO, type, dir, frameTime, labels.Labels[i], frameImg);
 		if (!err.OK()) {
 #pragma omp critical(firstError)
 			firstErr = err;
@@ -64,11 +81,10 @@ Error ExportLabeledImagePatches_Frame_Rect(ExportTypes type, std::string dir, in
 	return firstErr;
 }
 
-Error ExportLabeledImagePatches_Frame_Polygons(std::string dir, int64_t frameTime, const ImageLabels& labels, const gfx::Image& frameImg) {
+// segClasses maps from class name to segmentation class ID (see LabelTaxonomy::SegmentationClassToIndex)
+static Error ExportLabeledImagePatches_Frame_Polygons(gfx::ImageIO& imgIO, const ohash::map<std::string, int>& segClasses, std::string dir, int64_t frameTime, const ImageLabels& labels, const gfx::Image& frameImg) {
 	IMQS_ASSERT(labels.HasPolygons());
 
-	gfx::ImageIO imgIO;
-
 	auto srcFilename = dir + "/" + tsf::fmt("%09d-whole.jpeg", frameTime);
 	auto segFilename = dir + "/" + tsf::fmt("%09d-class.png", frameTime);
 	if (!os::IsFile(srcFilename)) {
@@ -78,26 +94,45 @@ Error ExportLabeledImagePatches_Frame_Polygons(std::string dir, int64_t frameTim
 			return err;
 	}
 
-	gfx::Canvas   canvas(frameImg.Width, frameImg.Height, gfx::Color8(0, 0, 0, 255));
-	vector<float> vx;
+	// The segmentation target is a single channel image of class IDs, with 0 being unlabeled.
+	// Polygons are not antialiased, so that edges never blend two class IDs together.
+	// Where polygons overlap, the label that was added last wins.
+	gfx::MaskRasterizer ras;
+	vector<float>       vx;
 	for (auto& lab : labels.Labels) {
 		if (!lab.IsPolygon())
 			continue;
+		if (lab.Classes.size() == 0)
+			continue;
+		auto classID = segClasses.getp(lab.Classes[0].Class);
+		if (!classID)
+			return Error::Fmt("Polygon class '%v' is not a segmentation class", lab.Classes[0].Class);
 		vx.clear();
 		for (auto& v : lab.Polygon.Vertices) {
 			vx.push_back((float) v.X);
 			vx.push_back((float) v.Y);
 		}
-		// Note we use antialiased rendering, intended for MSE loss.
-		// We'll need to binaries the output if we're going to be doing BCE loss, or multiple categories.
-		canvas.FillPoly((int) lab.Polygon.Vertices.size(), &vx[0], 2 * sizeof(float), gfx::Color8(255, 255, 255, 255));
+		ras.AddPolygon((int) lab.Polygon.Vertices.size(), &vx[0], 2 * sizeof(float), (uint8_t) *classID);
 	}
 
-	auto err = SaveImageFile(imgIO, *canvas.GetImage(), gfx::ImageType::Png, segFilename);
+	gfx::Image mask(gfx::ImageFormat::Gray, frameImg.Width, frameImg.Height);
+	for (int y = 0; y < mask.Height; y++)
+		memset(mask.Line(y), 0, mask.Width);
+	ras.Render(mask);
+
+	void*  encbuf  = nullptr;
+	size_t encsize = 0;
+	auto   err     = imgIO.SavePng(gfx::ImageFormat::Gray, false, mask.Width, mask.Height, mask.Stride, mask.Data, 1, encbuf, encsize);
 	if (!err.OK())
 		return err;
+	err = os::WriteWholeFile(segFilename, encbuf, encsize);
+	imgIO.FreeEncodedBuffer(gfx::ImageType::Png, encbuf);
+	return err;
+}
 
-	return Error();
+Error ExportLabeledImagePatches_Frame_Polygons(const ohash::map<std::string, int>& segClasses, std::string dir, int64_t frameTime, const ImageLabels& labels, const gfx::Image& frameImg) {
+	gfx::ImageIO imgIO;
+	return ExportLabeledImagePatches_Frame_Polygons(imgIO, segClasses, dir, frameTime, labels, frameImg);
 }
 
 Error FindVideoFiles(std::string modelName, string root, vector<string>& videoFiles, bool filterToVideosWithLabels) {
@@ -112,61 +147,38 @@ Error FindVideoFiles(std::string modelName, string root, vector<string>& videoFi
 	});
 }
 
-Error ExportLabeledImagePatches_Video_Bulk(ExportTypes type, std::string modelName, std::string rootDir, const LabelTaxonomy& taxonomy) {
-	vector<string> videoFiles;
-	auto           err = FindVideoFiles(modelName, rootDir, videoFiles, true);
-	if (!err.OK()) {
-		return Error::Fmt("Error finding videos in '%v': %v", rootDir, err.Message());
-	}
-
-	for (size_t i = 0; i < videoFiles.size(); i++) {
-		auto progress = [&](size_t pos, size_t total) -> bool {
-			tsf::print("Video %v. File %v/%v\r", videoFiles[i], pos + 1, total);
-			fflush(stdout);
-			return true;
-		};
-		VideoLabels labels;
-		auto        err = LoadVideoLabels(videoFiles[i], modelName, labels);
-		if (!err.OK())
-			return err;
-		err = ExportLabeledImagePatches_Video(type, videoFiles[i], taxonomy, labels, progress);
-		if (!err.OK())
-			return err;
-		tsf::print("\n");
-	}
-	tsf::print("\n");
-	return Error();
+static bool IsFrameExported(ExportTypes type, const ImageLabels& frame) {
+	if (type == ExportTypes::Segmentation)
+		return frame.HasPolygons();
+	return frame.HasRects();
 }
 
-Error ExportLabeledImagePatches_Video(ExportTypes type, std::string videoFilename, const LabelTaxonomy& taxonomy, const VideoLabels& labels, ProgressCallback prog) {
-	auto dir = ImagePatchDir(videoFilename);
-	auto err = os::MkDirAll(dir);
-	if (!err.OK())
-		return err;
-
+static Error OpenExportVideo(const std::string& videoFilename, std::unique_ptr<video::IVideo>& video, bool& enableSeek) {
 #ifdef _WIN32
-	video::VideoFile video;
-	bool             enableSeek = true;
+	video.reset(new video::VideoFile());
+	enableSeek = true;
 #else
-	video::NVVideo video;
-	bool           enableSeek = false;
+	video.reset(new video::NVVideo());
+	enableSeek = false;
 #endif
-	err = video.OpenFile(videoFilename);
-	if (!err.OK())
-		return err;
+	return video->OpenFile(videoFilename);
+}
 
-	gfx::Image img(gfx::ImageFormat::RGBA, video.Width(), video.Height());
+// Called for every labeled frame that we need to export. The callback must call ConvertFrameRGBA
+// on the video, to get the frame's pixels.
+typedef std::function<Error(size_t frameIdx, const ImageLabels& frame, video::IVideo& video)> LabeledFrameFunc;
 
+// Decode forward through the video, and call onFrame for every labeled frame that needs to be exported.
+static Error WalkLabeledFrames(ExportTypes type, video::IVideo& video, bool enableSeek, const VideoLabels& labels, LabeledFrameFunc onFrame) {
 	int64_t lastFrameTime = 0;
 	int64_t micro         = 1000000;
 
 	for (size_t i = 0; i < labels.Frames.size(); i++) {
 		const auto& frame = labels.Frames[i];
-		if (type == ExportTypes::Segmentation && !frame.HasPolygons())
-			continue;
-		if (type != ExportTypes::Segmentation && !frame.HasRects())
+		if (!IsFrameExported(type, frame))
 			continue;
 
+		Error err;
 		// Only seek if frame is more than 20 seconds into the future. Haven't measured optimal metric to use here.
 		if (enableSeek && frame.Time - lastFrameTime > 20 * micro) {
 			int64_t buffer = 5 * micro; // seek 5 seconds behind frame target
@@ -175,27 +187,17 @@ Error ExportLabeledImagePatches_Video(ExportTypes type, std::string videoFilenam
 				return err;
 		}
 
+		// Labeled frames are sparse, so we only pay for the RGBA conversion of the frames that we export
 		while (true) {
 			double frameSeconds = 0;
-			err                 = video.DecodeFrameRGBA(img.Width, img.Height, img.Data, img.Stride, &frameSeconds);
+			err                 = video.DecodeFrame(&frameSeconds);
 			if (!err.OK())
 				break;
-			//int64_t pts   = video.LastFrameTimeMicrosecond();
 			int64_t pts   = int64_t(frameSeconds * 1000000);
 			lastFrameTime = pts;
 			if (pts == frame.Time) {
 				// found our frame
-				if (type == ExportTypes::Segmentation)
-					err = ExportLabeledImagePatches_Frame_Polygons(dir, frame.Time, frame, img);
-				else
-					err = ExportLabeledImagePatches_Frame_Rect(type, dir, frame.Time, frame, img);
-				if (!err.OK())
-					break;
-
-				if (prog != nullptr) {
-					if (!prog(i, labels.Frames.size()))
-						err = Error("Cancelled");
-				}
+				err = onFrame(i, frame, video);
 				break;
 			} else if (pts > frame.Time) {
 				err = Error::Fmt("Fail to find frame %v", frame.Time);
@@ -210,6 +212,338 @@ Error ExportLabeledImagePatches_Video(ExportTypes type, std::string videoFilenam
 	return Error();
 }
 
+// BulkExporter exports many videos concurrently.
+// Decoder threads each work through one video at a time, and decode its labeled frames into frame
+// buffers. Every frame is split into encode jobs (one per rectangular patch, or one per frame for
+// segmentation), which are picked up by a pool of encoder threads, each with its own ImageIO.
+// For ExportTypes::Shards, the encoders add their patches to a single ShardWriter, instead of writing
+// one file per patch. A frame buffer is recycled once all of its encode jobs are done. The number of frame buffers is
+// bounded, so decoders stall when the encoders fall behind, instead of consuming unbounded memory.
+class BulkExporter {
+public:
+	ExportTypes                  Type = ExportTypes::Jpeg;
+	BulkExportOptions            Options;
+	ProgressCallback             Progress;
+	std::vector<string>          VideoFiles;
+	std::vector<string>          PatchDirs;        // One per video
+	std::vector<VideoLabels>     Labels;           // One per video
+	ShardWriter*                 Shards = nullptr; // Required for ExportTypes::Shards
+	ohash::map<std::string, int> SegClasses;       // Required for ExportTypes::Segmentation
+
+	BulkExporter() : FramesFree(0) {
+		NextVideo  = 0;
+		FramesDone = 0;
+		Abort      = false;
+	}
+
+	Error Run();
+
+private:
+	// A decoded frame, shared by all of the encode jobs that are cut out of it
+	struct Frame {
+		gfx::Image         Img;
+		const ImageLabels* Labels = nullptr;
+		const string*      Dir    = nullptr;
+		const string*      Video  = nullptr;
+		std::atomic<int>   Refs; // Number of encode jobs that still need this frame
+
+		Frame() { Refs = 0; }
+	};
+	struct EncodeJob {
+		Frame* F;     // If null, then the encoder thread must exit
+		int    Label; // Index of the rectangle label in F->Labels, or -1 for a whole-frame segmentation job
+	};
+
+	std::atomic<size_t> NextVideo;
+	std::atomic<size_t> FramesDone;
+	size_t              FramesTotal = 0;
+	std::atomic<bool>   Abort;
+	std::mutex          Lock; // Guards FreeFrames, and calls to Progress
+	std::mutex          ErrLock;
+	Error               FirstErr;
+	std::vector<Frame*> FreeFrames;
+	Semaphore           FramesFree; // Number of frames in FreeFrames
+	TQueue<EncodeJob>   Jobs;
+
+	void   DecoderThread();
+	void   EncoderThread();
+	Frame* AcquireFrame(int width, int height);
+	void   ReleaseFrame(Frame* f);
+	void   SetError(Error err);
+};
+
+Error BulkExporter::Run() {
+	// Encoding is far more expensive than decoding, because we only convert the labeled frames
+	int cores     = os::NumberOfCPUCores();
+	int nDecoders = Options.Decoders > 0 ? Options.Decoders : std::max(1, cores / 8);
+	int nEncoders = Options.Encoders > 0 ? Options.Encoders : std::max(1, cores - nDecoders);
+	nDecoders     = std::min(nDecoders, (int) VideoFiles.size());
+	int nFrames   = std::max(Options.MaxFramesInFlight, nDecoders);
+
+	for (const auto& labels : Labels) {
+		for (const auto& f : labels.Frames)
+			FramesTotal += IsFrameExported(Type, f) ? 1 : 0;
+	}
+
+	Jobs.Initialize(true);
+	for (int i = 0; i < nFrames; i++)
+		FreeFrames.push_back(new Frame());
+	FramesFree.signal(nFrames);
+
+	vector<thread> encoders;
+	for (int i = 0; i < nEncoders; i++)
+		encoders.emplace_back([this]() { EncoderThread(); });
+
+	vector<thread> decoders;
+	for (int i = 0; i < nDecoders; i++)
+		decoders.emplace_back([this]() { DecoderThread(); });
+	for (auto& t : decoders)
+		t.join();
+
+	// Once the decoders are done, the only remaining jobs are the ones in the queue, so our
+	// exit signals are processed after all of them.
+	for (int i = 0; i < nEncoders; i++) {
+		Jobs.Push(EncodeJob{nullptr, 0});
+		Jobs.SemaphoreObj().signal();
+	}
+	for (auto& t : encoders)
+		t.join();
+
+	for (auto f : FreeFrames)
+		delete f;
+	FreeFrames.clear();
+	return FirstErr;
+}
+
+void BulkExporter::DecoderThread() {
+	while (!Abort) {
+		size_t iVideo = NextVideo++;
+		if (iVideo >= VideoFiles.size())
+			return;
+		const auto& videoFile = VideoFiles[iVideo];
+		const auto& dir       = PatchDirs[iVideo];
+
+		auto err = os::MkDirAll(dir);
+		if (!err.OK()) {
+			SetError(err);
+			return;
+		}
+
+		unique_ptr<video::IVideo> video;
+		bool                      enableSeek = false;
+		err                                  = OpenExportVideo(videoFile, video, enableSeek);
+		if (!err.OK()) {
+			SetError(Error::Fmt("Error opening %v: %v", videoFile, err.Message()));
+			return;
+		}
+		int     width, height;
+		int64_t duration;
+		video->Info(width, height, duration);
+
+		err = WalkLabeledFrames(Type, *video, enableSeek, Labels[iVideo], [&](size_t frameIdx, const ImageLabels& frame, video::IVideo& vid) -> Error {
+			if (Abort)
+				return Error("Cancelled");
+			Frame* f = AcquireFrame(width, height);
+			auto   e = vid.ConvertFrameRGBA(width, height, f->Img.Data, f->Img.Stride);
+			if (!e.OK()) {
+				ReleaseFrame(f);
+				return e;
+			}
+			f->Labels = &frame;
+			f->Dir    = &dir;
+			f->Video  = &videoFile;
+			if (Type == ExportTypes::Segmentation) {
+				f->Refs = 1;
+				Jobs.Push(EncodeJob{f, -1});
+				Jobs.SemaphoreObj().signal();
+			} else {
+				// Set the reference count before pushing any jobs, because an encoder could finish a job
+				// before we're done pushing.
+				vector<int> rects;
+				for (int i = 0; i < (int) frame.Labels.size(); i++) {
+					if (frame.Labels[i].IsRect())
+						rects.push_back(i);
+				}
+				f->Refs = (int) rects.size();
+				for (int i : rects) {
+					Jobs.Push(EncodeJob{f, i});
+					Jobs.SemaphoreObj().signal();
+				}
+			}
+			return Error();
+		});
+		if (!err.OK()) {
+			SetError(Error::Fmt("Error exporting %v: %v", videoFile, err.Message()));
+			return;
+		}
+	}
+}
+
+void BulkExporter::EncoderThread() {
+	gfx::ImageIO imgIO;
+	while (true) {
+		Jobs.SemaphoreObj().wait();
+		EncodeJob job = Jobs.PopTailR();
+		if (job.F == nullptr)
+			return;
+
+		Frame* f = job.F;
+		if (!Abort) {
+			Error err;
+			if (job.Label == -1)
+				err = ExportLabeledImagePatches_Frame_Polygons(imgIO, SegClasses, *f->Dir, f->Labels->Time, *f->Labels, f->Img);
+			else if (Type == ExportTypes::Shards)
+				err = ShardLabeledPatch(*Shards, *f->Video, f->Labels->Time, f->Labels->Labels[job.Label], f->Img);
+			else
+				err = ExportLabeledPatch(imgIO, Type, *f->Dir, f->Labels->Time, f->Labels->Labels[job.Label], f->Img);
+			if (!err.OK())
+				SetError(err);
+		}
+
+		if (--f->Refs == 0) {
+			ReleaseFrame(f);
+			size_t done = ++FramesDone;
+			if (Progress) {
+				lock_guard<mutex> lock(Lock);
+				if (!Abort && !Progress(done - 1, FramesTotal))
+					SetError(Error("Cancelled"));
+			}
+		}
+	}
+}
+
+BulkExporter::Frame* BulkExporter::AcquireFrame(int width, int height) {
+	FramesFree.wait();
+	Frame* f = nullptr;
+	{
+		lock_guard<mutex> lock(Lock);
+		f = FreeFrames.back();
+		FreeFrames.pop_back();
+	}
+	if (f->Img.Width != width || f->Img.Height != height)
+		f->Img = gfx::Image(gfx::ImageFormat::RGBA, width, height);
+	return f;
+}
+
+void BulkExporter::ReleaseFrame(Frame* f) {
+	{
+		lock_guard<mutex> lock(Lock);
+		FreeFrames.push_back(f);
+	}
+	FramesFree.signal();
+}
+
+void BulkExporter::SetError(Error err) {
+	lock_guard<mutex> lock(ErrLock);
+	if (FirstErr.OK())
+		FirstErr = err;
+	Abort = true;
+}
+
+Error ExportLabeledImagePatches_Video_Bulk(ExportTypes type, std::string modelName, std::string rootDir, const LabelTaxonomy& taxonomy, ProgressCallback prog, BulkExportOptions options) {
+	vector<string> videoFiles;
+	auto           err = FindVideoFiles(modelName, rootDir, videoFiles, true);
+	if (!err.OK()) {
+		return Error::Fmt("Error finding videos in '%v': %v", rootDir, err.Message());
+	}
+	if (videoFiles.size() == 0)
+		return Error();
+
+	// All videos share one sequence of shards
+	ShardWriter shards;
+	if (type == ExportTypes::Shards) {
+		err = shards.Open(rootDir + "/shards");
+		if (!err.OK())
+			return err;
+	}
+
+	BulkExporter exp;
+	exp.Type       = type;
+	exp.Options    = options;
+	exp.Progress   = prog;
+	exp.Shards     = &shards;
+	exp.SegClasses = taxonomy.SegmentationClassToIndex();
+	if (!exp.Progress) {
+		exp.Progress = [](size_t pos, size_t total) -> bool {
+			tsf::print("Frame %v/%v\r", pos + 1, total);
+			fflush(stdout);
+			return true;
+		};
+	}
+	for (const auto& v : videoFiles) {
+		VideoLabels labels;
+		auto        err = LoadVideoLabels(v, modelName, labels);
+		if (!err.OK())
+			return Error::Fmt("Error loading labels for %v: %v", v, err.Message());
+		exp.VideoFiles.push_back(v);
+		exp.PatchDirs.push_back(ImagePatchDir(v));
+		exp.Labels.emplace_back(std::move(labels));
+	}
+
+	err = exp.Run();
+	if (err.OK() && type == ExportTypes::Shards)
+		err = shards.Close();
+	tsf::print("\n");
+	return err;
+}
+
+Error ExportLabeledImagePatches_Video(ExportTypes type, std::string videoFilename, const LabelTaxonomy& taxonomy, const VideoLabels& labels, ProgressCallback prog) {
+	auto dir = ImagePatchDir(videoFilename);
+	auto err = os::MkDirAll(dir);
+	if (!err.OK())
+		return err;
+
+	unique_ptr<video::IVideo> video;
+	bool                      enableSeek = false;
+	err                                  = OpenExportVideo(videoFilename, video, enableSeek);
+	if (!err.OK())
+		return err;
+
+	int     width, height;
+	int64_t duration;
+	video->Info(width, height, duration);
+	gfx::Image img(gfx::ImageFormat::RGBA, width, height);
+
+	ShardWriter shards;
+	if (type == ExportTypes::Shards) {
+		err = shards.Open(dir);
+		if (!err.OK())
+			return err;
+	}
+
+	auto segClasses = taxonomy.SegmentationClassToIndex();
+
+	err = WalkLabeledFrames(type, *video, enableSeek, labels, [&](size_t frameIdx, const ImageLabels& frame, video::IVideo& vid) -> Error {
+		auto err = vid.ConvertFrameRGBA(img.Width, img.Height, img.Data, img.Stride);
+		if (!err.OK())
+			return err;
+		if (type == ExportTypes::Segmentation) {
+			err = ExportLabeledImagePatches_Frame_Polygons(segClasses, dir, frame.Time, frame, img);
+		} else if (type == ExportTypes::Shards) {
+			for (const auto& lab : frame.Labels) {
+				if (!lab.IsRect())
+					continue;
+				err = ShardLabeledPatch(shards, videoFilename, frame.Time, lab, img);
+				if (!err.OK())
+					break;
+			}
+		} else {
+			err = ExportLabeledImagePatches_Frame_Rect(type, dir, frame.Time, frame, img);
+		}
+		if (!err.OK())
+			return err;
+
+		if (prog != nullptr) {
+			if (!prog(frameIdx, labels.Frames.size()))
+				return Error("Cancelled");
+		}
+		return Error();
+	});
+	if (err.OK() && type == ExportTypes::Shards)
+		err = shards.Close();
+	return err;
+}
+
 static void ConvertRGBAtoRGB(bool channelsFirst, int srcStride, const uint8_t* src, int dstStride, uint8_t* dst, int width, int height) {
 	// convert RGBA to RGB
 	if (channelsFirst) {
@@ -255,17 +589,95 @@ struct BatchHeader {
 };
 #pragma pack(pop)
 
+// A run of batch samples whose frames all follow the same keyframe. We extract all of them
+// with a single seek, followed by decoding forward. If the container has no index, then a
+// GOP is the samples of a single frame.
+struct BatchGOP {
+	int64_t             Keyframe = -1; // Time of the keyframe, or -1 if the container has no index
+	std::vector<size_t> Samples;       // Indices into the batch, sorted by frame time
+};
+
+// The state of one decoder thread, which is carried from one GOP to the next, so that a GOP
+// can pick up where the previous one stopped, instead of seeking.
+struct BatchDecoderState {
+	int64_t FrameTime  = -1; // Time of the last frame that the decoder produced, or -1 after a seek
+	int64_t SampleTime = -1; // Frame time of the labels that frameBuf holds, or -1 if frameBuf is stale
+};
+
+// Extract the samples of one GOP into dstImage
+static Error ExtractBatchGOP(bool channelsFirst, const std::vector<std::pair<int, int>>& batch, const BatchGOP& gop, video::VideoFile& video, gfx::Image& frameBuf,
+                             BatchDecoderState& state, const VideoLabels& labels, size_t dstImageSize, int dstStride, uint8_t* dstImage) {
+	int64_t firstTime = labels.Frames[batch[gop.Samples[0]].first].Time;
+
+	// If the decoder stopped between our keyframe and our first frame, then keep decoding forward from there
+	if (gop.Keyframe != -1 && (state.FrameTime == -1 || state.FrameTime < gop.Keyframe || state.FrameTime > firstTime)) {
+		state    = BatchDecoderState();
+		auto err = video.SeekToKeyframeAtOrBefore(gop.Keyframe);
+		if (!err.OK())
+			return Error::Fmt("Error seeking to keyframe at %v: %v", gop.Keyframe, err.Message());
+	}
+
+	for (auto i : gop.Samples) {
+		const auto& p     = batch[i];
+		const auto& frame = labels.Frames[p.first];
+		const auto& label = frame.Labels[p.second];
+
+		if (frame.Time != state.SampleTime) {
+			if (gop.Keyframe == -1) {
+				// Without an index, we have no choice but to seek to every frame
+				state    = BatchDecoderState();
+				auto err = video.SeekToMicrosecond(frame.Time);
+				if (!err.OK())
+					return Error::Fmt("Error seeking to frame %v: %v", p.first, err.Message());
+				err = video.DecodeFrameRGBA(video.Width(), video.Height(), frameBuf.Data, frameBuf.Stride);
+				if (!err.OK())
+					return Error::Fmt("Error decoding frame %v: %v", p.first, err.Message());
+				state.FrameTime = video.LastFrameTimeMicrosecond();
+			} else {
+				// Decode forward until we reach our frame. If the decoder is already at or beyond
+				// this frame's time, then we reuse its frame.
+				// Only the frame that we stop on is converted to RGBA.
+				while (state.FrameTime == -1 || state.FrameTime < frame.Time) {
+					auto err = video.DecodeFrame();
+					if (!err.OK())
+						return Error::Fmt("Error decoding frame %v: %v", p.first, err.Message());
+					state.FrameTime  = video.LastFrameTimeMicrosecond();
+					state.SampleTime = -1;
+				}
+				if (state.SampleTime == -1) {
+					auto err = video.ConvertFrameRGBA(video.Width(), video.Height(), frameBuf.Data, frameBuf.Stride);
+					if (!err.OK())
+						return Error::Fmt("Error converting frame %v: %v", p.first, err.Message());
+				}
+			}
+			state.SampleTime = frame.Time;
+		}
+
+		auto     wnd    = frameBuf.Window(label.Rect.X1, label.Rect.Y1, label.Rect.Width(), label.Rect.Height());
+		uint8_t* dstBuf = dstImage + i * dstImageSize;
+		ConvertRGBAtoRGB(channelsFirst, wnd.Stride, wnd.Data, dstStride, dstBuf, wnd.Width, wnd.Height);
+	}
+	return Error();
+}
+
 // Export a labeled batch into a data format that can be easily turned into a numpy array, or pytorch tensor.
 // 'batch' contains a list of pairs, where the first part of the pair is the frame index (not the frame time),
 // and the second part is the label index within that frame.
-IMQS_TRAIN_API Error ExportLabeledBatch(bool channelsFirst, bool compress, const std::vector<std::pair<int, int>>& batch, video::VideoFile& video, const VideoLabels& labels, std::string& encoded) {
+// Instead of seeking to every sample, we sort the samples by time, and group them by the keyframe that
+// precedes them. Each group is decoded forward once, from its keyframe. Groups are independent, so we
+// decode them in parallel, one thread per VideoFile in 'decoders'. The decoders must all be open on
+// the same video, and the caller owns them, so that they can be reused between batches.
+// The label of a sample is the index of its first class, or -1 if the label has no classes.
+// The output order is the same as the order of 'batch'.
+IMQS_TRAIN_API Error ExportLabeledBatch(bool channelsFirst, bool compress, const std::vector<std::pair<int, int>>& batch, const std::vector<video::VideoFile*>& decoders, const VideoLabels& labels, std::string& encoded) {
+	if (decoders.size() == 0)
+		return Error("No video decoders for batch export");
+	auto& video = *decoders[0];
+
 	int    sampleWidth  = 0;
 	int    sampleHeight = 0;
 	size_t dstImageSize = 0;
 	int    dstStride    = 0;
-	int    lastFrame    = -1;
-
-	gfx::Image frameBuf(gfx::ImageFormat::RGBA, video.Width(), video.Height());
 
 	// store labels separately, and add them in at the end
 	string dstLabels;
@@ -297,24 +709,69 @@ IMQS_TRAIN_API Error ExportLabeledBatch(bool channelsFirst, bool compress, const
 			return Error::Fmt("Label %v.%v has different dimensions (%v, %v) to the other labels (%v, %v)", label.Rect.Width(), label.Rect.Height(), sampleWidth, sampleHeight);
 		}
 
-		if (p.first != lastFrame) {
-			auto err = video.SeekToMicrosecond(frame.Time);
-			if (!err.OK())
-				return Error::Fmt("Error seeking to frame %v: %v", p.first, err.Message());
-			err = video.DecodeFrameRGBA(video.Width(), video.Height(), frameBuf.Data, frameBuf.Stride);
-			if (!err.OK())
-				return Error::Fmt("Error decoding frame %v: %v", p.first, err.Message());
-			lastFrame = p.first;
-		}
+		dstLabelsPtr[i] = label.Classes.size() != 0 ? classToIndex.get(label.Classes[0].Class) : -1;
+	}
 
-		auto     wnd    = frameBuf.Window(label.Rect.X1, label.Rect.Y1, label.Rect.Width(), label.Rect.Height());
-		uint8_t* dstBuf = (uint8_t*) dstImage.data() + i * dstImageSize;
-		ConvertRGBAtoRGB(channelsFirst, wnd.Stride, wnd.Data, dstStride, dstBuf, wnd.Width, wnd.Height);
+	// Sort samples by presentation time, and split them into GOPs
+	vector<size_t> order;
+	for (size_t i = 0; i < batch.size(); i++)
+		order.push_back(i);
+	sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+		int64_t ta = labels.Frames[batch[a].first].Time;
+		int64_t tb = labels.Frames[batch[b].first].Time;
+		return ta != tb ? ta < tb : a < b;
+	});
+
+	vector<BatchGOP> gops;
+	for (auto i : order) {
+		int64_t time     = labels.Frames[batch[i].first].Time;
+		int64_t keyframe = video.KeyframeAtOrBefore(time);
+		// Without an index, every frame needs its own seek, but the samples of one frame still share it
+		bool sameGOP = gops.size() != 0 && gops.back().Keyframe == keyframe &&
+		               (keyframe != -1 || labels.Frames[batch[gops.back().Samples.back()].first].Time == time);
+		if (!sameGOP)
+			gops.push_back(BatchGOP());
+		gops.back().Keyframe = keyframe;
+		gops.back().Samples.push_back(i);
+	}
+
+	// Decode GOPs in parallel. Every decoder thread has its own VideoFile and frame buffer.
+	size_t nDecoders = std::min(gops.size(), decoders.size());
+
+	mutex          errLock;
+	Error          firstErr;
+	atomic<size_t> nextGOP;
+	vector<thread> threads;
+	uint8_t*       dstImagePtr = (uint8_t*) dstImage.data();
+	nextGOP                    = 0;
 
-		// BROKEN by move to multiple classes per patch
-		IMQS_ASSERT(false);
-		//dstLabelsPtr[i] = classToIndex.get(label.Class);
+	auto decoderThread = [&](video::VideoFile* vid) {
+		gfx::Image        frameBuf(gfx::ImageFormat::RGBA, vid->Width(), vid->Height());
+		BatchDecoderState state;
+		while (true) {
+			size_t g = nextGOP++;
+			if (g >= gops.size())
+				break;
+			auto err = ExtractBatchGOP(channelsFirst, batch, gops[g], *vid, frameBuf, state, labels, dstImageSize, dstStride, dstImagePtr);
+			if (!err.OK()) {
+				lock_guard<mutex> lock(errLock);
+				if (firstErr.OK())
+					firstErr = err;
+				nextGOP = gops.size();
+			}
+		}
+	};
+
+	for (size_t i = 1; i < nDecoders; i++) {
+		auto v = decoders[i];
+		threads.push_back(thread([&, v] { decoderThread(v); }));
 	}
+	decoderThread(&video);
+	for (auto& t : threads)
+		t.join();
+
+	if (!firstErr.OK())
+		return firstErr;
 
 	// append labels to images, so it's one contiguous block of bytes
 	dstImage += dstLabels;
@@ -9,13 +9,24 @@ enum class ExportTypes {
 	Png,          // One directory per class, with all images for that class inside the directory.
 	Jpeg,         // Same as png, but jpeg at 95% quality
 	Segmentation, // Segmentation. JPEG for video frame, and PNG for segmentation class
+	Shards,       // Rectangular patches, packed into large shard files (see Shard.h), instead of one file per patch
 };
 
 typedef std::function<bool(size_t pos, size_t total)> ProgressCallback;
 
-IMQS_TRAIN_API Error ExportLabeledImagePatches_Video_Bulk(ExportTypes type, std::string modelName, std::string rootDir, const LabelTaxonomy& taxonomy);
+// Threading for ExportLabeledImagePatches_Video_Bulk. Zero means choose automatically.
+struct BulkExportOptions {
+	int Decoders          = 0;  // Number of videos that are decoded concurrently
+	int Encoders          = 0;  // Number of threads that encode patches into png/jpeg files
+	int MaxFramesInFlight = 16; // Maximum number of decoded frames waiting to be encoded. This bounds memory usage.
+};
+
+// Export all of the labeled videos inside rootDir. Progress is reported as the number of exported frames,
+// over all videos, and may be called from any thread (but never concurrently). If prog is null, then
+// progress is printed to stdout.
+IMQS_TRAIN_API Error ExportLabeledImagePatches_Video_Bulk(ExportTypes type, std::string modelName, std::string rootDir, const LabelTaxonomy& taxonomy, ProgressCallback prog = nullptr, BulkExportOptions options = BulkExportOptions());
 IMQS_TRAIN_API Error ExportLabeledImagePatches_Video(ExportTypes type, std::string videoFilename, const LabelTaxonomy& taxonomy, const VideoLabels& labels, ProgressCallback prog);
-IMQS_TRAIN_API Error ExportLabeledBatch(bool channelsFirst, bool compress, const std::vector<std::pair<int, int>>& batch, video::VideoFile& video, const VideoLabels& labels, std::string& encoded);
+IMQS_TRAIN_API Error ExportLabeledBatch(bool channelsFirst, bool compress, const std::vector<std::pair<int, int>>& batch, const std::vector<video::VideoFile*>& decoders, const VideoLabels& labels, std::string& encoded);
 
 } // namespace train
 } // namespace imqs
\ No newline at end of file
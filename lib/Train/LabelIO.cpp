@@ -452,34 +452,245 @@ IMQS_TRAIN_API bool VideoFileHasLabels(std::string videoFilename, std::string mo
 	return os::Stat(LabelFileDir(videoFilename, modelName), at).OK();
 }
 
+static StaticError ErrLabelSnapshotCorrupt("Label snapshot is corrupt");
+
+#pragma pack(push)
+#pragma pack(4)
+struct LabelSnapshotHeader {
+	enum Constants {
+		CurrentVersion = 1,
+	};
+	uint32_t Magic      = 0x4e534c42; // "BLSN"
+	uint32_t Version    = CurrentVersion;
+	uint64_t NumFiles   = 0; // Number of .json and .journal files in the label directory
+	uint64_t ListingSig = 0; // Hash of the names and modification times of those files
+	uint64_t NumFrames  = 0;
+};
+#pragma pack(pop)
+
+// Reads the binary snapshot format. Every read is bounds checked, so that a truncated or corrupt
+// snapshot results in an error (and a rebuild from JSON), instead of a crash.
+class LabelSnapshotReader {
+public:
+	const uint8_t* P;
+	const uint8_t* End;
+
+	LabelSnapshotReader(const std::string& buf, size_t offset) : P((const uint8_t*) buf.data() + offset), End((const uint8_t*) buf.data() + buf.size()) {}
+
+	// Returns true if the remaining bytes can hold 'count' records of at least 'minRecordSize' bytes each.
+	// We check this before sizing a vector from a count that was read off disk.
+	bool HasRoomFor(uint64_t count, size_t minRecordSize) const {
+		return count <= (uint64_t)(End - P) / minRecordSize;
+	}
+
+	template <typename T>
+	bool Read(T& v) {
+		if ((size_t)(End - P) < sizeof(T))
+			return false;
+		memcpy(&v, P, sizeof(T));
+		P += sizeof(T);
+		return true;
+	}
+
+	bool ReadStr(std::string& s) {
+		uint32_t len;
+		if (!Read(len) || (size_t)(End - P) < len)
+			return false;
+		s.assign((const char*) P, len);
+		P += len;
+		return true;
+	}
+};
+
+static void WriteSnapshotStr(io::Buffer& buf, const std::string& s) {
+	buf.WriteUint32((uint32_t) s.size());
+	buf.Add(s.data(), s.size());
+}
+
+static std::string LabelSnapshotFilename(const std::string& dir) {
+	// The snapshot lives beside the label directory, so that it is not part of the directory listing
+	return dir + ".snapshot";
+}
+
+static Error SaveLabelSnapshot(const std::string& filename, const LabelSnapshotHeader& head, const VideoLabels& labels) {
+	io::Buffer buf;
+	buf.Add(&head, sizeof(head));
+	for (const auto& f : labels.Frames) {
+		buf.WriteInt64(f.Time);
+		buf.WriteUint32((uint32_t) f.Labels.size());
+		for (const auto& lab : f.Labels) {
+			buf.WriteInt32(lab.Rect.X1);
+			buf.WriteInt32(lab.Rect.Y1);
+			buf.WriteInt32(lab.Rect.X2);
+			buf.WriteInt32(lab.Rect.Y2);
+			buf.WriteUint32((uint32_t) lab.Polygon.Vertices.size());
+			for (const auto& v : lab.Polygon.Vertices) {
+				buf.WriteInt32(v.X);
+				buf.WriteInt32(v.Y);
+			}
+			buf.WriteUint32((uint32_t) lab.Classes.size());
+			for (const auto& c : lab.Classes) {
+				WriteSnapshotStr(buf, c.Class);
+				buf.WriteInt32(c.Severity);
+			}
+			WriteSnapshotStr(buf, lab.Author);
+			int64_t sec;
+			int32_t nsec;
+			lab.EditTime.Internal(sec, nsec);
+			buf.WriteInt64(sec);
+			buf.WriteInt32(nsec);
+		}
+	}
+
+	// Write to a temporary file and rename, so that a concurrent reader never sees a partial snapshot
+	string tmp = filename + ".tmp";
+	auto   err = os::WriteWholeFile(tmp, buf.Buf, buf.Len);
+	if (!err.OK())
+		return err;
+	err = os::Rename(tmp, filename);
+	if (!err.OK())
+		os::Remove(tmp);
+	return err;
+}
+
+static Error LoadLabelSnapshot(const std::string& filename, const LabelSnapshotHeader& expect, VideoLabels& labels) {
+	string buf;
+	auto   err = os::ReadWholeFile(filename, buf);
+	if (!err.OK())
+		return err;
+
+	LabelSnapshotHeader head;
+	if (buf.size() < sizeof(head))
+		return Error("Label snapshot is truncated");
+	memcpy(&head, buf.data(), sizeof(head));
+	if (head.Magic != expect.Magic || head.Version != expect.Version)
+		return Error("Label snapshot has wrong magic or version");
+	if (head.NumFiles != expect.NumFiles || head.ListingSig != expect.ListingSig)
+		return Error("Label snapshot is stale");
+
+	// Minimum size of each record, when all of its arrays and strings are empty
+	const size_t minFrame  = 8 + 4;                  // time, label count
+	const size_t minLabel  = 16 + 4 + 4 + 4 + 8 + 4; // rect, vertex count, class count, author length, edit time
+	const size_t minVertex = 8;                      // x, y
+	const size_t minClass  = 4 + 4;                  // class length, severity
+
+	LabelSnapshotReader r(buf, sizeof(head));
+	if (!r.HasRoomFor(head.NumFrames, minFrame))
+		return ErrLabelSnapshotCorrupt;
+	labels.Frames.resize(head.NumFrames);
+	for (auto& f : labels.Frames) {
+		uint32_t nlabels;
+		if (!r.Read(f.Time) || !r.Read(nlabels) || !r.HasRoomFor(nlabels, minLabel))
+			return ErrLabelSnapshotCorrupt;
+		f.Labels.resize(nlabels);
+		for (auto& lab : f.Labels) {
+			uint32_t nvert, nclass;
+			if (!r.Read(lab.Rect.X1) || !r.Read(lab.Rect.Y1) || !r.Read(lab.Rect.X2) || !r.Read(lab.Rect.Y2) || !r.Read(nvert) || !r.HasRoomFor(nvert, minVertex))
+				return ErrLabelSnapshotCorrupt;
+			lab.Polygon.Vertices.resize(nvert);
+			for (auto& v : lab.Polygon.Vertices) {
+				if (!r.Read(v.X) || !r.Read(v.Y))
+					return ErrLabelSnapshotCorrupt;
+			}
+			if (!r.Read(nclass) || !r.HasRoomFor(nclass, minClass))
+				return ErrLabelSnapshotCorrupt;
+			lab.Classes.resize(nclass);
+			for (auto& c : lab.Classes) {
+				if (!r.ReadStr(c.Class) || !r.Read(c.Severity))
+					return ErrLabelSnapshotCorrupt;
+			}
+			int64_t sec;
+			int32_t nsec;
+			if (!r.ReadStr(lab.Author) || !r.Read(sec) || !r.Read(nsec))
+				return ErrLabelSnapshotCorrupt;
+			lab.EditTime = time::Time::FromInternal(sec, nsec);
+		}
+	}
+	if (r.P != r.End)
+		return ErrLabelSnapshotCorrupt;
+	return Error();
+}
+
+// Labels are loaded from a binary snapshot, if the snapshot is still consistent with the label
+// directory. Otherwise we parse the JSON files, and write a new snapshot. The snapshot is validated
+// against the names and modification times of all the files in the directory, so listing the
+// directory is the only cost that we can't avoid.
 IMQS_TRAIN_API Error LoadVideoLabels(std::string videoFilename, std::string modelName, VideoLabels& labels) {
 	labels.Frames.clear();
-	auto  dir = LabelFileDir(videoFilename, modelName);
-	Error err;
-	auto  errFind = os::FindFiles(dir, [&err, &labels](const os::FindFileItem& item) -> bool {
+	auto dir = LabelFileDir(videoFilename, modelName);
+
+	struct FileItem {
+		string     Name;
+		time::Time TimeModify;
+		bool       IsJournal;
+	};
+	vector<FileItem> files;
+	auto             err = os::FindFiles(dir, [&files](const os::FindFileItem& item) -> bool {
         if (item.IsDir)
             return false;
-        // 000001.json
-        if (strings::EndsWith(item.Name, ".json")) {
-            std::string buf;
-            err = os::ReadWholeFile(item.FullPath(), buf);
-            if (!err.OK())
-                return false;
-            auto        j = json::parse(buf.c_str());
-            ImageLabels frame;
-            frame.Time = AtoI64(item.Name.c_str());
-            err        = frame.FromJson(j);
-            if (!err.OK())
-                return false;
-            labels.Frames.emplace_back(std::move(frame));
-        }
+        // 000001.json, or frames that have not yet been compacted out of a LabelStore journal
+        bool isJournal = strings::EndsWith(item.Name, ".journal");
+        if (isJournal || strings::EndsWith(item.Name, ".json"))
+            files.push_back({item.Name, item.TimeModify, isJournal});
         return true;
     });
+	if (!err.OK())
+		return err;
+
+	sort(files.begin(), files.end(), [](const FileItem& a, const FileItem& b) { return a.Name < b.Name; });
+	string listing;
+	for (const auto& f : files) {
+		int64_t sec;
+		int32_t nsec;
+		f.TimeModify.Internal(sec, nsec);
+		listing += f.Name;
+		listing += tsf::fmt(":%v.%v\n", sec, nsec);
+	}
+	LabelSnapshotHeader head;
+	head.NumFiles   = files.size();
+	head.ListingSig = XXH64(listing.data(), (unsigned) listing.size(), 0);
+
+	auto snapshotFile = LabelSnapshotFilename(dir);
+	if (LoadLabelSnapshot(snapshotFile, head, labels).OK())
+		return Error();
+	labels.Frames.clear();
+
+	vector<FileItem>                journals;
+	ohash::map<int64_t, time::Time> frameFileTimes;
+	for (const auto& f : files) {
+		if (f.IsJournal) {
+			journals.push_back(f);
+			continue;
+		}
+		frameFileTimes.insert(AtoI64(f.Name.c_str()), f.TimeModify);
+		json j;
+		err = nj::ParseFile(dir + "/" + f.Name, j);
+		if (!err.OK())
+			return err;
+		ImageLabels frame;
+		frame.Time = AtoI64(f.Name.c_str());
+		err        = frame.FromJson(j);
+		if (!err.OK())
+			return err;
+		labels.Frames.emplace_back(std::move(frame));
+	}
 	std::sort(labels.Frames.begin(), labels.Frames.end());
 
-	if (!errFind.OK())
-		return errFind;
-	return err;
+	// A journal frame only replaces a frame file that is older than it, and when several journals hold
+	// the same frame, the most recently modified journal wins.
+	sort(journals.begin(), journals.end(), [](const FileItem& a, const FileItem& b) { return a.TimeModify < b.TimeModify; });
+	for (const auto& f : journals) {
+		vector<ImageLabels> journal;
+		err = LoadLabelJournal(dir + "/" + f.Name, journal, &frameFileTimes);
+		if (!err.OK())
+			return err;
+		ApplyLabelJournal(journal, labels);
+	}
+
+	// Failure to write the snapshot (eg read-only media) just means that we'll parse the JSON again next time
+	head.NumFrames = labels.Frames.size();
+	SaveLabelSnapshot(snapshotFile, head, labels);
+	return Error();
 }
 
 IMQS_TRAIN_API Error SaveVideoLabels(std::string videoFilename, std::string modelName, const VideoLabels& labels) {
@@ -503,6 +714,63 @@ IMQS_TRAIN_API Error SaveFrameLabels(std::string videoFilename, std::string mode
 	return os::WriteWholeFile(dir + "/" + fn, j.dump(4));
 }
 
+IMQS_TRAIN_API Error LoadLabelJournal(std::string filename, std::vector<ImageLabels>& frames, const ohash::map<int64_t, time::Time>* frameFileTimes) {
+	string buf;
+	auto   err = os::ReadWholeFile(filename, buf);
+	if (!err.OK())
+		return err;
+
+	// Journals written before we recorded a save time on every line were all saved by the time
+	// of the journal's last modification. The journal's modification time also caps a save time
+	// from a machine whose clock is ahead.
+	time::Time journalTime;
+	if (frameFileTimes) {
+		os::FileAttributes attribs;
+		err = os::Stat(filename, attribs);
+		if (!err.OK())
+			return err;
+		journalTime = attribs.TimeModify;
+	}
+
+	// Every line is one frame. A final line without a terminator is the result of an interrupted
+	// write, so we ignore it.
+	size_t start = 0;
+	while (true) {
+		size_t end = buf.find('\n', start);
+		if (end == string::npos)
+			break;
+		json j;
+		err = nj::ParseString(buf.substr(start, end - start), j);
+		if (!err.OK())
+			return Error::Fmt("Invalid line in label journal %v: %v", filename, err.Message());
+		ImageLabels frame;
+		frame.Time = nj::GetInt64(j, "time");
+		err        = frame.FromJson(j);
+		if (!err.OK())
+			return err;
+		start = end + 1;
+		if (frameFileTimes) {
+			auto fileTime = frameFileTimes->getp(frame.Time);
+			if (fileTime) {
+				time::Time saved = journalTime;
+				if (nj::Has(j, "saved"))
+					saved = std::min(saved, time::Time::FromUnix(0, nj::GetInt64(j, "saved")));
+				if (*fileTime > saved)
+					continue;
+			}
+		}
+		frames.emplace_back(std::move(frame));
+	}
+	return Error();
+}
+
+IMQS_TRAIN_API void ApplyLabelJournal(const std::vector<ImageLabels>& journal, VideoLabels& labels) {
+	// Later entries of a journal replace earlier ones. This is also how an erased frame (ie one
+	// with no labels) replaces its older version.
+	for (const auto& f : journal)
+		*labels.FindOrInsertFrame(f.Time) = f;
+}
+
 IMQS_TRAIN_API int MergeVideoLabels(const VideoLabels& src, VideoLabels& dst) {
 	int nnew = 0;
 	for (const auto& sframe : src.Frames) {
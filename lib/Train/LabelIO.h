@@ -167,7 +167,13 @@ IMQS_TRAIN_API bool        VideoFileHasLabels(std::string videoFilename, std::st
 IMQS_TRAIN_API Error LoadVideoLabels(std::string videoFilename, std::string modelName, VideoLabels& labels);
 IMQS_TRAIN_API Error SaveVideoLabels(std::string videoFilename, std::string modelName, const VideoLabels& labels);
 IMQS_TRAIN_API Error SaveFrameLabels(std::string videoFilename, std::string modelName, const ImageLabels& frame);
-IMQS_TRAIN_API int   MergeVideoLabels(const VideoLabels& src, VideoLabels& dst); // Returns number of new frames
+// Read the frames of a journal written by LabelStore, in the order that they were written.
+// If frameFileTimes is given (modification time of every <time>.json frame file), then journal frames that
+// were saved before their frame file was last written are dropped, so that a journal which was left behind
+// (eg by a labeler that crashed) cannot override newer edits.
+IMQS_TRAIN_API Error LoadLabelJournal(std::string filename, std::vector<ImageLabels>& frames, const ohash::map<int64_t, time::Time>* frameFileTimes = nullptr);
+IMQS_TRAIN_API void  ApplyLabelJournal(const std::vector<ImageLabels>& journal, VideoLabels& labels); // Journal frames replace frames loaded from the per-frame files
+IMQS_TRAIN_API int   MergeVideoLabels(const VideoLabels& src, VideoLabels& dst);                      // Returns number of new frames
 IMQS_TRAIN_API Error ExportClassTaxonomy(std::string filename, std::vector<LabelClass> classes);
 IMQS_TRAIN_API ohash::map<std::string, std::string> ClassToGroupMap(std::vector<LabelClass> classes);
 
@@ -0,0 +1,218 @@
+#include "pch.h"
+#include "LabelStore.h"
+
+using namespace std;
+using json = nlohmann::json;
+
+namespace imqs {
+namespace train {
+
+LabelStore::~LabelStore() {
+	Close();
+}
+
+Error LabelStore::Open(std::string videoFilename, std::string modelName, std::string owner) {
+	Close();
+
+	// The owner becomes part of a filename
+	for (auto& c : owner) {
+		if (!isalnum((unsigned char) c) && c != '-' && c != '_' && c != '.')
+			c = '_';
+	}
+
+	Dir             = LabelFileDir(videoFilename, modelName);
+	JournalFilename = owner + ".journal";
+	auto err        = os::MkDirAll(Dir);
+	if (!err.OK())
+		return err;
+
+	VideoFilename = videoFilename;
+	ModelName     = modelName;
+
+	// A journal that is left over from a previous session was not compacted, perhaps because we crashed.
+	// Other labelers may have saved some of its frames since then, and those newer versions must win.
+	string                          journalPath = Dir + "/" + JournalFilename;
+	vector<ImageLabels>             leftover;
+	ohash::map<int64_t, time::Time> frameFileTimes;
+	err = os::FindFiles(Dir, [&](const os::FindFileItem& item) -> bool {
+		if (item.IsDir)
+			return false;
+		if (strings::EndsWith(item.Name, ".json"))
+			frameFileTimes.insert(AtoI64(item.Name.c_str()), item.TimeModify);
+		return true;
+	});
+	if (err.OK())
+		err = LoadLabelJournal(journalPath, leftover, &frameFileTimes);
+	if (err.OK()) {
+		for (auto& f : leftover)
+			Pending.set(f.Time, f);
+		err = Compact();
+	} else if (os::IsNotExist(err)) {
+		err = Error();
+	}
+	if (!err.OK()) {
+		VideoFilename = "";
+		return err;
+	}
+	return OpenJournal();
+}
+
+Error LabelStore::Close() {
+	if (!IsOpen())
+		return Error();
+	auto err = Compact();
+	Journal.Close();
+	JournalIsOpen = false;
+	if (err.OK())
+		os::Remove(Dir + "/" + JournalFilename);
+	VideoFilename = "";
+	ModelName     = "";
+	Dir           = "";
+	Pending.clear();
+	Seen.clear();
+	return err;
+}
+
+Error LabelStore::OpenJournal() {
+	if (JournalIsOpen)
+		return Error();
+	string journalPath = Dir + "/" + JournalFilename;
+	auto   err         = Journal.Open(journalPath, os::File::OpenFlagModify);
+	if (os::IsNotExist(err))
+		err = Journal.Create(journalPath);
+	if (!err.OK())
+		return err;
+	err = Journal.Seek(0, io::SeekWhence::End);
+	if (!err.OK()) {
+		Journal.Close();
+		return err;
+	}
+	JournalIsOpen = true;
+	return Error();
+}
+
+Error LabelStore::Save(const std::vector<ImageLabels>& frames) {
+	if (frames.size() == 0)
+		return Error();
+	if (!IsOpen())
+		return Error("LabelStore is not open");
+
+	auto err = OpenJournal();
+	if (!err.OK())
+		return err;
+
+	// Write all of the frames with a single call, so that an interruption can at worst leave behind
+	// one partial line at the end of the journal, which LoadLabelJournal ignores.
+	string  buf;
+	int64_t saved = time::Now().UnixNano();
+	for (const auto& f : frames) {
+		json j;
+		f.ToJson(j);
+		j["time"]  = f.Time;
+		j["saved"] = saved; // Lets LoadLabelJournal decide whether this is newer than the frame's own file
+		buf += j.dump();
+		buf += "\n";
+		Pending.set(f.Time, f);
+	}
+	err = Journal.Write(buf.data(), buf.size());
+	if (!err.OK())
+		return err;
+	RememberModifyTime(JournalFilename);
+
+	if (Pending.size() >= CompactThreshold)
+		return Compact();
+	return Error();
+}
+
+Error LabelStore::Compact() {
+	if (Pending.size() == 0)
+		return Error();
+
+	for (const auto& p : Pending) {
+		auto err = SaveFrameLabels(VideoFilename, ModelName, p.second);
+		if (!err.OK())
+			return err;
+		RememberModifyTime(tsf::fmt("%v.json", p.first));
+	}
+
+	// Only truncate the journal once all of its frames are safely in their own files
+	Journal.Close();
+	JournalIsOpen = false;
+	auto err      = Journal.Create(Dir + "/" + JournalFilename);
+	if (!err.OK())
+		return err;
+	JournalIsOpen = true;
+	RememberModifyTime(JournalFilename);
+	Pending.clear();
+	return Error();
+}
+
+void LabelStore::RememberModifyTime(const std::string& name) {
+	os::FileAttributes attribs;
+	if (os::Stat(Dir + "/" + name, attribs).OK())
+		Seen.set(name, attribs.TimeModify);
+}
+
+Error LabelStore::LoadChanged(VideoLabels& changed) {
+	if (!IsOpen())
+		return Error("LabelStore is not open");
+
+	changed.Frames.clear();
+	Error                           err;
+	vector<string>                  journals;
+	ohash::map<int64_t, time::Time> frameFileTimes;
+	auto                            errFind = os::FindFiles(Dir, [&](const os::FindFileItem& item) -> bool {
+        if (item.IsDir)
+            return false;
+        bool isJournal = strings::EndsWith(item.Name, ".journal");
+        bool isFrame   = strings::EndsWith(item.Name, ".json");
+        if (!isJournal && !isFrame)
+            return true;
+        if (isFrame)
+            frameFileTimes.insert(AtoI64(item.Name.c_str()), item.TimeModify);
+        // Our own journal only contains frames that we already have
+        if (item.Name == JournalFilename)
+            return true;
+        auto prev = Seen.getp(item.Name);
+        if (prev && *prev == item.TimeModify)
+            return true;
+        Seen.set(item.Name, item.TimeModify);
+        if (isJournal) {
+            journals.push_back(item.FullPath());
+        } else {
+            json j;
+            err = nj::ParseFile(item.FullPath(), j);
+            if (!err.OK())
+                return false;
+            ImageLabels frame;
+            frame.Time = AtoI64(item.Name.c_str());
+            err        = frame.FromJson(j);
+            if (!err.OK())
+                return false;
+            changed.Frames.emplace_back(std::move(frame));
+        }
+        return true;
+    });
+	std::sort(changed.Frames.begin(), changed.Frames.end());
+
+	if (!errFind.OK())
+		return errFind;
+	if (!err.OK())
+		return err;
+
+	for (const auto& fn : journals) {
+		vector<ImageLabels> journal;
+		err = LoadLabelJournal(fn, journal, &frameFileTimes);
+		if (os::IsNotExist(err)) {
+			// The other labeler closed its journal while we were scanning
+			continue;
+		}
+		if (!err.OK())
+			return err;
+		ApplyLabelJournal(journal, changed);
+	}
+	return Error();
+}
+
+} // namespace train
+} // namespace imqs
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "LabelIO.h"
+
+namespace imqs {
+namespace train {
+
+// LabelStore persists the labels of a single video incrementally.
+//
+// Saved frames are appended, one compact JSON line per frame, to a journal inside the label
+// directory (<owner>.journal). Once the journal has grown past CompactThreshold frames, or when
+// the store is closed, the latest version of every journaled frame is written out to the usual
+// one-file-per-frame layout, and the journal is truncated. LoadVideoLabels replays journals, so
+// readers never miss frames that have not been compacted yet. Every journal line records when it
+// was saved, and a journaled frame never replaces a frame file that was written after it.
+//
+// LoadChanged only reads the files that have been modified since the previous call, so periodically
+// polling for the edits of other labelers does not mean re-reading the entire directory.
+//
+// The owner string must be unique to every concurrent writer (eg host and user name), because
+// every owner has its own journal.
+class IMQS_TRAIN_API LabelStore {
+public:
+	size_t CompactThreshold = 500; // Compact the journal after this many frames have been appended to it
+
+	~LabelStore();
+
+	Error       Open(std::string videoFilename, std::string modelName, std::string owner);
+	Error       Close(); // Compact and close. Returns the compaction error, if any.
+	bool        IsOpen() const { return VideoFilename != ""; }
+	std::string GetVideoFilename() const { return VideoFilename; }
+
+	Error Save(const std::vector<ImageLabels>& frames); // Append frames to the journal (and possibly compact)
+	Error Compact();                                    // Write all journaled frames out to their per-frame files, and truncate the journal
+
+	// Load the frames from all files that have changed since the previous call. On the first call, this
+	// loads everything. Our own writes are not reported as changes.
+	Error LoadChanged(VideoLabels& changed);
+
+private:
+	std::string                         VideoFilename;
+	std::string                         ModelName;
+	std::string                         Dir;
+	std::string                         JournalFilename;
+	os::File                            Journal;
+	bool                                JournalIsOpen = false;
+	ohash::map<int64_t, ImageLabels>    Pending; // Latest version of every frame in our journal
+	ohash::map<std::string, time::Time> Seen;    // Modification time of every file at the time that we last read or wrote it
+
+	Error OpenJournal();
+	void  RememberModifyTime(const std::string& name);
+};
+
+} // namespace train
+} // namespace imqs
@@ -0,0 +1,282 @@
+#include "pch.h"
+#include "Shard.h"
+
+using namespace std;
+
+namespace imqs {
+namespace train {
+
+static const size_t ShardPayloadAlign = 16;
+
+static size_t AlignUp(size_t v, size_t align) {
+	return (v + align - 1) & ~(align - 1);
+}
+
+uint32_t ShardWriter::Pending::AddString(const std::string& s) {
+	auto p = StringIndex.getp(s);
+	if (p)
+		return *p;
+	uint32_t i = (uint32_t) Strings.size();
+	Strings.push_back(s);
+	StringIndex.insert(s, i);
+	return i;
+}
+
+ShardWriter::~ShardWriter() {
+	// Discard the final partial shard, unless Close was called
+}
+
+Error ShardWriter::Open(const std::string& dir) {
+	Dir      = dir;
+	auto err = os::MkDirAll(Dir);
+	if (!err.OK())
+		return err;
+
+	vector<string> stale;
+	err = os::FindFiles(Dir, [&](const os::FindFileItem& item) -> bool {
+		if (!item.IsDir && strings::StartsWith(item.Name, (Prefix + "-").c_str()) && (strings::EndsWith(item.Name, ".shard") || strings::EndsWith(item.Name, ".shard.tmp")))
+			stale.push_back(item.FullPath());
+		return true;
+	});
+	if (!err.OK())
+		return err;
+	for (const auto& f : stale) {
+		err = os::Remove(f);
+		if (!err.OK())
+			return Error::Fmt("Error deleting old shard %v: %v", f, err.Message());
+	}
+	return Error();
+}
+
+Error ShardWriter::Add(const std::string& videoFilename, int64_t frameTime, const Label& label, const gfx::Image& rgba) {
+	// Convert to RGB, and compress, before taking the lock
+	size_t rawSize = (size_t) rgba.Width * (size_t) rgba.Height * 3;
+	string rgb;
+	rgb.resize(rawSize);
+	uint8_t* dst = (uint8_t*) &rgb[0];
+	for (int y = 0; y < rgba.Height; y++) {
+		const uint8_t* src = (const uint8_t*) rgba.Line(y);
+		for (int x = 0; x < rgba.Width; x++) {
+			dst[0] = src[0];
+			dst[1] = src[1];
+			dst[2] = src[2];
+			dst += 3;
+			src += 4;
+		}
+	}
+
+	string   compressed;
+	uint32_t compression = ShardCompressionNone;
+	if (Compress) {
+		compressed.resize(LZ4_compressBound((int) rawSize));
+		int n = LZ4_compress_default(rgb.data(), &compressed[0], (int) rawSize, (int) compressed.size());
+		if (n > 0 && (size_t) n < rawSize) {
+			compressed.resize(n);
+			compression = ShardCompressionLZ4;
+		}
+	}
+	const string& payload = compression == ShardCompressionLZ4 ? compressed : rgb;
+
+	unique_ptr<Pending> full;
+	size_t              fullNumber = 0;
+	{
+		lock_guard<mutex> lock(Lock);
+		if (!Cur)
+			Cur = unique_ptr<Pending>(new Pending());
+
+		ShardRecord rec;
+		rec.PayloadOffset = Cur->Payload.size(); // Relative to the start of the payload section. Fixed up in WriteShard.
+		rec.PayloadSize   = (uint32_t) payload.size();
+		rec.RawSize       = (uint32_t) rawSize;
+		rec.Compression   = compression;
+		rec.Video         = Cur->AddString(videoFilename);
+		rec.FrameTime     = frameTime;
+		rec.X             = label.Rect.X1;
+		rec.Y             = label.Rect.Y1;
+		rec.Width         = rgba.Width;
+		rec.Height        = rgba.Height;
+		rec.FirstClass    = (uint32_t) Cur->Classes.size();
+		rec.NumClasses    = (uint32_t) label.Classes.size();
+		for (const auto& c : label.Classes) {
+			ShardClass sc;
+			sc.Class    = Cur->AddString(c.Class);
+			sc.Severity = c.Severity;
+			Cur->Classes.push_back(sc);
+		}
+		Cur->Records.push_back(rec);
+		Cur->Payload.append(payload);
+		Cur->Payload.resize(AlignUp(Cur->Payload.size(), ShardPayloadAlign));
+
+		if (Cur->Payload.size() >= ShardSize) {
+			full       = std::move(Cur);
+			fullNumber = NextShard++;
+		}
+	}
+
+	// Write the full shard outside of the lock, so that other threads can continue to fill the next one
+	if (full)
+		return WriteShard(fullNumber, *full);
+	return Error();
+}
+
+Error ShardWriter::Close() {
+	unique_ptr<Pending> last;
+	size_t              lastNumber = 0;
+	{
+		lock_guard<mutex> lock(Lock);
+		if (!Cur || Cur->Records.size() == 0)
+			return Error();
+		last       = std::move(Cur);
+		lastNumber = NextShard++;
+	}
+	return WriteShard(lastNumber, *last);
+}
+
+Error ShardWriter::WriteShard(size_t shardNumber, const Pending& p) {
+	string strings;
+	for (const auto& s : p.Strings) {
+		uint32_t len = (uint32_t) s.size();
+		strings.append((const char*) &len, sizeof(len));
+		strings.append(s);
+	}
+
+	ShardHeader head;
+	head.NumRecords    = p.Records.size();
+	head.RecordsOffset = sizeof(ShardHeader);
+	head.NumClasses    = p.Classes.size();
+	head.ClassesOffset = head.RecordsOffset + p.Records.size() * sizeof(ShardRecord);
+	head.NumStrings    = p.Strings.size();
+	head.StringsOffset = head.ClassesOffset + p.Classes.size() * sizeof(ShardClass);
+	head.PayloadOffset = AlignUp(head.StringsOffset + strings.size(), ShardPayloadAlign);
+	head.PayloadSize   = p.Payload.size();
+
+	vector<ShardRecord> records = p.Records;
+	for (auto& r : records)
+		r.PayloadOffset += head.PayloadOffset;
+
+	auto err = os::MkDirAll(Dir);
+	if (!err.OK())
+		return err;
+
+	// Write to a temporary file and rename, so that a reader never sees a partial shard
+	auto     filename = Dir + "/" + tsf::fmt("%v-%06d.shard", Prefix, shardNumber);
+	auto     tmp      = filename + ".tmp";
+	os::File f;
+	err = f.Create(tmp);
+	if (!err.OK())
+		return err;
+	uint8_t zeros[ShardPayloadAlign] = {0};
+	err |= f.Write(&head, sizeof(head));
+	err |= f.Write(records.data(), records.size() * sizeof(ShardRecord));
+	if (p.Classes.size() != 0)
+		err |= f.Write(p.Classes.data(), p.Classes.size() * sizeof(ShardClass));
+	err |= f.Write(strings.data(), strings.size());
+	err |= f.Write(zeros, head.PayloadOffset - (head.StringsOffset + strings.size()));
+	err |= f.Write(p.Payload.data(), p.Payload.size());
+	f.Close();
+	if (err.OK())
+		err = os::Rename(tmp, filename);
+	if (!err.OK()) {
+		os::Remove(tmp);
+		return Error::Fmt("Error writing shard %v: %v", filename, err.Message());
+	}
+	return Error();
+}
+
+Error ShardReader::Open(const std::string& filename) {
+	Close();
+	auto err = File.Open(filename);
+	if (!err.OK())
+		return err;
+
+	// Validate everything up front, so that the accessors don't need to
+	uint64_t len = (uint64_t) File.Length();
+	if (len < sizeof(ShardHeader)) {
+		Close();
+		return Error::Fmt("Shard %v is truncated", filename);
+	}
+	ShardHeader expect;
+	memcpy(&Header, File.MemBase(), sizeof(Header));
+	if (Header.Magic != expect.Magic || Header.Version != expect.Version) {
+		Close();
+		return Error::Fmt("Shard %v has wrong magic or version", filename);
+	}
+	// Compare with subtraction and division, so that a corrupt header can't overflow the arithmetic
+	auto fits = [len](uint64_t offset, uint64_t count, uint64_t size) {
+		return offset <= len && count <= (len - offset) / size;
+	};
+	if (!fits(Header.RecordsOffset, Header.NumRecords, sizeof(ShardRecord)) ||
+	    !fits(Header.ClassesOffset, Header.NumClasses, sizeof(ShardClass)) ||
+	    !fits(Header.PayloadOffset, Header.PayloadSize, 1) ||
+	    Header.StringsOffset > Header.PayloadOffset) {
+		Close();
+		return Error::Fmt("Shard %v is truncated", filename);
+	}
+	Records = (const ShardRecord*) (File.MemBase() + Header.RecordsOffset);
+	Classes = (const ShardClass*) (File.MemBase() + Header.ClassesOffset);
+
+	const uint8_t* s   = File.MemBase() + Header.StringsOffset;
+	const uint8_t* end = File.MemBase() + Header.PayloadOffset;
+	for (uint64_t i = 0; i < Header.NumStrings; i++) {
+		uint32_t slen;
+		if (end - s < (ptrdiff_t) sizeof(slen)) {
+			Close();
+			return Error::Fmt("Shard %v has a corrupt string table", filename);
+		}
+		memcpy(&slen, s, sizeof(slen));
+		s += sizeof(slen);
+		if ((uint64_t)(end - s) < slen) {
+			Close();
+			return Error::Fmt("Shard %v has a corrupt string table", filename);
+		}
+		Strings.push_back(string((const char*) s, slen));
+		s += slen;
+	}
+
+	for (uint64_t i = 0; i < Header.NumClasses; i++) {
+		if (Classes[i].Class >= Header.NumStrings) {
+			Close();
+			return Error::Fmt("Shard %v has a corrupt class %v", filename, i);
+		}
+	}
+
+	// Payload offsets are within [PayloadOffset, PayloadOffset + PayloadSize], which we've already checked against len
+	uint64_t payloadEnd = Header.PayloadOffset + Header.PayloadSize;
+	for (uint64_t i = 0; i < Header.NumRecords; i++) {
+		const auto& r = Records[i];
+		if (r.PayloadOffset < Header.PayloadOffset || r.PayloadOffset > payloadEnd || r.PayloadSize > payloadEnd - r.PayloadOffset ||
+		    (r.Compression == ShardCompressionNone && r.RawSize != r.PayloadSize) ||
+		    (r.Compression != ShardCompressionNone && r.Compression != ShardCompressionLZ4) ||
+		    (uint64_t) r.FirstClass + r.NumClasses > Header.NumClasses || r.Video >= Header.NumStrings) {
+			Close();
+			return Error::Fmt("Shard %v has a corrupt record %v", filename, i);
+		}
+	}
+	return Error();
+}
+
+void ShardReader::Close() {
+	File.Close();
+	Header  = ShardHeader();
+	Records = nullptr;
+	Classes = nullptr;
+	Strings.clear();
+}
+
+Error ShardReader::ReadImage(size_t i, void* rgb) const {
+	const auto& r = Records[i];
+	if (r.Compression == ShardCompressionNone) {
+		memcpy(rgb, Payload(i), r.RawSize);
+		return Error();
+	}
+	size_t rawLen = r.RawSize;
+	auto   err    = compress::lz4::DecompressSafe(Payload(i), r.PayloadSize, rgb, rawLen);
+	if (!err.OK())
+		return err;
+	if (rawLen != r.RawSize)
+		return Error::Fmt("Shard record %v decompressed to %v bytes instead of %v", i, rawLen, r.RawSize);
+	return Error();
+}
+
+} // namespace train
+} // namespace imqs
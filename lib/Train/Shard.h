@@ -0,0 +1,141 @@
+#pragma once
+
+#include "LabelIO.h"
+
+namespace imqs {
+namespace train {
+
+/* Shard files
+
+A shard holds many training records (image patches and their labels) in one file, so that training
+doesn't need to open millions of tiny files. Everything that a reader needs to locate a record is at
+the front of the file, so a shard can be read sequentially at disk bandwidth, or memory mapped
+for random access.
+
+Layout (little endian):
+
+	ShardHeader
+	ShardRecord[NumRecords]          Sorted in the order that the records were added
+	ShardClass[NumClasses]           Classes of all records. A record references a contiguous run of these.
+	Strings                          Every string is a uint32 length, followed by the bytes (no terminator)
+	Payloads                         Each payload starts on a 16 byte boundary
+
+A payload is an RGB image (3 bytes per pixel, no row padding) of ShardRecord.Width x ShardRecord.Height.
+If ShardRecord.Compression is ShardCompressionLZ4, then the payload is an LZ4 block (not an LZ4 frame).
+*/
+
+enum ShardCompression {
+	ShardCompressionNone = 0,
+	ShardCompressionLZ4  = 1,
+};
+
+#pragma pack(push)
+#pragma pack(4)
+struct ShardHeader {
+	enum Constants {
+		CurrentVersion = 1,
+	};
+	uint32_t Magic         = 0x44524853; // "SHRD"
+	uint32_t Version       = CurrentVersion;
+	uint64_t NumRecords    = 0;
+	uint64_t RecordsOffset = 0;
+	uint64_t NumClasses    = 0;
+	uint64_t ClassesOffset = 0;
+	uint64_t NumStrings    = 0;
+	uint64_t StringsOffset = 0;
+	uint64_t PayloadOffset = 0;
+	uint64_t PayloadSize   = 0;
+};
+
+struct ShardRecord {
+	uint64_t PayloadOffset = 0; // Offset from the start of the file
+	uint32_t PayloadSize   = 0; // Size of the stored (possibly compressed) payload
+	uint32_t RawSize       = 0; // Size of the uncompressed RGB image
+	uint32_t Compression   = ShardCompressionNone;
+	uint32_t Video         = 0; // Index into the string table
+	int64_t  FrameTime     = 0; // Frame time in microseconds
+	int32_t  X             = 0; // Rectangle of the patch, inside the source frame
+	int32_t  Y             = 0;
+	int32_t  Width         = 0;
+	int32_t  Height        = 0;
+	uint32_t FirstClass    = 0; // Index of the first of this record's classes
+	uint32_t NumClasses    = 0;
+};
+
+struct ShardClass {
+	uint32_t Class    = 0; // Index into the string table
+	int32_t  Severity = 0;
+};
+#pragma pack(pop)
+
+// ShardWriter writes records into a sequence of shard files inside Dir (shard-000000.shard, shard-000001.shard, etc).
+// A shard is written out once it reaches approximately ShardSize bytes. Add is thread safe, and the expensive
+// part of Add (pixel conversion and compression) runs outside of the writer's lock.
+// Open deletes any shards that were left in Dir by a previous export, because numbering always starts
+// at zero, and a reader must not pick up stale shards after the new ones. If the writer is destroyed
+// without calling Close, then the final partial shard is discarded, so that an export which failed
+// half way doesn't look complete.
+class IMQS_TRAIN_API ShardWriter {
+public:
+	std::string Dir;
+	std::string Prefix    = "shard";
+	size_t      ShardSize = 128 * 1024 * 1024; // Approximate size of every shard
+	bool        Compress  = true;              // Compress payloads with LZ4. Incompressible payloads are always stored raw.
+
+	~ShardWriter();
+
+	// Set Dir, create it if necessary, and delete any existing shards with our Prefix
+	Error Open(const std::string& dir);
+
+	// Add a patch. rgba is the window of the patch, inside the source frame.
+	Error Add(const std::string& videoFilename, int64_t frameTime, const Label& label, const gfx::Image& rgba);
+
+	// Write out the final partial shard
+	Error Close();
+
+	size_t NumShardsWritten() const { return NextShard; }
+
+private:
+	// The contents of one shard, which we accumulate in memory until it's full
+	struct Pending {
+		std::vector<ShardRecord>          Records;
+		std::vector<ShardClass>           Classes;
+		std::vector<std::string>          Strings;
+		ohash::map<std::string, uint32_t> StringIndex;
+		std::string                       Payload; // Concatenated payloads, each padded to 16 bytes
+
+		uint32_t AddString(const std::string& s);
+	};
+
+	std::mutex               Lock;
+	std::unique_ptr<Pending> Cur;
+	size_t                   NextShard = 0;
+
+	Error WriteShard(size_t shardNumber, const Pending& p);
+};
+
+// ShardReader memory maps a shard file. Records, classes and strings can be inspected directly.
+class IMQS_TRAIN_API ShardReader {
+public:
+	Error Open(const std::string& filename);
+	void  Close();
+
+	size_t             NumRecords() const { return (size_t) Header.NumRecords; }
+	const ShardRecord& Record(size_t i) const { return Records[i]; }
+	const ShardClass&  Class(size_t i) const { return Classes[i]; } // i is in the range [Record.FirstClass, Record.FirstClass + Record.NumClasses)
+	std::string        String(size_t i) const { return Strings[i]; }
+	const uint8_t*     Payload(size_t i) const { return File.MemBase() + Records[i].PayloadOffset; } // Raw payload, which may be compressed
+
+	// Decode the RGB image of a record into rgb, which must be at least Record(i).RawSize bytes
+	Error ReadImage(size_t i, void* rgb) const;
+
+private:
+	os::MMapFile             File;
+	ShardHeader              Header;
+	const ShardRecord*       Records = nullptr;
+	const ShardClass*        Classes = nullptr;
+	std::vector<std::string> Strings;
+};
+
+} // namespace train
+} // namespace imqs
@@ -9,4 +9,6 @@
 #endif
 
 #include "Exporter.h"
-#include "LabelIO.h"
\ No newline at end of file
+#include "LabelIO.h"
+#include "LabelStore.h"
+#include "Shard.h"
\ No newline at end of file
@@ -22,6 +22,8 @@ void VideoFile::Initialize() {
 
 VideoFile::VideoFile() {
 	memset(&Pkt, 0, sizeof(Pkt));
+	IndexBuildDone  = false;
+	IndexBuildAbort = false;
 }
 
 VideoFile::~VideoFile() {
@@ -29,6 +31,7 @@ VideoFile::~VideoFile() {
 }
 
 void VideoFile::Close() {
+	StopIndexBuild();
 	FlushCachedFrames();
 
 	av_packet_unref(&Pkt);
@@ -45,6 +48,7 @@ void VideoFile::Close() {
 	SwsDstW        = 0;
 	SwsDstH        = 0;
 	Filename       = "";
+	Index.Clear();
 }
 
 Error VideoFile::OpenFile(std::string filename) {
@@ -68,6 +72,18 @@ Error VideoFile::OpenFile(std::string filename) {
 
 	VideoStream = FmtCtx->streams[VideoStreamIdx];
 
+	if (UseFrameIndex && !Index.LoadSidecar(filename).OK()) {
+		// Build the index in the background, so that we don't stall the first frame. A missing index is
+		// not fatal. We just fall back to the container's seek implementation.
+		Index.Clear();
+		int streamIdx = VideoStreamIdx;
+		IndexBuilder  = std::thread([this, filename, streamIdx] {
+			if (!BuiltIndex.BuildFromFile(filename, streamIdx, &IndexBuildAbort).OK())
+				BuiltIndex.Clear();
+			IndexBuildDone = true;
+		});
+	}
+
 	//av_dump_format(fmt_ctx, 0, src_filename, 0);
 
 	Frame = av_frame_alloc();
@@ -90,6 +106,33 @@ void VideoFile::Info(int& width, int& height, int64_t& durationMicroseconds) {
 	durationMicroseconds = int64_t(GetVideoStreamInfo().DurationSeconds() * 1000000);
 }
 
+void VideoFile::StopIndexBuild() {
+	if (IndexBuilder.joinable()) {
+		IndexBuildAbort = true;
+		IndexBuilder.join();
+	}
+	IndexBuildAbort = false;
+	IndexBuildDone  = false;
+	BuiltIndex.Clear();
+}
+
+// Start using the index, if the background build has finished. This is called before every operation
+// that consults the index, so the index never changes underneath an operation.
+void VideoFile::UpdateIndex() {
+	if (!IndexBuildDone)
+		return;
+	IndexBuilder.join();
+	IndexBuildDone = false;
+	std::swap(Index, BuiltIndex);
+	BuiltIndex.Clear();
+}
+
+void VideoFile::CopyIndexFrom(VideoFile& src) {
+	src.UpdateIndex();
+	if (Index.IsEmpty() && !src.Index.IsEmpty())
+		Index = src.Index;
+}
+
 Error VideoFile::SetOutputResolution(int width, int height) {
 	// We don't need to do anything here, since we are capable of recreating our scaler object
 	// on every frame.
@@ -121,6 +164,12 @@ VideoMetadata VideoFile::Metadata() {
 }
 
 Error VideoFile::SeekToPreviousFrame() {
+	UpdateIndex();
+	if (!Index.IsEmpty()) {
+		int frame = LastIndexedFrameAtOrBefore(LastFramePTS);
+		return SeekToIndexedFrame(std::max(frame - 1, 0), true);
+	}
+
 	auto timePerFrame = av_inv_q(VideoStream->avg_frame_rate);
 	auto t            = av_mul_q({(int) LastFramePTS, 1}, VideoStream->time_base);
 	t                 = av_sub_q(t, timePerFrame);
@@ -140,6 +189,10 @@ Error VideoFile::SeekToPreviousFrame() {
 }
 
 Error VideoFile::SeekToFrame(int64_t frame, unsigned flags) {
+	UpdateIndex();
+	if (!Index.IsEmpty() && frame >= 0 && frame < (int64_t) Index.Frames.size())
+		return SeekToIndexedFrame((int) frame, !!(flags & SeekFlagAny));
+
 	// frame rate = number of frames per second. So to get seconds/frame, we divide by frame rate.
 	auto t = av_div_q({(int) frame, 1}, VideoStream->avg_frame_rate);
 
@@ -166,6 +219,13 @@ Error VideoFile::SeekToSecond(double second, unsigned flags) {
 }
 
 Error VideoFile::SeekToMicrosecond(int64_t microsecond, unsigned flags) {
+	UpdateIndex();
+	if (!Index.IsEmpty()) {
+		int frame = Index.FindFrame(Index.MicrosecondToPts(microsecond));
+		if (frame != -1)
+			return SeekToIndexedFrame(frame, !!(flags & SeekFlagAny));
+	}
+
 	double  ts  = av_q2d(VideoStream->time_base);
 	double  t   = ((double) microsecond / 1000000.0) / ts;
 	int64_t pts = (int64_t) t;
@@ -175,6 +235,68 @@ Error VideoFile::SeekToMicrosecond(int64_t microsecond, unsigned flags) {
 	return Error();
 }
 
+int64_t VideoFile::KeyframeAtOrBefore(int64_t microsecond) {
+	UpdateIndex();
+	int64_t pts = av_rescale_q(microsecond, {1, 1000000}, VideoStream->time_base);
+	if (!Index.IsEmpty()) {
+		int frame = LastIndexedFrameAtOrBefore(pts);
+		if (frame == -1)
+			return -1;
+		return Index.PtsToMicrosecond(Index.Frames[Index.FindKeyframe(frame)].PTS);
+	}
+	int idx = av_index_search_timestamp(VideoStream, pts, AVSEEK_FLAG_BACKWARD);
+	if (idx < 0)
+		return -1;
+	return av_rescale_q(VideoStream->index_entries[idx].timestamp, VideoStream->time_base, {1, 1000000});
+}
+
+Error VideoFile::SeekToKeyframeAtOrBefore(int64_t microsecond) {
+	UpdateIndex();
+	// We seek by PTS here, instead of going through SeekToMicrosecond, so that rounding
+	// of the keyframe time to microseconds can never land us on the frame before the keyframe.
+	int64_t pts = av_rescale_q(microsecond, {1, 1000000}, VideoStream->time_base);
+	if (!Index.IsEmpty()) {
+		int frame = LastIndexedFrameAtOrBefore(pts);
+		if (frame == -1)
+			return Error::Fmt("No keyframe found before %v microseconds", microsecond);
+		return SeekToIndexedFrame(Index.FindKeyframe(frame), true);
+	}
+	int idx = av_index_search_timestamp(VideoStream, pts, AVSEEK_FLAG_BACKWARD);
+	if (idx < 0)
+		return Error::Fmt("No keyframe found before %v microseconds", microsecond);
+	pts   = VideoStream->index_entries[idx].timestamp;
+	int r = av_seek_frame(FmtCtx, VideoStreamIdx, pts, AVSEEK_FLAG_ANY);
+	if (r < 0)
+		return TranslateAvErr(r, "av_seek_frame");
+	avcodec_flush_buffers(VideoDecCtx);
+	LastSeekPTS = pts;
+	return Error();
+}
+
+// Seek to the keyframe from which 'frame' can be decoded. If exact is true, then the next call
+// to DecodeFrameRGBA will discard frames until it reaches 'frame'. Otherwise, the next decoded
+// frame is the keyframe.
+Error VideoFile::SeekToIndexedFrame(int frame, bool exact) {
+	const auto& key = Index.Frames[Index.FindKeyframe(frame)];
+	// Demuxers seek by DTS or by PTS, depending on the container. DTS <= PTS, so seeking backward
+	// to the keyframe's DTS always lands us on or before the keyframe.
+	int r = av_seek_frame(FmtCtx, VideoStreamIdx, key.DTS, AVSEEK_FLAG_BACKWARD);
+	if (r < 0)
+		return TranslateAvErr(r, "av_seek_frame");
+	// Because we flush the codec, DecodeFrameRGBA will never see stale frames from before the seek
+	avcodec_flush_buffers(VideoDecCtx);
+	LastSeekPTS = exact ? Index.Frames[frame].PTS : key.PTS;
+	return Error();
+}
+
+// Returns the index of the last frame with PTS <= pts, or -1 if pts is before the first frame
+int VideoFile::LastIndexedFrameAtOrBefore(int64_t pts) const {
+	int next = pts == INT64_MAX ? -1 : Index.FindFrame(pts + 1);
+	if (next == -1)
+		next = (int) Index.Frames.size();
+	return next - 1;
+}
+
 double VideoFile::LastFrameTimeSeconds() const {
 	return PtsToSeconds(LastFramePTS);
 }
@@ -200,15 +322,30 @@ int64_t VideoFile::LastFrameAVTime() const {
 */
 
 Error VideoFile::DecodeFrameRGBA(int width, int height, void* buf, int stride, double* timeSeconds) {
+	auto err = DecodeFrame(timeSeconds);
+	if (!err.OK())
+		return err;
+
+	if (width == 0 || height == 0 || buf == nullptr) {
+		// caller is not interested in actual frame pixels
+		return Error();
+	}
+
+	return ConvertFrameRGBA(width, height, buf, stride);
+}
+
+Error VideoFile::DecodeFrame(double* timeSeconds) {
 	// Allow for multiple attempts, if we have just performed a seek.
 	// After performing a seek, the codec will often emit what looks like a previously buffered
 	// frame. If the first frame that we receive is not the one that we seeked to, then
 	// we throw that frame away.
 	// NOTE: This can be very expensive, if you are far ahead of your last keyframe.
 	// However, sometimes that's what the user wants.
+	// There is no cap on the number of attempts, because giving up early would return a frame that
+	// is not the one that was asked for. We always stop once we reach (or pass) the seek target, or at EOF.
 	int wasBehind = 0;
 
-	for (int attempt = 0; attempt < 200; attempt++) {
+	for (int attempt = 0; true; attempt++) {
 		bool haveFrame = false;
 		int  nReceive  = 0;
 		while (!haveFrame) {
@@ -281,10 +418,12 @@ Error VideoFile::DecodeFrameRGBA(int width, int height, void* buf, int stride, d
 	if (timeSeconds)
 		*timeSeconds = LastFrameTimeSeconds();
 
-	if (width == 0 || height == 0 || buf == nullptr) {
-		// caller is not interested in actual frame pixels
-		return Error();
-	}
+	return Error();
+}
+
+Error VideoFile::ConvertFrameRGBA(int width, int height, void* buf, int stride) {
+	if (Frame == nullptr || Frame->width == 0)
+		return Error("No frame has been decoded");
 
 	if (SwsCtx && ((SwsDstW != width) || (SwsDstH != height))) {
 		sws_freeContext(SwsCtx);
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "IVideo.h"
+#include "FrameIndex.h"
 
 namespace imqs {
 namespace video {
@@ -20,8 +21,16 @@ struct IMQS_VIDEO_API VideoMetadata {
 	time::Time CreationTime;
 };
 
+// If UseFrameIndex is true (the default), then OpenFile loads a FrameIndex for the video,
+// and all seek operations use it to land exactly on the requested frame, instead of relying on the
+// container's seek implementation, and then discarding frames until we hit the target.
+// If there is no valid sidecar file for the index, then OpenFile starts building the index on a
+// background thread, and returns immediately. Seeks use the container's seek implementation until
+// the index is ready.
 class IMQS_VIDEO_API VideoFile : public IVideo {
 public:
+	bool UseFrameIndex = true; // Must be set before OpenFile
+
 	static void Initialize();
 
 	VideoFile();
@@ -38,16 +47,25 @@ public:
 	Error           SeekToSecond(double second, unsigned flags = SeekFlagNone);
 	double          LastFrameTimeSeconds() const;
 	int64_t         LastFrameTimeMicrosecond() const;
+	int64_t         KeyframeAtOrBefore(int64_t microsecond);       // Returns the time (in microseconds) of the last keyframe at or before the given time, or -1 if the container has no index
+	Error           SeekToKeyframeAtOrBefore(int64_t microsecond); // Seek to the keyframe returned by KeyframeAtOrBefore, so that the next decoded frame is that keyframe
 
 	// IVideo
 	Error OpenFile(std::string filename) override;
 	void  Info(int& width, int& height, int64_t& durationMicroseconds) override;
 	Error SetOutputResolution(int width, int height) override;
 	Error DecodeFrameRGBA(int width, int height, void* buf, int stride, double* timeSeconds = nullptr) override;
+	Error DecodeFrame(double* timeSeconds = nullptr) override;
+	Error ConvertFrameRGBA(int width, int height, void* buf, int stride) override;
 	Error SeekToMicrosecond(int64_t microsecond, unsigned flags = SeekFlagNone) override;
 
 	void Dimensions(int& width, int& height) const;
 
+	// Adopt a copy of src's frame index, if we have none, and src has finished building its index.
+	// This is for extra decoders on the same video, which are opened with UseFrameIndex = false,
+	// so that they don't each scan the whole file to build an identical index.
+	void CopyIndexFrom(VideoFile& src);
+
 	int Width() const { return VideoDecCtx->width; }
 	int Height() const { return VideoDecCtx->height; }
 
@@ -64,11 +82,21 @@ private:
 	int              SwsDstH      = 0;
 	int64_t          LastFramePTS = 0;  // PTS = presentation time stamp (ie time when frame should be shown to user)
 	int64_t          LastSeekPTS  = -1; // Set to a value other than -1, if we have just executed a seek operation
+	FrameIndex       Index;             // Empty if UseFrameIndex is false, or if the index is not yet built (or we failed to build it)
+
+	std::thread       IndexBuilder;    // Builds BuiltIndex, if there was no sidecar file
+	std::atomic<bool> IndexBuildDone;  // BuiltIndex is ready to be moved into Index
+	std::atomic<bool> IndexBuildAbort; // Cancel IndexBuilder, because we're closing
+	FrameIndex        BuiltIndex;      // Only touched by IndexBuilder, until IndexBuildDone is set
 
 	static Error TranslateErr(int ret, const char* whileBusyWith = nullptr);
 	static Error OpenCodecContext(AVFormatContext* fmt_ctx, AVMediaType type, int& stream_idx, AVCodecContext*& dec_ctx);
 	Error        RecvFrame();
 	void         FlushCachedFrames();
+	void         StopIndexBuild();
+	void         UpdateIndex();
+	Error        SeekToIndexedFrame(int frame, bool exact);
+	int          LastIndexedFrameAtOrBefore(int64_t pts) const;
 	double       PtsToSeconds(int64_t pts) const;
 };
 
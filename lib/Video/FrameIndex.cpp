@@ -0,0 +1,259 @@
+#include "pch.h"
+#include "FrameIndex.h"
+#include "IVideo.h"
+
+using namespace std;
+
+namespace imqs {
+namespace video {
+
+#pragma pack(push)
+#pragma pack(4)
+struct FrameIndexHeader {
+	enum Constants {
+		CurrentVersion = 1,
+	};
+	uint32_t Magic       = 0x58444946; // "FIDX"
+	uint32_t Version     = CurrentVersion;
+	uint64_t VideoSize   = 0; // Size of the video file, for validation
+	int64_t  VideoMTime  = 0; // Modification time of the video file (unix nanoseconds), for validation
+	int32_t  TimeBaseNum = 0;
+	int32_t  TimeBaseDen = 0;
+	uint64_t NumFrames   = 0;
+};
+
+struct FrameIndexRecord {
+	int64_t  PTS;
+	int64_t  DTS;
+	int64_t  Pos;
+	uint32_t Flags;
+};
+#pragma pack(pop)
+static_assert(sizeof(FrameIndexHeader) == 40, "FrameIndexHeader size expected to be 40");
+static_assert(sizeof(FrameIndexRecord) == 28, "FrameIndexRecord size expected to be 28");
+
+std::string FrameIndex::SidecarFilename(const std::string& videoFilename) {
+	return videoFilename + ".frameindex";
+}
+
+void FrameIndex::Clear() {
+	TimeBase = {0, 1};
+	Frames.clear();
+}
+
+Error FrameIndex::LoadSidecar(const std::string& videoFilename) {
+	os::FileAttributes attribs;
+	auto               err = os::Stat(videoFilename, attribs);
+	if (!err.OK())
+		return err;
+	return Load(SidecarFilename(videoFilename), attribs);
+}
+
+static int FrameIndexInterrupt(void* abort) {
+	return ((const std::atomic<bool>*) abort)->load() ? 1 : 0;
+}
+
+Error FrameIndex::BuildFromFile(const std::string& videoFilename, int streamIdx, const std::atomic<bool>* abort) {
+	Clear();
+	os::FileAttributes attribs;
+	auto               err = os::Stat(videoFilename, attribs);
+	if (!err.OK())
+		return err;
+
+	AVFormatContext* fmtCtx = avformat_alloc_context();
+	if (!fmtCtx)
+		return Error("Out of memory allocating format context");
+	if (abort) {
+		// ffmpeg polls this during blocking IO, and fails the read with AVERROR_EXIT
+		fmtCtx->interrupt_callback.callback = FrameIndexInterrupt;
+		fmtCtx->interrupt_callback.opaque   = (void*) abort;
+	}
+	// avformat_open_input frees fmtCtx on failure
+	int r = avformat_open_input(&fmtCtx, videoFilename.c_str(), nullptr, nullptr);
+	if (r < 0)
+		return IVideo::TranslateAvErr(r, "avformat_open_input");
+	r = avformat_find_stream_info(fmtCtx, nullptr);
+	if (r < 0)
+		err = IVideo::TranslateAvErr(r, "avformat_find_stream_info");
+	else if (streamIdx < 0 || streamIdx >= (int) fmtCtx->nb_streams)
+		err = Error::Fmt("Invalid video stream %v", streamIdx);
+	else
+		err = Build(fmtCtx, streamIdx);
+	avformat_close_input(&fmtCtx);
+	if (!err.OK())
+		return err;
+
+	// Ignore failure to write the sidecar. We'll just rebuild the index next time.
+	Save(SidecarFilename(videoFilename), attribs);
+	return Error();
+}
+
+Error FrameIndex::Build(AVFormatContext* fmtCtx, int streamIdx) {
+	Clear();
+	AVStream* st = fmtCtx->streams[streamIdx];
+	TimeBase     = st->time_base;
+
+	// Don't bother demuxing the other streams
+	vector<AVDiscard> discard;
+	for (unsigned i = 0; i < fmtCtx->nb_streams; i++) {
+		discard.push_back(fmtCtx->streams[i]->discard);
+		if ((int) i != streamIdx)
+			fmtCtx->streams[i]->discard = AVDISCARD_ALL;
+	}
+
+	int r = av_seek_frame(fmtCtx, streamIdx, 0, AVSEEK_FLAG_BACKWARD);
+	if (r < 0)
+		r = av_seek_frame(fmtCtx, streamIdx, 0, AVSEEK_FLAG_BYTE);
+
+	Error err;
+	if (r >= 0) {
+		AVPacket pkt;
+		av_init_packet(&pkt);
+		pkt.data = nullptr;
+		pkt.size = 0;
+		while (true) {
+			r = av_read_frame(fmtCtx, &pkt);
+			if (r == AVERROR_EOF)
+				break;
+			if (r < 0) {
+				err = IVideo::TranslateAvErr(r, "av_read_frame");
+				break;
+			}
+			if (pkt.stream_index == streamIdx) {
+				Entry e;
+				e.DTS   = pkt.dts;
+				e.PTS   = pkt.pts != AV_NOPTS_VALUE ? pkt.pts : pkt.dts;
+				e.Pos   = pkt.pos;
+				e.Flags = !!(pkt.flags & AV_PKT_FLAG_KEY) ? FlagKeyframe : 0;
+				if (e.PTS != AV_NOPTS_VALUE)
+					Frames.push_back(e);
+			}
+			av_packet_unref(&pkt);
+		}
+	} else {
+		err = IVideo::TranslateAvErr(r, "av_seek_frame");
+	}
+
+	for (unsigned i = 0; i < fmtCtx->nb_streams; i++)
+		fmtCtx->streams[i]->discard = discard[i];
+
+	if (!err.OK()) {
+		Clear();
+		return err;
+	}
+
+	// Packets arrive in decode order. With B-frames, this is not the same as presentation order.
+	sort(Frames.begin(), Frames.end(), [](const Entry& a, const Entry& b) { return a.PTS < b.PTS; });
+
+	if (Frames.size() == 0 || !Frames[0].IsKeyframe()) {
+		// This can happen with open GOPs, where leading B-frames have a PTS before the first keyframe.
+		// Such frames are not decodable on their own anyway, so we mark the first keyframe's
+		// predecessors as undecodable by simply dropping them.
+		size_t firstKey = 0;
+		while (firstKey < Frames.size() && !Frames[firstKey].IsKeyframe())
+			firstKey++;
+		Frames.erase(Frames.begin(), Frames.begin() + firstKey);
+	}
+
+	if (Frames.size() == 0)
+		return Error("No keyframes found in video stream");
+
+	return Error();
+}
+
+Error FrameIndex::Save(const std::string& filename, const os::FileAttributes& video) const {
+	FrameIndexHeader head;
+	head.VideoSize   = video.Size;
+	head.VideoMTime  = video.TimeModify.UnixNano();
+	head.TimeBaseNum = TimeBase.num;
+	head.TimeBaseDen = TimeBase.den;
+	head.NumFrames   = Frames.size();
+
+	string buf;
+	buf.resize(sizeof(head) + Frames.size() * sizeof(FrameIndexRecord));
+	memcpy(&buf[0], &head, sizeof(head));
+	auto rec = (FrameIndexRecord*) (&buf[0] + sizeof(head));
+	for (const auto& f : Frames) {
+		rec->PTS   = f.PTS;
+		rec->DTS   = f.DTS;
+		rec->Pos   = f.Pos;
+		rec->Flags = f.Flags;
+		rec++;
+	}
+
+	// Write to a temporary file and rename, so that a concurrent reader never sees a partial index.
+	// The temporary name is unique, because more than one process may be indexing the same video.
+	uint64_t nonce = 0;
+	crypto::RandomBytes(&nonce, sizeof(nonce));
+	string tmp = tsf::fmt("%v.%016x.tmp", filename, nonce);
+	auto   err = os::WriteWholeFile(tmp, buf);
+	if (!err.OK())
+		return err;
+	err = os::Rename(tmp, filename);
+	if (!err.OK())
+		os::Remove(tmp);
+	return err;
+}
+
+Error FrameIndex::Load(const std::string& filename, const os::FileAttributes& video) {
+	Clear();
+	string buf;
+	auto   err = os::ReadWholeFile(filename, buf);
+	if (!err.OK())
+		return err;
+
+	FrameIndexHeader head;
+	if (buf.size() < sizeof(head))
+		return Error("Frame index is truncated");
+	memcpy(&head, buf.data(), sizeof(head));
+	FrameIndexHeader expect;
+	if (head.Magic != expect.Magic || head.Version != expect.Version)
+		return Error("Frame index has wrong magic or version");
+	if (head.VideoSize != video.Size || head.VideoMTime != video.TimeModify.UnixNano())
+		return Error("Frame index is stale");
+	if (buf.size() != sizeof(head) + head.NumFrames * sizeof(FrameIndexRecord))
+		return Error("Frame index is truncated");
+	if (head.NumFrames == 0 || head.TimeBaseDen == 0)
+		return Error("Frame index is empty");
+
+	TimeBase = {head.TimeBaseNum, head.TimeBaseDen};
+	Frames.resize(head.NumFrames);
+	auto rec = (const FrameIndexRecord*) (buf.data() + sizeof(head));
+	for (auto& f : Frames) {
+		f.PTS   = rec->PTS;
+		f.DTS   = rec->DTS;
+		f.Pos   = rec->Pos;
+		f.Flags = rec->Flags;
+		rec++;
+	}
+	return Error();
+}
+
+int64_t FrameIndex::PtsToMicrosecond(int64_t pts) const {
+	return (int64_t)((double) pts * av_q2d(TimeBase) * 1000000.0);
+}
+
+int64_t FrameIndex::MicrosecondToPts(int64_t microsecond) const {
+	return (int64_t)(((double) microsecond / 1000000.0) / av_q2d(TimeBase));
+}
+
+int FrameIndex::FindFrame(int64_t pts) const {
+	auto it = lower_bound(Frames.begin(), Frames.end(), pts, [](const Entry& e, int64_t pts) { return e.PTS < pts; });
+	if (it == Frames.end())
+		return -1;
+	return (int) (it - Frames.begin());
+}
+
+int FrameIndex::FindKeyframe(int frame) const {
+	// We walk back in presentation order. This gives us the keyframe whose GOP contains 'frame'.
+	// For leading B-frames of an open GOP, that is the previous GOP's keyframe, which is what
+	// we want, because those B-frames reference the previous GOP.
+	for (int i = frame; i >= 0; i--) {
+		if (Frames[i].IsKeyframe())
+			return i;
+	}
+	return 0;
+}
+
+} // namespace video
+} // namespace imqs
@@ -0,0 +1,56 @@
+#pragma once
+
+namespace imqs {
+namespace video {
+
+// FrameIndex is a list of every frame in a video stream, sorted by presentation time.
+// It allows frame-accurate seeking, without relying on the container's seek implementation.
+// Building the index requires a demux pass over the entire file (no decoding), so we persist
+// it as a sidecar file next to the video, and only rebuild it when the video's size or
+// modification time changes. For a long video the demux pass can take minutes, which is why
+// VideoFile builds the index on a background thread.
+class IMQS_VIDEO_API FrameIndex {
+public:
+	enum EntryFlags {
+		FlagKeyframe = 1,
+	};
+
+	struct Entry {
+		int64_t  PTS   = 0;
+		int64_t  DTS   = 0;
+		int64_t  Pos   = 0; // Byte offset of the packet in the file (-1 if unknown)
+		uint32_t Flags = 0;
+
+		bool IsKeyframe() const { return !!(Flags & FlagKeyframe); }
+	};
+
+	AVRational         TimeBase = {0, 1}; // Time base of PTS and DTS
+	std::vector<Entry> Frames;            // Sorted by PTS
+
+	static std::string SidecarFilename(const std::string& videoFilename);
+
+	void Clear();
+	bool IsEmpty() const { return Frames.size() == 0; }
+
+	// Load the sidecar file, if it is still valid for the video
+	Error LoadSidecar(const std::string& videoFilename);
+
+	// Open the video with a demuxer of our own, build the index, and try to save the sidecar. Because we
+	// don't share a demuxer with the caller, this can run on a background thread while the video is being
+	// decoded. Setting *abort cancels the build. Failure to save the sidecar (eg read-only media) is not an error.
+	Error BuildFromFile(const std::string& videoFilename, int streamIdx, const std::atomic<bool>* abort = nullptr);
+
+	// Demux every packet of the video stream. The stream position is undefined afterwards.
+	Error Build(AVFormatContext* fmtCtx, int streamIdx);
+
+	Error Save(const std::string& filename, const os::FileAttributes& video) const;
+	Error Load(const std::string& filename, const os::FileAttributes& video);
+
+	int64_t PtsToMicrosecond(int64_t pts) const;         // Same rounding as VideoFile::LastFrameTimeMicrosecond
+	int64_t MicrosecondToPts(int64_t microsecond) const; // Same rounding as VideoFile::SeekToMicrosecond
+	int     FindFrame(int64_t pts) const;                // Returns the index of the first frame with PTS >= pts, or -1 if there is no such frame
+	int     FindKeyframe(int frame) const;               // Returns the index of the keyframe from which we must start decoding, in order to reach 'frame'
+};
+
+} // namespace video
+} // namespace imqs
@@ -18,6 +18,10 @@ enum SeekFlags {
 extern StaticError ErrNeedMoreData; // Codec needs more data before it can deliver a frame/audio
 
 // SetOutputResolution was built for the GPU decoder (NVVideo), but it's not necessary for the CPU decoder (ie the VideoFile class).
+// DecodeFrame advances to the next frame without converting it to RGBA. If you decide that you want the
+// pixels of that frame, then call ConvertFrameRGBA. This is much faster than DecodeFrameRGBA when you are
+// walking forward over many frames, in search of a few specific ones.
+// DecodeFrameRGBA is equivalent to DecodeFrame followed by ConvertFrameRGBA.
 class IMQS_VIDEO_API IVideo {
 public:
 	virtual ~IVideo() {}
@@ -25,6 +29,8 @@ public:
 	virtual void  Info(int& width, int& height, int64_t& durationMicroseconds)                                 = 0;
 	virtual Error SetOutputResolution(int width, int height)                                                   = 0;
 	virtual Error DecodeFrameRGBA(int width, int height, void* buf, int stride, double* timeSeconds = nullptr) = 0;
+	virtual Error DecodeFrame(double* timeSeconds = nullptr)                                                   = 0;
+	virtual Error ConvertFrameRGBA(int width, int height, void* buf, int stride)                               = 0; // Convert the frame most recently returned by DecodeFrame
 	virtual Error SeekToMicrosecond(int64_t microsecond, unsigned flags = SeekFlagNone)                        = 0;
 
 	static Error TranslateAvErr(int ret, const char* whileBusyWith = nullptr);
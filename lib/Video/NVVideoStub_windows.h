@@ -13,6 +13,12 @@ public:
 	Error DecodeFrameRGBA(int width, int height, void* buf, int stride, double* timeSeconds = nullptr) override {
 		return Error("NVVideo not available on Windows");
 	}
+	Error DecodeFrame(double* timeSeconds = nullptr) override {
+		return Error("NVVideo not available on Windows");
+	}
+	Error ConvertFrameRGBA(int width, int height, void* buf, int stride) override {
+		return Error("NVVideo not available on Windows");
+	}
 	Error SeekToMicrosecond(int64_t microsecond, unsigned flags = SeekFlagNone) override {
 		return Error("NVVideo not available on Windows");
 	}
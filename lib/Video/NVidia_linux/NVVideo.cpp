@@ -13,7 +13,9 @@ using namespace std;
 namespace imqs {
 namespace video {
 
-CUcontext CUCtx = nullptr;
+CUcontext             CUCtx = nullptr;
+static std::once_flag CUCtxOnce;
+static Error          CUCtxErr; // Result of the lazy Initialize() in OpenFile
 
 NVVideo::NVVideo() {
 	HostHead     = 0;
@@ -57,11 +59,14 @@ void NVVideo::Shutdown() {
 
 Error NVVideo::OpenFile(std::string filename) {
 	Close();
-	if (!CUCtx) {
-		auto err = Initialize();
-		if (!err.OK())
-			return err;
-	}
+	// Several threads can open their first video at the same time (eg BulkExporter's decoders), so
+	// the lazy initialization must run exactly once.
+	std::call_once(CUCtxOnce, []() {
+		if (!CUCtx)
+			CUCtxErr = Initialize();
+	});
+	if (!CUCtxErr.OK())
+		return CUCtxErr;
 	auto err = Demuxer.Open(filename.c_str());
 	if (!err.OK())
 		return err;
@@ -135,6 +140,8 @@ void NVVideo::Close() {
 	HostTail     = 0;
 	DeviceHead   = 0;
 	DeviceTail   = 0;
+
+	HoldingHostFrame = false;
 	delete SemHostFramesFree;
 	SemHostFramesFree = nullptr;
 	delete SemHostFramesReady;
@@ -183,12 +190,26 @@ Error NVVideo::DecodeFramePrelude() {
 }
 
 Error NVVideo::DecodeFrameRGBA(int width, int height, void* buf, int stride, double* timeSeconds) {
+	auto err = DecodeFrame(timeSeconds);
+	if (!err.OK())
+		return err;
+	err = ConvertFrameRGBA(width, height, buf, stride);
+	ReleaseHostFrame();
+	return err;
+}
+
+// The GPU has already converted the frame to RGBA by the time that we see it, so the work that we
+// save here is the copy out of pinned memory. The frame's host buffer slot is held until the next
+// call to DecodeFrame, so that ConvertFrameRGBA can still read from it.
+Error NVVideo::DecodeFrame(double* timeSeconds) {
 	IMQS_ASSERT(OutputMode == OutputCPU);
 
 	auto err = DecodeFramePrelude();
 	if (!err.OK())
 		return err;
 
+	ReleaseHostFrame();
+
 	//if (DecodeState == DecodeStateFinished && HostTail == HostHead) {
 	//	// The decoder has consumed all frames of the video, and we've consumed them all
 	//	return ErrEOF;
@@ -201,9 +222,23 @@ Error NVVideo::DecodeFrameRGBA(int width, int height, void* buf, int stride, dou
 		return ErrEOF;
 	}
 
+	IMQS_ASSERT(HostTail < HostHead);
+
+	HostFrame& f = HostFrames[HostTail % HostBufferSize];
+	if (timeSeconds)
+		*timeSeconds = Demuxer.PtsToSeconds(f.Pts);
+	LastObservedPTS  = f.Pts;
+	HoldingHostFrame = true;
+
+	return Error();
+}
+
+Error NVVideo::ConvertFrameRGBA(int width, int height, void* buf, int stride) {
+	if (!HoldingHostFrame)
+		return Error("No frame has been decoded");
+
 	IMQS_ASSERT(OutWidth() == width);
 	IMQS_ASSERT(OutHeight() == height);
-	IMQS_ASSERT(HostTail < HostHead);
 
 	HostFrame& f         = HostFrames[HostTail % HostBufferSize];
 	auto       lineBytes = f.Img.BytesPerLine();
@@ -213,14 +248,15 @@ Error NVVideo::DecodeFrameRGBA(int width, int height, void* buf, int stride, dou
 	for (int y = 0; y < height; y++)
 		memcpy(dst + y * stride, src + y * srcStride, lineBytes);
 
-	if (timeSeconds)
-		*timeSeconds = Demuxer.PtsToSeconds(f.Pts);
-	LastObservedPTS = f.Pts;
+	return Error();
+}
 
+void NVVideo::ReleaseHostFrame() {
+	if (!HoldingHostFrame)
+		return;
+	HoldingHostFrame = false;
 	HostTail++;
 	SemHostFramesFree->signal();
-
-	return Error();
 }
 
 Error NVVideo::DecodeFrameRGBA_GPU(CudaFrame& frame) {
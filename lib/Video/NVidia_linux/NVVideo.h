@@ -70,6 +70,8 @@ public:
 	void  Info(int& width, int& height, int64_t& durationMicroseconds) override;
 	Error SetOutputResolution(int width, int height) override;
 	Error DecodeFrameRGBA(int width, int height, void* buf, int stride, double* timeSeconds = nullptr) override;
+	Error DecodeFrame(double* timeSeconds = nullptr) override;
+	Error ConvertFrameRGBA(int width, int height, void* buf, int stride) override;
 	Error SeekToMicrosecond(int64_t microsecond, unsigned flags = SeekFlagNone) override;
 
 	// Returns a pointer to CUDA memory, containing the next decoded RGBA video frame (and it's stride)
@@ -109,6 +111,7 @@ private:
 	std::vector<HostFrame> HostFrames;
 	std::atomic<int>       HostHead;
 	std::atomic<int>       HostTail;
+	bool                   HoldingHostFrame = false; // The frame at HostTail was returned by DecodeFrame, and is kept alive for ConvertFrameRGBA
 	Semaphore*             SemHostFramesReady = nullptr; // Number of occupied slots in HostFrames
 	Semaphore*             SemHostFramesFree  = nullptr; // Number of available slots in HostFrames
 
@@ -119,6 +122,7 @@ private:
 	Error CloseAndReopen(bool seekToLastPTS);
 	Error AllocResizeBuffer();
 	Error DecodeFramePrelude();
+	void  ReleaseHostFrame();
 	Error InitBuffers();
 	void  DecodeThreadFunc();
 };
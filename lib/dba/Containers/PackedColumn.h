@@ -31,9 +31,11 @@ public:
 	bool   IsAllNull() const;                                    // Returns true if all entries are null
 	bool   GrowTo(size_t size);                                  // Add null values until size is greater than or equal to specified size. Returns false if out of memory.
 
-	dba::Type Type() const { return _Type; }
-	size_t    Size() const { return _IsNull.Size(); }
-	bool      IsNull(size_t i) const { return _IsNull[i]; }
+	dba::Type        Type() const { return _Type; }
+	size_t           Size() const { return _IsNull.Size(); }
+	bool             IsNull(size_t i) const { return _IsNull[i]; }
+	size_t           CountNulls() const { return _IsNull.CountOnes(); }
+	const BitVector& NullMask() const { return _IsNull; } // Bit i is set if value i is null. Use this to combine or scan null masks a word at a time.
 
 private:
 	dba::Type _Type            = Type::Null;
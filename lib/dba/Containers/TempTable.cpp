@@ -144,6 +144,16 @@ Error TempTable::IntersectWith(const std::string& localField, TempTable& foreign
 	IMQS_ASSERT(localFieldIndex != -1);
 	IMQS_ASSERT(foreignFieldIndex != -1);
 
+	// A null never matches, so if either column is entirely null, then nothing survives
+	const auto& localCol   = Columns[localFieldIndex];
+	const auto& foreignCol = foreign.Columns[foreignFieldIndex];
+	if (localCol.CountNulls() == localCol.Size() || foreignCol.CountNulls() == foreignCol.Size()) {
+		Order.clear();
+		return Error();
+	}
+	const BitVector& localNulls   = localCol.NullMask();
+	const BitVector& foreignNulls = foreignCol.NullMask();
+
 	// Build a hash table on the entries in foreignField
 	AttribSet fSet;
 	// We do a little trick here, to avoid having to make copies of the attribute internals - specifically
@@ -155,20 +165,25 @@ Error TempTable::IntersectWith(const std::string& localField, TempTable& foreign
 	if (!fList)
 		return Error::Fmt("Out of memory allocating attributes for hash table for TempTable.IntersectWith");
 
+	size_t nf = 0;
 	for (size_t i = 0; i < foreign.Size(); i++) {
+		if (foreignNulls[foreign.Order[i]])
+			continue;
 		Attrib tmp;
 		foreign.GetDeepByIndex(foreignFieldIndex, i, tmp);
-		memcpy(&fList[i], &tmp, sizeof(Attrib));
+		memcpy(&fList[nf++], &tmp, sizeof(Attrib));
 	}
-	for (size_t i = 0; i < foreign.Size(); i++)
+	for (size_t i = 0; i < nf; i++)
 		fSet.InsertNoCopy(&fList[i]);
 
 	// Iterate over our records, and reject any that aren't present in the foreign table
 	decltype(Order) newOrder;
 	for (size_t i = 0; i < Size(); i++) {
+		if (localNulls[Order[i]])
+			continue;
 		Attrib tmp;
 		GetDeepByIndex(localFieldIndex, i, tmp);
-		if (tmp.IsNull() || !fSet.Contains(tmp))
+		if (!fSet.Contains(tmp))
 			continue;
 		newOrder.push_back((TIndex) i);
 	}
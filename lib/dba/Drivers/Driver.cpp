@@ -27,6 +27,9 @@ DriverStmt::~DriverStmt() {
 	DCon->DecrementRefCount(this, "DriverStmt");
 }
 
+void DriverStmt::Reset() {
+}
+
 void DriverStmt::Initialize(const char* sql) {
 	SQL = sql;
 	std::string parseError;
@@ -39,6 +42,8 @@ DriverConn::DriverConn() {
 }
 
 DriverConn::~DriverConn() {
+	// The driver should already have done this, before closing its connection
+	ClearStmtCache();
 }
 
 void DriverConn::DecrementFailAfter() {
@@ -46,6 +51,62 @@ void DriverConn::DecrementFailAfter() {
 		FailAfter--;
 }
 
+DriverStmt* DriverConn::TakeCachedStmt(const char* sql) {
+	if (!CacheStmts)
+		return nullptr;
+	auto key    = std::string(sql);
+	auto cached = StmtCache.getp(key);
+	if (cached == nullptr)
+		return nullptr;
+	auto stmt = cached->Stmt;
+	StmtCache.erase(key);
+	// The statement owns a reference again, for as long as it is out of the cache
+	IncrementRefCount(stmt, "DriverStmt");
+	return stmt;
+}
+
+void DriverConn::ReturnCachedStmt(DriverStmt* stmt) {
+	// If the same SQL was running concurrently on another Rows object, then keep whichever statement comes back first
+	if (!CacheStmts || MaxCachedStmts == 0 || StmtCache.contains(stmt->SQL)) {
+		delete stmt;
+		return;
+	}
+	if (StmtCache.size() >= MaxCachedStmts) {
+		// Evict the least recently used statement. The cache is small, so a linear scan is cheaper than
+		// maintaining a list, and much cheaper than the Prepare that a cache miss costs.
+		const std::string* oldest     = nullptr;
+		uint64_t           oldestUsed = UINT64_MAX;
+		for (const auto& p : StmtCache) {
+			if (p.second.LastUsed < oldestUsed) {
+				oldest     = &p.first;
+				oldestUsed = p.second.LastUsed;
+			}
+		}
+		std::string key = *oldest;
+		DeleteCachedStmt(StmtCache.get(key).Stmt);
+		StmtCache.erase(key);
+	}
+	stmt->Reset();
+	CachedStmt c;
+	c.Stmt     = stmt;
+	c.LastUsed = ++StmtClock;
+	StmtCache.insert(stmt->SQL, c);
+	DecrementRefCount(stmt, "DriverStmt");
+}
+
+void DriverConn::ClearStmtCache() {
+	for (auto& p : StmtCache)
+		DeleteCachedStmt(p.second.Stmt);
+	StmtCache.clear();
+}
+
+// Delete an idle statement that is in the cache. The caller must remove it from StmtCache.
+void DriverConn::DeleteCachedStmt(DriverStmt* stmt) {
+	// Restore the reference that the destructor will release
+	IncrementRefCount(stmt, "DriverStmt");
+	delete stmt;
+}
+
 Error DriverConn::Exec(const char* sql, size_t nParams, const Attrib** params, DriverRows*& rowsOut) {
 	return ErrUnsupported;
 }
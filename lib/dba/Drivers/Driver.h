@@ -17,6 +17,7 @@ class Driver;
 class DriverStmt;
 class Conn;
 class ResultSink;
+class Rows;
 class Allocator;
 
 // Information about a column that is returned from a SELECT statement
@@ -43,12 +44,15 @@ protected:
 // Low level prepared statement
 class IMQS_DBA_API DriverStmt {
 public:
+	friend class Rows;
+
 	std::string              SQL;           // The SQL string of this statement
 	const sqlparser::SqlAST* AST = nullptr; // Parsed AST of SQL (if our parser was able to parse the statement)
 
 	DriverStmt(DriverConn* dcon);
 	virtual ~DriverStmt();
 	virtual Error Exec(size_t nParams, const Attrib** params, DriverRows*& rowsOut) = 0;
+	virtual void  Reset(); // Release whatever the most recent Exec is holding onto, so that the statement can sit idle in the statement cache. Default does nothing.
 
 	void Initialize(const char* sql);
 
@@ -90,6 +94,15 @@ public:
 	// This is used to implement assertions that verify that you're using transactions correctly.
 	bool IsTxBusy = false;
 
+	// Prepared statement cache, used by Tx::Query, and keyed by SQL text. A driver opts in by setting CacheStmts.
+	// A statement is taken out of the cache while a Rows object is iterating over it, so two queries never
+	// share a statement. Idle statements in the cache do not hold a reference to the connection.
+	// When the cache is full, a returned statement replaces the least recently used one, so that a burst of
+	// one-off statements can't permanently lock the hot statements out of the cache.
+	// A driver that enables the cache must call ClearStmtCache() before closing its underlying connection.
+	bool   CacheStmts     = false;
+	size_t MaxCachedStmts = 64;
+
 	DriverConn();
 	virtual ~DriverConn();
 	virtual Error Prepare(const char* sql, size_t nParams, const Type* paramTypes, DriverStmt*& stmt) = 0;
@@ -111,7 +124,20 @@ public:
 	void IncrementRefCount(void* caller, const char* callerName);
 	void DecrementRefCount(void* caller, const char* callerName);
 
+	DriverStmt* TakeCachedStmt(const char* sql);    // Returns null if there is no idle statement for sql
+	void        ReturnCachedStmt(DriverStmt* stmt); // Reset the statement, and put it back into the cache (evicting the least recently used statement, if the cache is full)
+	void        ClearStmtCache();
+
 private:
+	struct CachedStmt {
+		DriverStmt* Stmt     = nullptr;
+		uint64_t    LastUsed = 0; // Value of StmtClock when the statement was returned to the cache
+	};
+	ohash::map<std::string, CachedStmt> StmtCache;
+	uint64_t                            StmtClock = 0;
+
+	void DeleteCachedStmt(DriverStmt* stmt);
+
 	// The following two are only used when IMQS_DEBUG_REF_COUNT is defined inside Driver.cpp
 	std::mutex               RefCountLogLock;
 	std::vector<std::string> RefCountLog;
@@ -265,6 +265,15 @@ Error SqliteStmt::Exec(size_t nParams, const Attrib** params, DriverRows*& rowsO
 	}
 }
 
+void SqliteStmt::Reset() {
+	// Release any read lock held by a partially iterated result set, and drop references to the caller's parameter values
+	if (ValuesBound) {
+		sqlite3_reset(Stmt);
+		sqlite3_clear_bindings(Stmt);
+		ValuesBound = false;
+	}
+}
+
 SqliteConn* SqliteStmt::DBConn() {
 	return static_cast<SqliteConn*>(DCon);
 }
@@ -322,6 +331,10 @@ void SqliteDialect::TruncateTable(SqlStr& s, const std::string& table, bool rese
 /////////////////////////////////////////////////////////////////////////////////////////////////////
 /////////////////////////////////////////////////////////////////////////////////////////////////////
 
+SqliteConn::SqliteConn() {
+	CacheStmts = true;
+}
+
 SqliteConn::~SqliteConn() {
 	Close();
 }
@@ -369,6 +382,8 @@ Error SqliteConn::Connect(const ConnDesc& desc) {
 }
 
 void SqliteConn::Close() {
+	// sqlite3_close fails if there are any unfinalized statements
+	ClearStmtCache();
 	if (HDB != nullptr) {
 		sqlite3_close(HDB);
 		HDB = nullptr;
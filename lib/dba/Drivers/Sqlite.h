@@ -48,6 +48,7 @@ public:
 	~SqliteStmt() override;
 
 	Error Exec(size_t nParams, const Attrib** params, DriverRows*& rowsOut) override;
+	void  Reset() override;
 
 	SqliteConn* DBConn();
 
@@ -72,6 +73,7 @@ class SqliteConn : public DriverConn {
 public:
 	sqlite3* HDB = nullptr;
 
+	SqliteConn();
 	~SqliteConn() override;
 
 	Error       Prepare(const char* sql, size_t nParams, const Type* paramTypes, DriverStmt*& stmt) override;
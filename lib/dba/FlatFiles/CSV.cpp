@@ -201,39 +201,84 @@ static int CSVElementTypeWithGeom(const char* csv, size_t len) {
 }
 
 Error CSV::ReadRecordStarts() {
-	// For every field, store a bit field of all types that we have seen inside that field
+	// Records start after the header line, which ReadFields has just consumed
+	int64_t pos = 0;
+	auto    err = File.SeekWithResult(0, io::SeekWhence::Current, pos);
+	if (!err.OK())
+		return err;
+	pos += Decoder.GetBufferPosBehindReader();
+
+	// The whole file is mapped, so we can find the records without decoding them.
+	// We're about to read the whole file from front to back, so ask for aggressive read-ahead.
+	// Afterwards, records are read in whatever order the caller asks for them.
+	File.Advise(os::MMapAdvice::Sequential);
+	ScopeGuard   restoreAdvice([&] { File.Advise(os::MMapAdvice::Normal); });
+	const char*  base = (const char*) File.MemBase();
+	size_t       len  = (size_t) File.Length();
+	csv::Indexer indexer;
+	indexer.Separator = Decoder.Separator;
+	indexer.Quote     = Decoder.Quote;
+	indexer.Index(base + pos, len - (size_t) pos, RecordStarts);
+	for (auto& r : RecordStarts)
+		r += pos;
+
+	auto recordEnd = [&](size_t i) -> int64_t {
+		return i + 1 < RecordStarts.size() ? RecordStarts[i + 1] : (int64_t) len;
+	};
+
+	// Erase last record if it's empty (ie no commas, nothing). It's common to find a single blank line at the end of a file.
+	if (RecordStarts.size() != 0) {
+		io::ByteReader reader(base + RecordStarts.back(), (size_t)(len - RecordStarts.back()));
+		csv::Decoder   dec(&reader);
+		dec.Separator = Decoder.Separator;
+		dec.Quote     = Decoder.Quote;
+		err           = dec.ClearAndReadLine(Buf, BufCells);
+		if (!err.OK())
+			return err;
+		if (BufCells.back() - BufCells.front() == 0)
+			RecordStarts.pop_back();
+	}
+
+	// For every field, store a bit field of all types that we have seen inside that field.
+	// Each thread decodes its own range of records, and the masks are merged at the end.
 	vector<int> masks;
 	for (size_t i = 0; i < CachedFields.size(); i++)
 		masks.push_back(0);
 
-	size_t lastLineLen = 0;
-	Error  err;
-	while (true) {
-		int64_t pos = 0;
-		err         = File.SeekWithResult(0, io::SeekWhence::Current, pos);
-		if (!err.OK())
-			return err;
-		pos += Decoder.GetBufferPosBehindReader();
-		err = Decoder.ClearAndReadLine(Buf, BufCells);
-		if (!err.OK())
-			break;
-		RecordStarts.push_back(pos);
-		if (ReadFieldTypesOnOpen) {
-			for (size_t i = 0; i < BufCells.size() - 1 && i < masks.size(); i++) {
-				if (masks[i] & TMText)
-					continue;
-				int mask = CSVElementTypeWithGeom(Buf.c_str() + BufCells[i], BufCells[i + 1] - BufCells[i]);
-				masks[i] |= mask;
+	if (ReadFieldTypesOnOpen && RecordStarts.size() != 0) {
+		std::mutex masksLock;
+		Error      firstErr;
+		char       sep   = Decoder.Separator;
+		char       quote = Decoder.Quote;
+		sync::ParallelFor(0, RecordStarts.size(), 0, [&](size_t first, size_t last) {
+			io::ByteReader reader(base + RecordStarts[first], (size_t)(recordEnd(last - 1) - RecordStarts[first]));
+			csv::Decoder   dec(&reader);
+			dec.Separator = sep;
+			dec.Quote     = quote;
+			dec.SetBufferSize(64 * 1024);
+			string         buf;
+			vector<size_t> cells;
+			vector<int>    local(masks.size(), 0);
+			Error          e;
+			for (size_t r = first; r < last; r++) {
+				e = dec.ClearAndReadLine(buf, cells);
+				if (!e.OK())
+					break;
+				for (size_t i = 0; i < cells.size() - 1 && i < local.size(); i++) {
+					if (local[i] & TMText)
+						continue;
+					local[i] |= CSVElementTypeWithGeom(buf.c_str() + cells[i], cells[i + 1] - cells[i]);
+				}
 			}
-		}
-		lastLineLen = BufCells.back() - BufCells.front();
+			std::lock_guard<std::mutex> lock(masksLock);
+			for (size_t i = 0; i < masks.size(); i++)
+				masks[i] |= local[i];
+			if (!e.OK() && e != ErrEOF && firstErr.OK())
+				firstErr = e;
+		});
+		if (!firstErr.OK())
+			return firstErr;
 	}
-	if (err != ErrEOF)
-		return err;
-
-	// Erase last record if it's empty (ie no commas, nothing). It's common to find a single blank line at the end of a file.
-	if (lastLineLen == 0)
-		RecordStarts.pop_back();
 
 	if (ReadFieldTypesOnOpen) {
 		// Look at the masks to figure out the field types. We must be conservative. If even one record
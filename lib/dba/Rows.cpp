@@ -118,6 +118,7 @@ Rows::Rows() {
 
 Rows::Rows(Rows&& r) {
 	std::swap(OwnStmt, r.OwnStmt);
+	std::swap(CachedStmt, r.CachedStmt);
 	std::swap(DRows, r.DRows);
 	std::swap(DeadWithError, r.DeadWithError);
 }
@@ -125,6 +126,7 @@ Rows::Rows(Rows&& r) {
 Rows&& Rows::operator=(Rows&& r) {
 	if (this != &r) {
 		std::swap(OwnStmt, r.OwnStmt);
+		std::swap(CachedStmt, r.CachedStmt);
 		std::swap(DRows, r.DRows);
 		std::swap(DeadWithError, r.DeadWithError);
 	}
@@ -133,17 +135,28 @@ Rows&& Rows::operator=(Rows&& r) {
 
 Rows::~Rows() {
 	delete DRows;
-	delete OwnStmt;
+	FreeStmt();
 }
 
-void Rows::Reset(DriverRows* drows, DriverStmt* ownStmt) {
+void Rows::Reset(DriverRows* drows, DriverStmt* ownStmt, bool cachedStmt) {
 	delete DRows;
-	delete OwnStmt;
-	DRows   = drows;
-	OwnStmt = ownStmt;
+	FreeStmt();
+	DRows      = drows;
+	OwnStmt    = ownStmt;
+	CachedStmt = cachedStmt;
 	IMQS_ASSERT(DeadWithError.OK());
 }
 
+// DRows must be deleted before calling this, because a cached statement can be reused as soon as it is returned
+void Rows::FreeStmt() {
+	if (OwnStmt && CachedStmt)
+		OwnStmt->DCon->ReturnCachedStmt(OwnStmt);
+	else
+		delete OwnStmt;
+	OwnStmt    = nullptr;
+	CachedStmt = false;
+}
+
 Error Rows::ReadAll(ResultSink* sink) {
 	if (!OK())
 		return Err();
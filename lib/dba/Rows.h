@@ -138,15 +138,19 @@ private:
 	of that prepared statement, and the only reasonable way to do that, is via the
 	Rows object, because when the user is done iterating over the results of his
 	query, we can safely delete the prepared statement.
+	If CachedStmt is true, then OwnStmt came from its connection's statement cache, and
+	instead of deleting it, we return it to the cache.
 	*/
-	DriverStmt* OwnStmt = nullptr;
-	DriverRows* DRows   = nullptr;
+	DriverStmt* OwnStmt    = nullptr;
+	bool        CachedStmt = false;
+	DriverRows* DRows      = nullptr;
 	Error       DeadWithError;
 
 	Rows(const Rows& r) = delete;
 	Rows& operator=(const Rows& r) = delete;
 
-	void Reset(DriverRows* drows, DriverStmt* ownStmt);
+	void Reset(DriverRows* drows, DriverStmt* ownStmt, bool cachedStmt = false);
+	void FreeStmt();
 };
 } // namespace dba
 } // namespace imqs
@@ -52,16 +52,18 @@ Rows Tx::Query(const char* sql, size_t nParams, const Attrib** params) {
 		pTypes[i] = params[i] ? params[i]->Type : Type::Null;
 
 	Rows        rows;
-	DriverStmt* stmt   = nullptr;
-	rows.DeadWithError = DCon->Prepare(sql, nParams, &pTypes[0], stmt);
-	if (!rows.DeadWithError.OK())
-		return rows;
-	stmt->SQL = sql;
+	DriverStmt* stmt = DCon->TakeCachedStmt(sql);
+	if (stmt == nullptr) {
+		rows.DeadWithError = DCon->Prepare(sql, nParams, &pTypes[0], stmt);
+		if (!rows.DeadWithError.OK())
+			return rows;
+		stmt->SQL = sql;
+	}
 
 	DriverRows* drows  = nullptr;
 	rows.DeadWithError = stmt->Exec(nParams, params, drows);
 	if (rows.DeadWithError.OK())
-		rows.Reset(drows, stmt);
+		rows.Reset(drows, stmt, DCon->CacheStmts);
 	else
 		delete stmt;
 	return rows;
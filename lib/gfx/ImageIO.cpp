@@ -226,8 +226,9 @@ Error ImageIO::LoadJpegScaled(const void* jpegBuf, size_t jpegLen, int scaleFact
 	int colorspace;
 	if (0 != tjDecompressHeader3(JpegDecomp, (uint8_t*) jpegBuf, (unsigned long) jpegLen, &width, &height, &subsamp, &colorspace))
 		return ErrJpegHead;
-	width /= scaleFactor;
-	height /= scaleFactor;
+	// This must match libjpeg-turbo's rounding (TJSCALED), otherwise it will choose a different scaling factor
+	width      = (width + scaleFactor - 1) / scaleFactor;
+	height     = (height + scaleFactor - 1) / scaleFactor;
 	int stride = BytesPerSample(format) * width;
 	stride     = math::RoundUpInt(stride, 4);
 	buf        = imqs_malloc_or_die(stride * height);
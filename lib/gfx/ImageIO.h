@@ -46,7 +46,8 @@ public:
 	// Decodes a jpeg image into a memory buffer of the desired type. Stride is natural, rounded up to the nearest 4 bytes.
 	Error LoadJpeg(const void* jpegBuf, size_t jpegLen, int& width, int& height, void*& buf, TJPF format = TJPF_RGBA);
 
-	// Decodes a jpeg image with downscaling by 1/2 or 1/4. scaleFactor can be 1,2,4, for 1/1, 1/2, 1/4 scales.
+	// Decodes a jpeg image with downscaling by 1/2, 1/4 or 1/8. scaleFactor can be 1,2,4,8, for 1/1, 1/2, 1/4, 1/8 scales.
+	// Downscaling happens inside the IDCT, so it is much faster than decoding at full size.
 	Error LoadJpegScaled(const void* jpegBuf, size_t jpegLen, int scaleFactor, int& width, int& height, void*& buf, TJPF format = TJPF_RGBA);
 
 	// Encode an RGBA buffer to jpeg
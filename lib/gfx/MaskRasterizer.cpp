@@ -0,0 +1,143 @@
+#include "pch.h"
+#include "MaskRasterizer.h"
+
+using namespace std;
+
+namespace imqs {
+namespace gfx {
+
+void MaskRasterizer::AddPolygon(int nvx, const float* vx, int vx_stride_bytes, uint8_t classID, int priority) {
+	if (nvx < 3)
+		return;
+	uint32_t poly = (uint32_t) Polygons.size();
+	Polygons.push_back({classID, priority});
+
+	const float* prev = (const float*) ((const char*) vx + (nvx - 1) * vx_stride_bytes);
+	for (int i = 0; i < nvx; i++) {
+		const float* cur = (const float*) ((const char*) vx + i * vx_stride_bytes);
+		// Horizontal edges never cross a scanline, so they don't contribute anything
+		if (prev[1] != cur[1]) {
+			Edge e;
+			if (prev[1] < cur[1]) {
+				e.X1 = prev[0];
+				e.Y1 = prev[1];
+				e.X2 = cur[0];
+				e.Y2 = cur[1];
+			} else {
+				e.X1 = cur[0];
+				e.Y1 = cur[1];
+				e.X2 = prev[0];
+				e.Y2 = prev[1];
+			}
+			e.Polygon = poly;
+			Edges.push_back(e);
+		}
+		prev = cur;
+	}
+}
+
+void MaskRasterizer::Reset() {
+	Edges.clear();
+	Polygons.clear();
+}
+
+void MaskRasterizer::Render(Image& target) const {
+	IMQS_ASSERT(target.Format == ImageFormat::Gray);
+	if (Edges.size() == 0)
+		return;
+
+	// Polygons are painted in order of rank, so a higher rank overwrites a lower rank
+	vector<uint32_t> order;
+	for (uint32_t i = 0; i < (uint32_t) Polygons.size(); i++)
+		order.push_back(i);
+	stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return Polygons[a].Priority < Polygons[b].Priority; });
+	vector<uint32_t> rank(Polygons.size());
+	for (uint32_t i = 0; i < (uint32_t) order.size(); i++)
+		rank[order[i]] = i;
+
+	struct ActiveEdge {
+		int      YEnd; // Exclusive
+		uint32_t Rank;
+		double   X; // Intersection with the center of the current scanline
+		double   DxDy;
+	};
+	struct PendingEdge {
+		int        YStart;
+		ActiveEdge Edge;
+	};
+	struct Crossing {
+		uint32_t Rank;
+		double   X;
+	};
+
+	// Build the edge table. An edge covers every scanline whose center lies in [Y1, Y2).
+	vector<PendingEdge> pending;
+	pending.reserve(Edges.size());
+	for (const auto& e : Edges) {
+		int y1 = std::max((int) ceil(e.Y1 - 0.5), 0);
+		int y2 = std::min((int) ceil(e.Y2 - 0.5), target.Height);
+		if (y1 >= y2)
+			continue;
+		PendingEdge p;
+		p.YStart    = y1;
+		p.Edge.YEnd = y2;
+		p.Edge.Rank = rank[e.Polygon];
+		p.Edge.DxDy = ((double) e.X2 - (double) e.X1) / ((double) e.Y2 - (double) e.Y1);
+		p.Edge.X    = e.X1 + ((double) y1 + 0.5 - e.Y1) * p.Edge.DxDy;
+		pending.push_back(p);
+	}
+	if (pending.size() == 0)
+		return;
+	sort(pending.begin(), pending.end(), [](const PendingEdge& a, const PendingEdge& b) { return a.YStart < b.YStart; });
+
+	vector<ActiveEdge> active;
+	vector<Crossing>   crossings;
+	size_t             next = 0;
+	for (int y = pending[0].YStart; y < target.Height; y++) {
+		// Retire finished edges, and activate new ones
+		size_t j = 0;
+		for (size_t i = 0; i < active.size(); i++) {
+			if (active[i].YEnd > y)
+				active[j++] = active[i];
+		}
+		active.resize(j);
+		for (; next < pending.size() && pending[next].YStart <= y; next++)
+			active.push_back(pending[next].Edge);
+
+		if (active.size() == 0) {
+			if (next == pending.size())
+				break;
+			// Skip empty scanlines
+			y = pending[next].YStart - 1;
+			continue;
+		}
+
+		crossings.clear();
+		for (const auto& a : active)
+			crossings.push_back({a.Rank, a.X});
+		sort(crossings.begin(), crossings.end(), [](const Crossing& a, const Crossing& b) {
+			return a.Rank != b.Rank ? a.Rank < b.Rank : a.X < b.X;
+		});
+
+		// Every polygon crosses a scanline an even number of times, so consecutive pairs of
+		// crossings of the same polygon are the spans that are inside it (even-odd rule).
+		uint8_t* line = target.Line(y);
+		for (size_t i = 0; i + 1 < crossings.size();) {
+			if (crossings[i].Rank != crossings[i + 1].Rank) {
+				i++;
+				continue;
+			}
+			int x1 = std::max((int) ceil(crossings[i].X - 0.5), 0);
+			int x2 = std::min((int) ceil(crossings[i + 1].X - 0.5), target.Width);
+			if (x1 < x2)
+				memset(line + x1, Polygons[order[crossings[i].Rank]].Class, x2 - x1);
+			i += 2;
+		}
+
+		for (auto& a : active)
+			a.X += a.DxDy;
+	}
+}
+
+} // namespace gfx
+} // namespace imqs
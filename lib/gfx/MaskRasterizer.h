@@ -0,0 +1,44 @@
+#pragma once
+
+#include "Image.h"
+
+namespace imqs {
+namespace gfx {
+
+// MaskRasterizer fills polygons into a single channel image of class IDs, such as a segmentation target.
+// There is no antialiasing, so a pixel is either inside a polygon, or it isn't. A pixel is inside a
+// polygon if its center is inside the polygon, using the even-odd rule. This means that two polygons
+// which share an edge never both claim the same pixel, and never leave a gap between them.
+//
+// All polygons are rendered in a single pass over the image, using one active edge table for all of them.
+// Where polygons overlap, the polygon with the higher priority wins. If priorities are equal, then the
+// polygon that was added last wins.
+class MaskRasterizer {
+public:
+	// Add a closed polygon. Vertices are x,y pairs of floats, in pixel coordinates, and the first
+	// vertex is not repeated at the end.
+	void AddPolygon(int nvx, const float* vx, int vx_stride_bytes, uint8_t classID, int priority = 0);
+
+	// Remove all polygons
+	void Reset();
+
+	// Write the class IDs of all polygons into target, which must be a Gray image.
+	// Pixels that are outside of every polygon are not touched.
+	void Render(Image& target) const;
+
+private:
+	struct Edge {
+		float    X1, Y1; // Y1 < Y2
+		float    X2, Y2;
+		uint32_t Polygon;
+	};
+	struct PolygonInfo {
+		uint8_t Class;
+		int     Priority;
+	};
+	std::vector<Edge>        Edges;
+	std::vector<PolygonInfo> Polygons;
+};
+
+} // namespace gfx
+} // namespace imqs
@@ -15,6 +15,7 @@
 #include "ImageFilters.h"
 #include "Mat3.h"
 #include "Mat4.h"
+#include "MaskRasterizer.h"
 #include "Point.h"
 #include "Raster.h"
 #include "Rect.h"
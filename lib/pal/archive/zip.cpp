@@ -3,16 +3,133 @@
 #include "../alloc.h"
 #include "../io/io.h"
 #include "../os/os.h"
+#include "../sync/TaskScheduler.h"
 
 using namespace std;
 
 namespace imqs {
 namespace archive {
 
-static Error MakeMzErr(int32_t e, const char* action) {
-	return Error::Fmt("Error %v: %v", action, e);
+// Signatures and fixed sizes of the zip records that we read
+static const uint32_t SigLocalHeader        = 0x04034b50;
+static const uint32_t SigCentralHeader      = 0x02014b50;
+static const uint32_t SigEndOfCentral       = 0x06054b50;
+static const uint32_t SigEndOfCentral64     = 0x06064b50;
+static const uint32_t SigEndOfCentral64Loc  = 0x07064b50;
+static const size_t   LocalHeaderSize       = 30;
+static const size_t   CentralHeaderSize     = 46;
+static const size_t   EndOfCentralSize      = 22;
+static const size_t   EndOfCentral64Size    = 56;
+static const size_t   EndOfCentral64LocSize = 20;
+
+static const uint16_t MethodStored  = 0;
+static const uint16_t MethodDeflate = 8;
+
+static uint16_t U16(const uint8_t* p) {
+	return (uint16_t) p[0] | (uint16_t) p[1] << 8;
+}
+
+static uint32_t U32(const uint8_t* p) {
+	return (uint32_t) p[0] | (uint32_t) p[1] << 8 | (uint32_t) p[2] << 16 | (uint32_t) p[3] << 24;
+}
+
+static uint64_t U64(const uint8_t* p) {
+	return (uint64_t) U32(p) | (uint64_t) U32(p + 4) << 32;
 }
 
+// Decompresses a single file, straight out of the archive's memory
+class EntryReader : public io::Reader {
+public:
+	const uint8_t* In      = nullptr;
+	uint64_t       InLen   = 0;
+	uint64_t       InPos   = 0;
+	uint64_t       OutLen  = 0; // Expected uncompressed size
+	uint64_t       OutPos  = 0;
+	uint32_t       CRC     = 0; // Expected CRC
+	uint32_t       RunCRC  = 0; // CRC of the data that we've produced so far
+	bool           Deflate = false;
+	bool           Done    = false;
+	z_stream       Stream;
+
+	EntryReader(const uint8_t* in, const ZipFile::Entry& e) : In(in), InLen(e.CompressedSize), OutLen(e.UncompressedSize), CRC(e.CRC32) {
+		Deflate = e.Method == MethodDeflate;
+		RunCRC  = (uint32_t) crc32(0, nullptr, 0);
+		memset(&Stream, 0, sizeof(Stream));
+	}
+
+	~EntryReader() {
+		if (Deflate)
+			inflateEnd(&Stream);
+	}
+
+	Error Init() {
+		// Negative window bits means a raw deflate stream, without a zlib header
+		if (Deflate && inflateInit2(&Stream, -MAX_WBITS) != Z_OK)
+			return Error("Failed to initialize zlib inflate");
+		return Error();
+	}
+
+	Error Read(void* buf, size_t& len) override {
+		if (Done) {
+			len = 0;
+			return ErrEOF;
+		}
+		size_t n         = 0;
+		bool   streamEnd = false;
+		if (!Deflate) {
+			n = (size_t) std::min<uint64_t>(len, OutLen - OutPos);
+			memcpy(buf, In + InPos, n);
+			InPos += n;
+			streamEnd = InPos == InLen;
+		} else {
+			// zlib takes 32-bit sizes, so large buffers are consumed over several calls to inflate.
+			// We always call inflate at least once, even if len is zero, because the end of the stream
+			// can be reached without producing any output.
+			const uint64_t maxChunk = 1 << 30;
+			do {
+				Stream.next_in   = (Bytef*) (In + InPos);
+				Stream.avail_in  = (uInt) std::min(InLen - InPos, maxChunk);
+				Stream.next_out  = (Bytef*) buf;
+				Stream.avail_out = (uInt) std::min<uint64_t>(len, maxChunk);
+				uInt availIn     = Stream.avail_in;
+				int  r           = inflate(&Stream, Z_NO_FLUSH);
+				InPos += availIn - Stream.avail_in;
+				n = (size_t)((uint8_t*) Stream.next_out - (uint8_t*) buf);
+				if (r == Z_STREAM_END) {
+					streamEnd = true;
+					break;
+				}
+				if (r != Z_OK && r != Z_BUF_ERROR)
+					return Error::Fmt("Error decompressing zip entry: %v", Stream.msg ? Stream.msg : "?");
+				if (n == 0 && Stream.avail_in == availIn) {
+					// No progress. That's expected if the caller gave us no space, but otherwise the input is bad.
+					if (len == 0)
+						break;
+					if (InPos == InLen)
+						return Error("Zip entry is truncated");
+					return Error("Zip entry is corrupt (decompression made no progress)");
+				}
+			} while (n == 0 && len != 0);
+		}
+		if (n > OutLen - OutPos)
+			return Error("Zip entry is larger than its declared size");
+		OutPos += n;
+		for (size_t i = 0; i < n; i += 1 << 30)
+			RunCRC = (uint32_t) crc32(RunCRC, (const Bytef*) buf + i, (uInt) std::min<size_t>(n - i, 1 << 30));
+		len = n;
+		if (streamEnd) {
+			if (OutPos != OutLen)
+				return Error("Zip entry is smaller than its declared size");
+			Done = true;
+			if (RunCRC != CRC)
+				return Error("Zip entry is corrupt (CRC mismatch)");
+			if (n == 0)
+				return ErrEOF;
+		}
+		return Error();
+	}
+};
+
 ZipFile::ZipFile() {
 }
 
@@ -21,104 +138,243 @@ ZipFile::~ZipFile() {
 }
 
 void ZipFile::Close() {
-	mz_zip_close(MzZip);
-	mz_stream_mem_delete(&MzStream);
+	File.Close();
 	free(MemBuf);
-	MzZip      = nullptr;
-	MzStream   = nullptr;
-	MemBuf     = nullptr;
-	MemBufSize = 0;
+	Mem    = nullptr;
+	MemLen = 0;
+	MemBuf = nullptr;
+	Items.clear();
 	Filenames.clear();
+	NameToItem.clear();
 }
 
-Error ZipFile::OpenMem(const void* data, size_t len) {
+Error ZipFile::Open(const std::string& filename) {
 	Close();
+	auto err = File.Open(filename);
+	if (!err.OK())
+		return err;
+	Mem    = File.MemBase();
+	MemLen = (size_t) File.Length();
+	err    = ReadCentralDirectory();
+	if (!err.OK())
+		Close();
+	return err;
+}
 
-	// mz_stream_mem_set_buffer takes an int32
-	if ((uint64_t) len >= (uint64_t) 0x7fffffff)
-		return Error::Fmt("Zip file is too large to open in memory (%v bytes)", len);
-
+Error ZipFile::OpenMem(const void* data, size_t len) {
+	Close();
 	MemBuf = imqs_malloc_or_die(len);
 	memcpy(MemBuf, data, len);
-	MemBufSize = len;
-
-	// fill zip_buffer with zip contents
-	mz_stream_mem_create(&MzStream);
-	mz_stream_mem_set_buffer(MzStream, MemBuf, (int32_t) MemBufSize);
-	auto err = mz_stream_open(MzStream, NULL, MZ_OPEN_MODE_READ);
-	if (err != MZ_OK)
-		return MakeMzErr(err, "opening zip stream");
-
-	MzZip = mz_zip_open(MzStream, MZ_OPEN_MODE_READ);
-	if (!MzZip)
-		return MakeMzErr(0, "opening zip");
+	Mem      = (const uint8_t*) MemBuf;
+	MemLen   = len;
+	auto err = ReadCentralDirectory();
+	if (!err.OK())
+		Close();
+	return err;
+}
 
-	err = mz_zip_goto_first_entry(MzZip);
-	if (err != MZ_OK && err != MZ_END_OF_LIST)
-		return MakeMzErr(err, "seeking to first file in zip");
+Error ZipFile::ReadCentralDirectory() {
+	// The end of central directory record is at the end of the file, followed by a comment of up to 64k
+	if (MemLen < EndOfCentralSize)
+		return Error("Not a zip file");
+	size_t eocd = MemLen - EndOfCentralSize;
+	size_t stop = eocd > 0xffff ? eocd - 0xffff : 0;
+	while (U32(Mem + eocd) != SigEndOfCentral) {
+		if (eocd == stop)
+			return Error("Not a zip file (end of central directory not found)");
+		eocd--;
+	}
+	uint64_t numEntries = U16(Mem + eocd + 10);
+	uint64_t cdSize     = U32(Mem + eocd + 12);
+	uint64_t cdOffset   = U32(Mem + eocd + 16);
 
-	if (err == MZ_END_OF_LIST) {
-		// zip file is empty
-		return Error();
+	// Zip64 archives have a second end of central directory record, which is found via a locator that
+	// sits just before the regular record
+	if (eocd >= EndOfCentral64LocSize && U32(Mem + eocd - EndOfCentral64LocSize) == SigEndOfCentral64Loc) {
+		uint64_t eocd64 = U64(Mem + eocd - EndOfCentral64LocSize + 8);
+		if (MemLen < EndOfCentral64Size || eocd64 > MemLen - EndOfCentral64Size || U32(Mem + eocd64) != SigEndOfCentral64)
+			return Error("Zip64 end of central directory is corrupt");
+		numEntries = U64(Mem + eocd64 + 32);
+		cdSize     = U64(Mem + eocd64 + 40);
+		cdOffset   = U64(Mem + eocd64 + 48);
 	}
+	if (cdOffset > MemLen || cdSize > MemLen - cdOffset)
+		return Error("Zip central directory is out of bounds");
 
-	while (true) {
-		err = mz_zip_entry_read_open(MzZip, 0, nullptr);
-		if (err != MZ_OK)
-			return MakeMzErr(err, "opening zip file entry");
+	// Don't trust numEntries for the reservation, because it comes from the file
+	Items.reserve((size_t) std::min<uint64_t>(numEntries, cdSize / CentralHeaderSize));
+	const uint8_t* p   = Mem + cdOffset;
+	const uint8_t* end = p + cdSize;
+	for (uint64_t i = 0; i < numEntries; i++) {
+		if ((size_t)(end - p) < CentralHeaderSize || U32(p) != SigCentralHeader)
+			return Error::Fmt("Zip central directory is corrupt at entry %v", i);
+		size_t nameLen    = U16(p + 28);
+		size_t extraLen   = U16(p + 30);
+		size_t commentLen = U16(p + 32);
+		if ((size_t)(end - p) < CentralHeaderSize + nameLen + extraLen + commentLen)
+			return Error::Fmt("Zip central directory is corrupt at entry %v", i);
 
-		mz_zip_file* info = nullptr;
-		err               = mz_zip_entry_get_info(MzZip, &info);
-		if (err != MZ_OK)
-			return MakeMzErr(err, "reading zip info");
+		Entry e;
+		e.Flags             = U16(p + 8);
+		e.Method            = U16(p + 10);
+		e.CRC32             = U32(p + 16);
+		e.CompressedSize    = U32(p + 20);
+		e.UncompressedSize  = U32(p + 24);
+		e.LocalHeaderOffset = U32(p + 42);
+		e.Name.assign((const char*) p + CentralHeaderSize, nameLen);
 
-		// 7-zip saves directories, but Windows built-in compressor doesn't
-		bool isDir = !!(info->external_fa & 16) && !(info->external_fa & 32) && info->filename[info->filename_size - 1] == '/';
-		if (!isDir)
-			Filenames.push_back(string(info->filename, info->filename_size));
+		// The zip64 extra field holds the 64-bit versions of whichever fields are saturated, in this order
+		const uint8_t* x    = p + CentralHeaderSize + nameLen;
+		const uint8_t* xend = x + extraLen;
+		while (xend - x >= 4) {
+			uint16_t id   = U16(x);
+			uint16_t size = U16(x + 2);
+			x += 4;
+			if (size > xend - x)
+				break;
+			if (id == 0x0001) {
+				const uint8_t* f    = x;
+				const uint8_t* fend = x + size;
+				if (e.UncompressedSize == 0xffffffff && fend - f >= 8) {
+					e.UncompressedSize = U64(f);
+					f += 8;
+				}
+				if (e.CompressedSize == 0xffffffff && fend - f >= 8) {
+					e.CompressedSize = U64(f);
+					f += 8;
+				}
+				if (e.LocalHeaderOffset == 0xffffffff && fend - f >= 8)
+					e.LocalHeaderOffset = U64(f);
+			}
+			x += size;
+		}
+		p += CentralHeaderSize + nameLen + extraLen + commentLen;
 
-		err = mz_zip_entry_close(MzZip);
-		if (err != MZ_OK)
-			return MakeMzErr(err, "closing zip entry");
+		// 7-zip saves directories, but Windows built-in compressor doesn't
+		if (e.Name.size() != 0 && e.Name.back() == '/')
+			continue;
 
-		err = mz_zip_goto_next_entry(MzZip);
-		if (err == MZ_END_OF_LIST)
-			break;
-		else if (err != MZ_OK)
-			return MakeMzErr(err, "seeking to next file in zip");
+		// If a name appears twice, then the first one wins
+		NameToItem.insert(e.Name, Items.size());
+		Filenames.push_back(e.Name);
+		Items.push_back(std::move(e));
 	}
 
 	return Error();
 }
 
-static int32_t CompareFilename(void* handle, const char* filename1, const char* filename2) {
-	return strcmp(filename1, filename2);
+const ZipFile::Entry* ZipFile::Find(const std::string& name) const {
+	size_t* i = NameToItem.getp(name);
+	return i ? &Items[*i] : nullptr;
+}
+
+Error ZipFile::OpenFile(const std::string& name, std::unique_ptr<io::Reader>& reader) const {
+	auto e = Find(name);
+	if (!e)
+		return os::ErrENOENT;
+	return OpenFile(*e, reader);
 }
 
-Error ZipFile::ReadWholeFile(const std::string& name, std::string& content) {
-	int err = mz_zip_locate_entry(MzZip, name.c_str(), CompareFilename);
-	if (err == MZ_END_OF_LIST)
+Error ZipFile::OpenFile(const Entry& e, std::unique_ptr<io::Reader>& reader) const {
+	if (!!(e.Flags & 1))
+		return Error::Fmt("Zip entry %v is encrypted", e.Name);
+	if (e.Method != MethodStored && e.Method != MethodDeflate)
+		return Error::Fmt("Zip entry %v uses unsupported compression method %v", e.Name, e.Method);
+	if (e.Method == MethodStored && e.CompressedSize != e.UncompressedSize)
+		return Error::Fmt("Zip entry %v is corrupt (stored size mismatch)", e.Name);
+
+	// The local header has its own copy of the name and extra field, which can differ in length from the central directory
+	uint64_t h = e.LocalHeaderOffset;
+	if (h > MemLen || MemLen - h < LocalHeaderSize || U32(Mem + h) != SigLocalHeader)
+		return Error::Fmt("Zip entry %v is corrupt (bad local header)", e.Name);
+	uint64_t data = h + LocalHeaderSize + U16(Mem + h + 26) + U16(Mem + h + 28);
+	if (data > MemLen || e.CompressedSize > MemLen - data)
+		return Error::Fmt("Zip entry %v is out of bounds", e.Name);
+
+	auto r   = new EntryReader(Mem + data, e);
+	auto err = r->Init();
+	if (!err.OK()) {
+		delete r;
+		return err;
+	}
+	reader.reset(r);
+	return Error();
+}
+
+Error ZipFile::ReadWholeFile(const std::string& name, std::string& content) const {
+	auto e = Find(name);
+	if (!e)
 		return os::ErrENOENT;
+	std::unique_ptr<io::Reader> reader;
+	auto                        err = OpenFile(*e, reader);
+	if (!err.OK())
+		return err;
 
-	err = mz_zip_entry_read_open(MzZip, 0, nullptr);
-	if (err != MZ_OK)
-		return MakeMzErr(err, "opening zip entry");
+	// Deflate cannot compress by more than 1032:1, so this protects us from allocating a huge buffer for a corrupt size
+	if (e->UncompressedSize > e->CompressedSize * 1032 + 1024)
+		return Error::Fmt("Zip entry %v is corrupt (impossible uncompressed size)", name);
 
-	char buf[1024];
+	// Decompress straight into the output string
+	size_t start = content.size();
+	content.resize(start + (size_t) e->UncompressedSize);
+	size_t pos = start;
 	while (true) {
-		int n = mz_zip_entry_read(MzZip, buf, sizeof(buf));
-		if (n < 0)
-			return MakeMzErr(n, "reading zip entry contents");
-		if (n == 0)
+		// Once the output is full, keep asking for one more byte, so that the reader gets to see the end of the
+		// stream. If that byte actually arrives, then the reader fails, because the entry is larger than declared.
+		size_t n       = content.size() - pos;
+		bool   full    = n == 0;
+		char   scratch = 0;
+		if (full)
+			n = 1;
+		err = reader->Read(full ? &scratch : &content[pos], n);
+		if (err == ErrEOF)
 			break;
-		content.append(buf, n);
+		if (err.OK() && (n == 0 || full))
+			err = Error("No progress");
+		if (!err.OK()) {
+			content.resize(start);
+			return Error::Fmt("Error reading %v from zip: %v", name, err.Message());
+		}
+		pos += n;
 	}
+	return Error();
+}
 
-	err = mz_zip_entry_close(MzZip);
-	if (err != MZ_OK)
-		return MakeMzErr(err, "closing zip entry");
+Error ZipFile::ReadParallel(const std::vector<std::string>& files, std::function<Error(size_t i, io::Reader& reader)> f) const {
+	std::mutex lock;
+	Error      firstErr;
+	sync::ParallelFor(0, files.size(), 1, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			std::unique_ptr<io::Reader> reader;
+			auto                        err = OpenFile(files[i], reader);
+			if (err.OK())
+				err = f(i, *reader);
+			if (!err.OK()) {
+				std::lock_guard<std::mutex> g(lock);
+				if (firstErr.OK())
+					firstErr = err;
+			}
+		}
+	});
+	return firstErr;
+}
 
-	return Error();
+Error ZipFile::ReadParallel(const std::vector<std::string>& files, std::vector<std::string>& contents) const {
+	contents.clear();
+	contents.resize(files.size());
+	std::mutex lock;
+	Error      firstErr;
+	sync::ParallelFor(0, files.size(), 1, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			auto err = ReadWholeFile(files[i], contents[i]);
+			if (!err.OK()) {
+				std::lock_guard<std::mutex> g(lock);
+				if (firstErr.OK())
+					firstErr = err;
+			}
+		}
+	});
+	return firstErr;
 }
 
 } // namespace archive
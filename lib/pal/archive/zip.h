@@ -1,34 +1,79 @@
 #pragma once
 
+#include "../io/io.h"
+#include "../os/MMapFile.h"
+#include <functional>
+
 namespace imqs {
 namespace archive {
 
 // Zip file reader
+// The central directory is parsed once, when the archive is opened, and files are looked up
+// with a hash table. Files are decompressed directly out of the archive's memory, which is memory
+// mapped if you use Open(), so large files can be streamed through an io::Reader, without ever
+// holding them in memory.
+// All of the read functions are const, and safe to call from multiple threads at once, because
+// every reader has its own inflate state.
+// Only the stored and deflate compression methods are supported, and encrypted files are not.
 class IMQS_PAL_API ZipFile {
 public:
+	// A file inside the archive
+	struct Entry {
+		std::string Name;
+		uint16_t    Method            = 0; // 0 = stored, 8 = deflate
+		uint16_t    Flags             = 0; // General purpose bit flags. Bit 0 means encrypted.
+		uint32_t    CRC32             = 0;
+		uint64_t    CompressedSize    = 0;
+		uint64_t    UncompressedSize  = 0;
+		uint64_t    LocalHeaderOffset = 0;
+	};
+
 	ZipFile();
 	~ZipFile();
 
 	void Close();
 
-	// Open a zip file in memory
+	// Open a zip file on disk, by memory mapping it
+	Error Open(const std::string& filename);
+
+	// Open a zip file in memory. The data is copied, so you don't need to keep it alive.
 	Error OpenMem(const void* data, size_t len);
 
 	// Get a list of all filenames inside the archive
 	std::vector<std::string> Files() const { return Filenames; }
 
-	// Read an entire file out of the archive
-	Error ReadWholeFile(const std::string& name, std::string& content);
+	// All files in the archive, in the order of the central directory. Directories are excluded.
+	const std::vector<Entry>& Entries() const { return Items; }
+
+	// Returns null if the file is not in the archive
+	const Entry* Find(const std::string& name) const;
+
+	// Read an entire file out of the archive, appending it to 'content'
+	Error ReadWholeFile(const std::string& name, std::string& content) const;
+
+	// Create a reader that decompresses the file as you read it. The reader returns ErrEOF at the end of the file,
+	// and returns an error if the file is corrupt, or its CRC does not match. The reader must not outlive the ZipFile.
+	Error OpenFile(const std::string& name, std::unique_ptr<io::Reader>& reader) const;
+	Error OpenFile(const Entry& entry, std::unique_ptr<io::Reader>& reader) const;
+
+	// Call f(i, reader) for every files[i], from multiple threads, and return the first error.
+	Error ReadParallel(const std::vector<std::string>& files, std::function<Error(size_t i, io::Reader& reader)> f) const;
+
+	// Read files[i] into contents[i], from multiple threads
+	Error ReadParallel(const std::vector<std::string>& files, std::vector<std::string>& contents) const;
 
 private:
-	void*  MemBuf     = nullptr; // Copy of data from OpenMem()
-	size_t MemBufSize = 0;
+	const uint8_t* Mem    = nullptr; // Start of the archive, which is either MemBuf, or the memory mapped File
+	size_t         MemLen = 0;
+	void*          MemBuf = nullptr; // Copy of data from OpenMem()
+	os::MMapFile   File;
 
-	std::vector<std::string> Filenames;
+	std::vector<Entry>              Items;
+	std::vector<std::string>        Filenames;
+	ohash::map<std::string, size_t> NameToItem;
 
-	void* MzStream = nullptr;
-	void* MzZip    = nullptr;
+	Error ReadCentralDirectory();
 };
 
 } // namespace archive
-} // namespace imqs
\ No newline at end of file
+} // namespace imqs
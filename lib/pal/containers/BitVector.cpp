@@ -2,8 +2,87 @@
 #include "BitVector.h"
 #include "../alloc.h"
 
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+#define IMQS_BITVECTOR_SIMD 1
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+// We don't build with -mavx2 or /arch:AVX2, so the AVX2 paths are compiled per-function, and chosen at runtime
+#if defined(_MSC_VER) && !defined(__clang__)
+#define IMQS_TARGET_AVX2
+#else
+#define IMQS_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
 namespace imqs {
 
+static const size_t RankBlockWords = 8;    // 512 bits per rank block
+static const size_t SelectSample   = 8192; // Distance between select hints, in 1s (or 0s)
+
+static inline int CountTrailingZeros(uint64_t m) {
+#ifdef _MSC_VER
+	unsigned long i;
+	_BitScanForward64(&i, m);
+	return (int) i;
+#else
+	return __builtin_ctzll(m);
+#endif
+}
+
+static inline int PopCount(uint64_t m) {
+#ifdef _MSC_VER
+	return (int) __popcnt64(m);
+#else
+	return __builtin_popcountll(m);
+#endif
+}
+
+#if defined(IMQS_BITVECTOR_SIMD)
+static bool DetectAVX2() {
+#if defined(__AVX2__)
+	return true;
+#elif defined(_MSC_VER)
+	// The OS must also save the YMM registers on a context switch
+	int r[4];
+	__cpuid(r, 0);
+	if (r[0] < 7)
+		return false;
+	__cpuid(r, 1);
+	if (!(r[2] & (1 << 27)) || (_xgetbv(0) & 6) != 6)
+		return false;
+	__cpuidex(r, 7, 0);
+	return !!(r[1] & (1 << 5));
+#else
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+static bool HasAVX2() {
+	static const bool has = DetectAVX2();
+	return has;
+}
+#endif
+
+// Returns the position of the n-th set bit in m. m must have more than n bits set.
+static inline int SelectInWord(uint64_t m, int n) {
+	// Skip whole bytes, and then clear the remaining lower bits one at a time
+	int shift = 0;
+	while (true) {
+		int c = PopCount(m & 0xff);
+		if (n < c)
+			break;
+		n -= c;
+		m >>= 8;
+		shift += 8;
+	}
+	for (; n != 0; n--)
+		m &= m - 1;
+	return shift + CountTrailingZeros(m);
+}
+
 BitVector::BitVector() {
 }
 
@@ -20,6 +99,9 @@ BitVector::~BitVector() {
 }
 
 BitVector& BitVector::operator=(const BitVector& b) {
+	RankBlocks     = b.RankBlocks;
+	SelectHints[0] = b.SelectHints[0];
+	SelectHints[1] = b.SelectHints[1];
 	if (WordCap != b.WordCap) {
 		free(Buf);
 		Buf     = nullptr;
@@ -45,6 +127,11 @@ BitVector& BitVector::operator=(BitVector&& b) {
 	b.Buf     = nullptr;
 	b.WordCap = 0;
 	b._Size   = 0;
+
+	RankBlocks     = std::move(b.RankBlocks);
+	SelectHints[0] = std::move(b.SelectHints[0]);
+	SelectHints[1] = std::move(b.SelectHints[1]);
+	b.DiscardRankIndex();
 	return *this;
 }
 
@@ -53,6 +140,13 @@ void BitVector::Clear() {
 	Buf     = nullptr;
 	WordCap = 0;
 	_Size   = 0;
+	DiscardRankIndex();
+}
+
+void BitVector::DiscardRankIndex() {
+	RankBlocks.clear();
+	SelectHints[0].clear();
+	SelectHints[1].clear();
 }
 
 void BitVector::Grow() {
@@ -61,6 +155,259 @@ void BitVector::Grow() {
 	WordCap       = newcap;
 }
 
+void BitVector::Reserve(size_t words) {
+	if (words <= WordCap)
+		return;
+	size_t newcap = std::max(words, std::max(WordCap * 2, 64 / sizeof(TWord)));
+	Buf           = (TWord*) imqs_realloc_or_die(Buf, newcap * sizeof(TWord));
+	WordCap       = newcap;
+}
+
+BitVector::TWord BitVector::WordAt(size_t i) const {
+	unsigned tail = (unsigned) (_Size % TWordBits);
+	if (i == _Size / TWordBits && tail != 0)
+		return Buf[i] & (((TWord) 1 << tail) - 1);
+	return Buf[i];
+}
+
+void BitVector::AddMany(const uint8_t* v, size_t n) {
+	if (!RankBlocks.empty())
+		DiscardRankIndex();
+	Reserve((_Size + n + TWordBits - 1) / TWordBits + 1);
+	size_t i = 0;
+	while (i < n) {
+		// Build up to 64 bits at a time, and then splice them onto the end
+		unsigned nbits = (unsigned) std::min<size_t>(n - i, (size_t) TWordBits);
+		TWord    m     = 0;
+		if (nbits == TWordBits) {
+#if defined(__AVX2__)
+			__m256i  zero = _mm256_setzero_si256();
+			uint64_t lo   = (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*) (v + i)), zero));
+			uint64_t hi   = (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*) (v + i + 32)), zero));
+			m             = ~(lo | (hi << 32));
+#elif defined(IMQS_BITVECTOR_SIMD)
+			__m128i zero = _mm_setzero_si128();
+			for (int k = 0; k < 4; k++)
+				m |= (uint64_t)(uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (v + i + k * 16)), zero)) << (k * 16);
+			m = ~m;
+#else
+			for (unsigned k = 0; k < TWordBits; k++)
+				m |= (TWord)(v[i + k] != 0) << k;
+#endif
+		} else {
+			for (unsigned k = 0; k < nbits; k++)
+				m |= (TWord)(v[i + k] != 0) << k;
+		}
+
+		size_t   word   = _Size / TWordBits;
+		unsigned offset = (unsigned) (_Size % TWordBits);
+		if (offset == 0) {
+			Buf[word] = m;
+		} else {
+			Buf[word] = (Buf[word] & (((TWord) 1 << offset) - 1)) | (m << offset);
+			if (offset + nbits > TWordBits)
+				Buf[word + 1] = m >> (TWordBits - offset);
+		}
+		_Size += nbits;
+		i += nbits;
+	}
+}
+
+#if defined(IMQS_BITVECTOR_SIMD)
+// Count the bits in each nibble with a table lookup, and then sum the bytes with SAD.
+// n must be a multiple of 4.
+IMQS_TARGET_AVX2 static size_t CountOnesAVX2(const uint64_t* buf, size_t n) {
+	const __m256i table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+	const __m256i low   = _mm256_set1_epi8(0x0f);
+	__m256i       acc   = _mm256_setzero_si256();
+	for (size_t i = 0; i < n; i += 4) {
+		__m256i v  = _mm256_loadu_si256((const __m256i*) (buf + i));
+		__m256i lo = _mm256_shuffle_epi8(table, _mm256_and_si256(v, low));
+		__m256i hi = _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(v, 4), low));
+		acc        = _mm256_add_epi64(acc, _mm256_sad_epu8(_mm256_add_epi8(lo, hi), _mm256_setzero_si256()));
+	}
+	return (size_t)(_mm256_extract_epi64(acc, 0) + _mm256_extract_epi64(acc, 1) + _mm256_extract_epi64(acc, 2) + _mm256_extract_epi64(acc, 3));
+}
+#endif
+
+size_t BitVector::CountOnes() const {
+	size_t n     = NumWords();
+	size_t i     = 0;
+	size_t count = 0;
+	if (n == 0)
+		return 0;
+#if defined(IMQS_BITVECTOR_SIMD)
+	if (HasAVX2()) {
+		// Leave the last word for WordAt, because its bits beyond _Size are garbage
+		i     = (n - 1) & ~(size_t) 3;
+		count = CountOnesAVX2(Buf, i);
+	}
+#endif
+	for (; i < n; i++)
+		count += PopCount(WordAt(i));
+	return count;
+}
+
+size_t BitVector::FindNextOne(size_t i) const {
+	if (i >= _Size)
+		return _Size;
+	size_t n    = NumWords();
+	size_t word = i / TWordBits;
+	TWord  m    = WordAt(word) & ((TWord) -1 << (i % TWordBits));
+	while (m == 0) {
+		if (++word == n)
+			return _Size;
+		m = WordAt(word);
+	}
+	return word * TWordBits + CountTrailingZeros(m);
+}
+
+size_t BitVector::FindNextZero(size_t i) const {
+	if (i >= _Size)
+		return _Size;
+	size_t n    = NumWords();
+	size_t word = i / TWordBits;
+	TWord  m    = ~Buf[word] & ((TWord) -1 << (i % TWordBits));
+	while (m == 0) {
+		if (++word == n)
+			return _Size;
+		m = ~Buf[word];
+	}
+	// The bits beyond _Size are garbage, so we may have found one of them
+	return std::min(word * TWordBits + CountTrailingZeros(m), _Size);
+}
+
+struct BitVectorAnd {
+	static uint64_t Word(uint64_t a, uint64_t b) { return a & b; }
+#if defined(IMQS_BITVECTOR_SIMD)
+	IMQS_TARGET_AVX2 static __m256i Vec(__m256i a, __m256i b) { return _mm256_and_si256(a, b); }
+#endif
+};
+
+struct BitVectorOr {
+	static uint64_t Word(uint64_t a, uint64_t b) { return a | b; }
+#if defined(IMQS_BITVECTOR_SIMD)
+	IMQS_TARGET_AVX2 static __m256i Vec(__m256i a, __m256i b) { return _mm256_or_si256(a, b); }
+#endif
+};
+
+struct BitVectorAndNot {
+	static uint64_t Word(uint64_t a, uint64_t b) { return a & ~b; }
+#if defined(IMQS_BITVECTOR_SIMD)
+	IMQS_TARGET_AVX2 static __m256i Vec(__m256i a, __m256i b) { return _mm256_andnot_si256(b, a); }
+#endif
+};
+
+#if defined(IMQS_BITVECTOR_SIMD)
+// Returns the number of words that were combined, which is n rounded down to a multiple of 4
+template <typename TOp>
+IMQS_TARGET_AVX2 static size_t CombineAVX2(uint64_t* a, const uint64_t* b, size_t n) {
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m256i x = _mm256_loadu_si256((const __m256i*) (a + i));
+		__m256i y = _mm256_loadu_si256((const __m256i*) (b + i));
+		_mm256_storeu_si256((__m256i*) (a + i), TOp::Vec(x, y));
+	}
+	return i;
+}
+#endif
+
+template <typename TOp>
+void BitVector::Combine(const BitVector& b) {
+	IMQS_ASSERT(_Size == b._Size);
+	if (!RankBlocks.empty())
+		DiscardRankIndex();
+	size_t n = NumWords();
+	size_t i = 0;
+#if defined(IMQS_BITVECTOR_SIMD)
+	if (HasAVX2())
+		i = CombineAVX2<TOp>(Buf, b.Buf, n);
+#endif
+	for (; i < n; i++)
+		Buf[i] = TOp::Word(Buf[i], b.Buf[i]);
+}
+
+void BitVector::And(const BitVector& b) {
+	Combine<BitVectorAnd>(b);
+}
+
+void BitVector::Or(const BitVector& b) {
+	Combine<BitVectorOr>(b);
+}
+
+void BitVector::AndNot(const BitVector& b) {
+	Combine<BitVectorAndNot>(b);
+}
+
+void BitVector::BuildRankIndex() {
+	const size_t blockBits = RankBlockWords * TWordBits;
+	size_t       nWords    = NumWords();
+	size_t       nBlocks   = (nWords + RankBlockWords - 1) / RankBlockWords;
+	RankBlocks.resize(nBlocks + 1);
+	SelectHints[0].clear();
+	SelectHints[1].clear();
+	uint64_t ones     = 0;
+	uint64_t nextOne  = 0; // Rank of the next 1 that needs a select hint
+	uint64_t nextZero = 0;
+	for (size_t b = 0; b < nBlocks; b++) {
+		RankBlocks[b] = ones;
+		size_t end    = std::min(nWords, (b + 1) * RankBlockWords);
+		for (size_t w = b * RankBlockWords; w < end; w++)
+			ones += PopCount(WordAt(w));
+		uint64_t zeros = std::min((b + 1) * blockBits, _Size) - ones;
+		for (; nextOne < ones; nextOne += SelectSample)
+			SelectHints[1].push_back((uint32_t) b);
+		for (; nextZero < zeros; nextZero += SelectSample)
+			SelectHints[0].push_back((uint32_t) b);
+	}
+	RankBlocks[nBlocks] = ones;
+}
+
+size_t BitVector::RankInternal(size_t i) const {
+	IMQS_ASSERT(!RankBlocks.empty() && i <= _Size);
+	size_t word  = i / TWordBits;
+	size_t count = RankBlocks[word / RankBlockWords];
+	for (size_t w = word - word % RankBlockWords; w < word; w++)
+		count += PopCount(Buf[w]);
+	unsigned offset = (unsigned) (i % TWordBits);
+	if (offset != 0)
+		count += PopCount(Buf[word] & (((TWord) 1 << offset) - 1));
+	return count;
+}
+
+size_t BitVector::SelectInternal(size_t n, int bit) const {
+	IMQS_ASSERT(!RankBlocks.empty());
+	const size_t blockBits = RankBlockWords * TWordBits;
+	size_t       nBlocks   = RankBlocks.size() - 1;
+	auto         before    = [&](size_t b) -> uint64_t { return bit ? RankBlocks[b] : b * blockBits - RankBlocks[b]; };
+	uint64_t     total     = bit ? RankBlocks[nBlocks] : _Size - RankBlocks[nBlocks];
+	if (n >= total)
+		return _Size;
+
+	// The hints narrow the search down to a range of blocks, and then we binary search inside that range
+	const auto& hints = SelectHints[bit];
+	size_t      k     = n / SelectSample;
+	size_t      lo    = hints[k];
+	size_t      hi    = k + 1 < hints.size() ? hints[k + 1] + 1 : nBlocks;
+	while (hi - lo > 1) {
+		size_t mid = (lo + hi) / 2;
+		if (before(mid) <= n)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	// The bits beyond _Size are never reached, because we know that the n-th bit is inside the vector
+	n -= (size_t) before(lo);
+	for (size_t w = lo * RankBlockWords;; w++) {
+		TWord  m = bit ? Buf[w] : ~Buf[w];
+		size_t c = PopCount(m);
+		if (n < c)
+			return w * TWordBits + SelectInWord(m, (int) n);
+		n -= c;
+	}
+}
+
 BitVector::Mixture BitVector::ScanAll() const {
 	if (_Size == 0)
 		return Mixture::Empty;
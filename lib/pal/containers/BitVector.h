@@ -23,6 +23,16 @@ namespace imqs {
 //
 // MSVC's vector<bool> is competitive on Set(), in a release build, but on everything else
 // it's miserably slow.
+//
+// The bulk operations (CountOnes, And/Or/AndNot, FindNext, AddMany) work a whole word at a time.
+// CountOnes and And/Or/AndNot check for AVX2 at runtime, because we don't build with -mavx2.
+// AddMany uses SSE2, or AVX2 if the whole build targets it.
+//
+// Rank and Select need an index, which you build with BuildRankIndex(). The index costs about 3%
+// of the size of the bit vector. It is not updated when the bit vector changes, so you must
+// build it again after any modification. Every modification discards the index, so that Rank and
+// Select assert, instead of silently returning stale answers. When there is no index, this costs
+// Add and Set one predictable branch.
 class IMQS_PAL_API BitVector {
 public:
 	typedef uint64_t    TWord;
@@ -52,6 +62,25 @@ public:
 	bool    Get(size_t i) const;
 	Mixture ScanAll() const;
 
+	void AddMany(const uint8_t* v, size_t n); // Add n bits, where a non-zero byte is a 1
+	void AddMany(const bool* v, size_t n) { AddMany((const uint8_t*) v, n); }
+
+	size_t CountOnes() const;
+	size_t CountZeros() const { return _Size - CountOnes(); }
+	size_t FindNextOne(size_t i) const;  // Returns the index of the first 1 at or after i, or Size() if there is none
+	size_t FindNextZero(size_t i) const; // Returns the index of the first 0 at or after i, or Size() if there is none
+
+	// These combine b into this bit vector. b must be the same size as this.
+	void And(const BitVector& b);
+	void Or(const BitVector& b);
+	void AndNot(const BitVector& b); // this = this & ~b
+
+	void   BuildRankIndex();
+	size_t RankOne(size_t i) const { return RankInternal(i); }         // Number of 1s in [0, i)
+	size_t RankZero(size_t i) const { return i - RankInternal(i); }    // Number of 0s in [0, i)
+	size_t SelectOne(size_t n) const { return SelectInternal(n, 1); }  // Index of the n-th 1 (starting at 0), or Size() if there are not that many
+	size_t SelectZero(size_t n) const { return SelectInternal(n, 0); } // Index of the n-th 0 (starting at 0), or Size() if there are not that many
+
 	bool operator[](size_t i) const { return Get(i); }
 
 private:
@@ -59,7 +88,20 @@ private:
 	size_t WordCap = 0; // Capacity in TWords
 	TWord* Buf     = nullptr;
 
-	void Grow();
+	// Rank/select index. RankBlocks[i] is the number of 1s before block i, where a block is RankBlockWords words.
+	// SelectHints[0][k] is the block that holds the (k * SelectSample)-th 0, and SelectHints[1] is the same for 1s.
+	std::vector<uint64_t> RankBlocks;
+	std::vector<uint32_t> SelectHints[2];
+
+	void   Grow();
+	void   Reserve(size_t words);
+	void   DiscardRankIndex();
+	size_t NumWords() const { return (_Size + TWordBits - 1) / TWordBits; }
+	TWord  WordAt(size_t i) const; // Returns word i, with the bits beyond _Size cleared
+	size_t RankInternal(size_t i) const;
+	size_t SelectInternal(size_t n, int bit) const;
+	template <typename TOp>
+	void Combine(const BitVector& b);
 };
 
 BITVECTOR_INLINE void BitVector::Add(bool b) {
@@ -67,6 +109,8 @@ BITVECTOR_INLINE void BitVector::Add(bool b) {
 	unsigned offset = (unsigned) (_Size % TWordBits);
 	if (word >= WordCap)
 		Grow();
+	if (!RankBlocks.empty())
+		DiscardRankIndex();
 
 	// This non-branch formulation seems to be a tiny bit slower on my i7 4700
 	//TWord clear = ~((TWord) 1 << offset);
@@ -82,6 +126,8 @@ BITVECTOR_INLINE void BitVector::Add(bool b) {
 
 BITVECTOR_INLINE void BitVector::Set(size_t i, bool b) {
 	IMQS_ASSERT(i < _Size);
+	if (!RankBlocks.empty())
+		DiscardRankIndex();
 	size_t   word   = i / TWordBits;
 	unsigned offset = (unsigned) (i % TWordBits);
 	if (b)
@@ -0,0 +1,314 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+
+namespace imqs {
+
+/*
+
+Bounded multi-producer, multi-consumer queue
+============================================
+
+* Lock-free FIFO on the fast path (Dmitry Vyukov's bounded MPMC queue)
+* Fixed capacity, which is rounded up to a power of 2
+* Items are moved in and out, so T may be move-only
+* Blocking Push and Pop spin for a short while, and then park on a condition variable
+* Close() stops further pushes. Consumers keep popping until the queue is drained.
+
+Every slot carries a sequence number, which tells producers and consumers whether the slot is
+ready for them. A producer claims a slot by advancing EnqueuePos with a CAS, writes the item,
+and then publishes it by bumping the slot's sequence number. Consumers do the mirror image with
+DequeuePos. Producers only contend with producers, and consumers with consumers.
+
+Close() sets the top bit of EnqueuePos, which makes every later claim fail. After that, the set of
+claimed slots is final, but a producer that claimed a slot just before Close() may still be writing
+its item. A consumer that finds the queue closed and empty therefore waits for DequeuePos to reach
+the final EnqueuePos before it reports the end of the queue, so that no pushed item is ever lost.
+
+Unlike Queue, there is no semaphore, so consumers are not restricted to the "wait, then pop
+exactly one" pattern. Any mix of TryPop and Pop is fine.
+
+	BoundedQueue<Job> q(1024);
+	// producers
+	q.Push(std::move(job));
+	// consumers
+	Job job;
+	while (q.Pop(job))
+		job.Run();
+	// shutdown
+	q.Close();
+
+*/
+template <typename T>
+class BoundedQueue {
+public:
+	explicit BoundedQueue(size_t capacity);
+	~BoundedQueue();
+
+	BoundedQueue(const BoundedQueue&) = delete;
+	BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+	bool   TryPush(T&& item);      // Returns false if the queue is full or closed. item is untouched on failure.
+	bool   TryPush(const T& item); // Copying version of TryPush
+	bool   TryPop(T& item);        // Returns false if the queue is empty
+	bool   Push(T&& item);         // Blocks while the queue is full. Returns false if the queue is closed.
+	bool   Push(const T& item);    // Copying version of Push
+	bool   Pop(T& item);           // Blocks while the queue is empty. Returns false once the queue is closed and drained.
+	void   Close();                // Fail all future pushes, and wake all blocked threads. Call this once the producers are done.
+	bool   IsClosed() const { return (EnqueuePos.load(std::memory_order_acquire) & ClosedBit) != 0; }
+	size_t Capacity() const { return Mask + 1; }
+	size_t SizeApprox() const; // Only a snapshot, because other threads can push and pop concurrently
+
+private:
+	static const size_t CacheLineSize = 64;
+	static const int    SpinCount     = 100;                 // Number of failed attempts before a blocking call parks
+	static const size_t ClosedBit     = ~(~(size_t) 0 >> 1); // Set in EnqueuePos by Close()
+
+	struct Cell {
+		std::atomic<size_t>                                        Sequence;
+		typename std::aligned_storage<sizeof(T), alignof(T)>::type Storage;
+
+		T* Item() { return reinterpret_cast<T*>(&Storage); }
+	};
+
+	Cell*  Cells = nullptr;
+	size_t Mask  = 0;
+
+	// Keep the producer and consumer positions on separate cache lines, so that they don't false share
+	alignas(CacheLineSize) std::atomic<size_t> EnqueuePos;
+	alignas(CacheLineSize) std::atomic<size_t> DequeuePos;
+
+	// Parking. The fast path only looks at the waiter counts, and never touches the mutex unless somebody is asleep.
+	alignas(CacheLineSize) std::mutex ParkLock;
+	std::condition_variable NotEmpty;
+	std::condition_variable NotFull;
+	std::atomic<int>        PopWaiters;
+	std::atomic<int>        PushWaiters;
+
+	bool Enqueue(T&& item); // Lock-free push, without waking anybody
+	bool Dequeue(T& item);  // Lock-free pop, without waking anybody
+	bool Drain(T& item);    // Pop once the queue is closed, waiting for items that are still being written
+	void WakeOne(std::atomic<int>& waiters, std::condition_variable& cv);
+};
+
+template <typename T>
+BoundedQueue<T>::BoundedQueue(size_t capacity) {
+	size_t size = 2;
+	while (size < capacity)
+		size *= 2;
+	Mask  = size - 1;
+	Cells = new Cell[size];
+	for (size_t i = 0; i < size; i++)
+		Cells[i].Sequence.store(i, std::memory_order_relaxed);
+	EnqueuePos.store(0, std::memory_order_relaxed);
+	DequeuePos.store(0, std::memory_order_relaxed);
+	PopWaiters  = 0;
+	PushWaiters = 0;
+}
+
+template <typename T>
+BoundedQueue<T>::~BoundedQueue() {
+	// Destroy whatever nobody popped
+	size_t end = EnqueuePos.load(std::memory_order_relaxed) & ~ClosedBit;
+	for (size_t pos = DequeuePos.load(std::memory_order_relaxed); pos != end; pos++) {
+		Cell* cell = &Cells[pos & Mask];
+		if (cell->Sequence.load(std::memory_order_relaxed) == pos + 1)
+			cell->Item()->~T();
+	}
+	delete[] Cells;
+}
+
+template <typename T>
+bool BoundedQueue<T>::TryPush(T&& item) {
+	if (!Enqueue(std::move(item)))
+		return false;
+	WakeOne(PopWaiters, NotEmpty);
+	return true;
+}
+
+template <typename T>
+bool BoundedQueue<T>::TryPush(const T& item) {
+	T copy(item);
+	return TryPush(std::move(copy));
+}
+
+template <typename T>
+bool BoundedQueue<T>::TryPop(T& item) {
+	if (!Dequeue(item))
+		return false;
+	WakeOne(PushWaiters, NotFull);
+	return true;
+}
+
+template <typename T>
+bool BoundedQueue<T>::Enqueue(T&& item) {
+	Cell*  cell;
+	size_t pos = EnqueuePos.load(std::memory_order_relaxed);
+	while (true) {
+		// Once ClosedBit is set, the CAS below can never succeed, so no slot is claimed after Close()
+		if (pos & ClosedBit)
+			return false;
+		cell         = &Cells[pos & Mask];
+		size_t   seq = cell->Sequence.load(std::memory_order_acquire);
+		intptr_t dif = (intptr_t) seq - (intptr_t) pos;
+		if (dif == 0) {
+			if (EnqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				break;
+		} else if (dif < 0) {
+			// The slot still holds an item from the previous lap, so the queue is full
+			return false;
+		} else {
+			pos = EnqueuePos.load(std::memory_order_relaxed);
+		}
+	}
+	new (cell->Item()) T(std::move(item));
+	cell->Sequence.store(pos + 1, std::memory_order_release);
+	return true;
+}
+
+template <typename T>
+bool BoundedQueue<T>::Dequeue(T& item) {
+	Cell*  cell;
+	size_t pos = DequeuePos.load(std::memory_order_relaxed);
+	while (true) {
+		cell         = &Cells[pos & Mask];
+		size_t   seq = cell->Sequence.load(std::memory_order_acquire);
+		intptr_t dif = (intptr_t) seq - (intptr_t) (pos + 1);
+		if (dif == 0) {
+			if (DequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				break;
+		} else if (dif < 0) {
+			// The slot has not been written yet, so the queue is empty
+			return false;
+		} else {
+			pos = DequeuePos.load(std::memory_order_relaxed);
+		}
+	}
+	item = std::move(*cell->Item());
+	cell->Item()->~T();
+	cell->Sequence.store(pos + Mask + 1, std::memory_order_release);
+	return true;
+}
+
+template <typename T>
+bool BoundedQueue<T>::Push(T&& item) {
+	for (int i = 0; i < SpinCount; i++) {
+		if (TryPush(std::move(item)))
+			return true;
+		if (IsClosed())
+			return false;
+		std::this_thread::yield();
+	}
+
+	std::unique_lock<std::mutex> lock(ParkLock);
+	PushWaiters++;
+	// Order our registration as a waiter before our final look at the queue. A consumer does the
+	// opposite (pop, then look at PushWaiters), so at least one of us sees the other.
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	bool ok = false;
+	while (true) {
+		// We're holding ParkLock, so we can't use TryPush, because WakeOne would try to take the lock again
+		if (Enqueue(std::move(item))) {
+			ok = true;
+			break;
+		}
+		if (IsClosed())
+			break;
+		NotFull.wait(lock);
+	}
+	PushWaiters--;
+	if (ok) {
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (PopWaiters.load(std::memory_order_relaxed) != 0)
+			NotEmpty.notify_one();
+	}
+	return ok;
+}
+
+template <typename T>
+bool BoundedQueue<T>::Push(const T& item) {
+	T copy(item);
+	return Push(std::move(copy));
+}
+
+template <typename T>
+bool BoundedQueue<T>::Pop(T& item) {
+	for (int i = 0; i < SpinCount; i++) {
+		if (TryPop(item))
+			return true;
+		if (IsClosed())
+			return Drain(item);
+		std::this_thread::yield();
+	}
+
+	{
+		std::unique_lock<std::mutex> lock(ParkLock);
+		PopWaiters++;
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		bool ok = false;
+		while (true) {
+			if (Dequeue(item)) {
+				ok = true;
+				break;
+			}
+			if (IsClosed())
+				break;
+			NotEmpty.wait(lock);
+		}
+		PopWaiters--;
+		if (ok) {
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (PushWaiters.load(std::memory_order_relaxed) != 0)
+				NotFull.notify_one();
+			return true;
+		}
+	}
+	// Drain without holding ParkLock, because it may need to wait for a producer to finish writing
+	return Drain(item);
+}
+
+template <typename T>
+bool BoundedQueue<T>::Drain(T& item) {
+	size_t end = EnqueuePos.load(std::memory_order_acquire) & ~ClosedBit;
+	while (true) {
+		if (TryPop(item))
+			return true;
+		// Every claimed slot has been popped, and nothing more can be claimed
+		if (DequeuePos.load(std::memory_order_acquire) == end)
+			return false;
+		// A producer claimed a slot before Close(), but has not published its item yet
+		std::this_thread::yield();
+	}
+}
+
+template <typename T>
+void BoundedQueue<T>::Close() {
+	std::lock_guard<std::mutex> lock(ParkLock);
+	EnqueuePos.fetch_or(ClosedBit, std::memory_order_acq_rel);
+	NotEmpty.notify_all();
+	NotFull.notify_all();
+}
+
+template <typename T>
+size_t BoundedQueue<T>::SizeApprox() const {
+	size_t head = EnqueuePos.load(std::memory_order_relaxed) & ~ClosedBit;
+	size_t tail = DequeuePos.load(std::memory_order_relaxed);
+	return head > tail ? head - tail : 0;
+}
+
+template <typename T>
+void BoundedQueue<T>::WakeOne(std::atomic<int>& waiters, std::condition_variable& cv) {
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (waiters.load(std::memory_order_relaxed) == 0)
+		return;
+	// Taking the lock guarantees that the waiter is either still before its final TryPush/TryPop
+	// (which will succeed), or already inside wait() (which we will wake).
+	std::lock_guard<std::mutex> lock(ParkLock);
+	cv.notify_one();
+}
+
+} // namespace imqs
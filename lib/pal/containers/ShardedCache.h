@@ -0,0 +1,308 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace imqs {
+
+/*
+
+Size-bounded concurrent cache
+=============================
+
+* The budget is in bytes (or whatever unit SizeOf returns), not in number of entries
+* Eviction uses the CLOCK algorithm, which approximates LRU, but a hit only sets a bit,
+  instead of moving the entry to the front of a list. One-hit wonders are evicted first.
+* Keys are spread over independent shards, each with its own lock and its own share of the budget
+* GetOrCompute has single-flight semantics: concurrent misses on the same key compute the value once,
+  and the other callers wait for that result
+* Hit, miss and eviction counters
+
+Eviction happens incrementally, on the insert that pushes a shard over its budget, so there is
+never a pause to rebuild the whole cache.
+
+Values are copied out of the cache, so for large values, store a std::shared_ptr<const T>.
+
+	ShardedCache<std::string, std::shared_ptr<const Tile>> tiles(256 * 1024 * 1024);
+	tiles.SizeOf = [](const std::string& key, const std::shared_ptr<const Tile>& t) { return key.size() + t->Bytes(); };
+
+	std::shared_ptr<const Tile> tile;
+	auto err = tiles.GetOrCompute(key, tile, [&](std::shared_ptr<const Tile>& t) -> Error { return LoadTile(key, t); });
+
+*/
+template <typename TKey, typename TVal, typename THash = std::hash<TKey>>
+class ShardedCache {
+public:
+	struct Stats {
+		uint64_t Hits      = 0;
+		uint64_t Misses    = 0;
+		uint64_t Evictions = 0;
+		size_t   Entries   = 0;
+		size_t   Bytes     = 0;
+	};
+
+	// Cost of an entry. The default charges 1 per entry, in which case MaxBytes is an entry count.
+	// Set this before using the cache.
+	std::function<size_t(const TKey& key, const TVal& val)> SizeOf;
+
+	ShardedCache(size_t maxBytes, size_t numShards = 16);
+	~ShardedCache();
+
+	ShardedCache(const ShardedCache&) = delete;
+	ShardedCache& operator=(const ShardedCache&) = delete;
+
+	bool  Get(const TKey& key, TVal& val); // Returns false if the key is not in the cache
+	void  Put(const TKey& key, const TVal& val);
+	bool  Erase(const TKey& key);
+	void  Clear();
+	Stats GetStats() const;
+
+	// If key is in the cache, return it. Otherwise call compute to produce the value, and add it to the
+	// cache. If another thread is already computing the same key, then wait for its result instead.
+	// An error from compute is returned to all of the waiters, and nothing is cached.
+	Error GetOrCompute(const TKey& key, TVal& val, std::function<Error(TVal& val)> compute);
+
+private:
+	struct Slot {
+		TKey   Key;
+		TVal   Val;
+		size_t Bytes      = 0;
+		bool   InUse      = false;
+		bool   Referenced = false; // Set by a hit, and cleared when the clock hand passes
+	};
+
+	// A computation that other callers can wait on
+	struct Flight {
+		std::mutex              Lock;
+		std::condition_variable CV;
+		bool                    Done = false;
+		Error                   Err;
+		TVal                    Val;
+	};
+
+	struct Shard {
+		std::mutex                                               Lock;
+		std::vector<Slot>                                        Slots;    // The clock
+		std::vector<size_t>                                      Free;     // Unused indices in Slots
+		std::unordered_map<TKey, size_t, THash>                  Index;    // Key -> index in Slots
+		std::unordered_map<TKey, std::shared_ptr<Flight>, THash> InFlight; // Keys that are being computed by GetOrCompute
+		size_t                                                   Hand  = 0;
+		size_t                                                   Bytes = 0;
+	};
+
+	size_t                MaxBytesPerShard = 0;
+	THash                 Hasher;
+	std::vector<Shard*>   Shards;
+	std::atomic<uint64_t> Hits;
+	std::atomic<uint64_t> Misses;
+	std::atomic<uint64_t> Evictions;
+
+	Shard& ShardFor(const TKey& key);
+	void   PutLocked(Shard& s, const TKey& key, const TVal& val);
+	void   EvictLocked(Shard& s);
+	void   RemoveLocked(Shard& s, size_t slot);
+};
+
+template <typename TKey, typename TVal, typename THash>
+ShardedCache<TKey, TVal, THash>::ShardedCache(size_t maxBytes, size_t numShards) {
+	if (numShards == 0)
+		numShards = 1;
+	MaxBytesPerShard = std::max(maxBytes / numShards, (size_t) 1);
+	for (size_t i = 0; i < numShards; i++)
+		Shards.push_back(new Shard());
+	Hits      = 0;
+	Misses    = 0;
+	Evictions = 0;
+}
+
+template <typename TKey, typename TVal, typename THash>
+ShardedCache<TKey, TVal, THash>::~ShardedCache() {
+	for (auto s : Shards)
+		delete s;
+}
+
+template <typename TKey, typename TVal, typename THash>
+typename ShardedCache<TKey, TVal, THash>::Shard& ShardedCache<TKey, TVal, THash>::ShardFor(const TKey& key) {
+	// std::hash is the identity function for integers, so mix the bits before picking a shard
+	uint64_t h = (uint64_t) Hasher(key) * 0x9E3779B97F4A7C15ull;
+	return *Shards[(size_t)(h >> 32) % Shards.size()];
+}
+
+template <typename TKey, typename TVal, typename THash>
+bool ShardedCache<TKey, TVal, THash>::Get(const TKey& key, TVal& val) {
+	Shard&                      s = ShardFor(key);
+	std::lock_guard<std::mutex> lock(s.Lock);
+	auto                        it = s.Index.find(key);
+	if (it == s.Index.end()) {
+		Misses++;
+		return false;
+	}
+	Slot& slot      = s.Slots[it->second];
+	slot.Referenced = true;
+	val             = slot.Val;
+	Hits++;
+	return true;
+}
+
+template <typename TKey, typename TVal, typename THash>
+void ShardedCache<TKey, TVal, THash>::Put(const TKey& key, const TVal& val) {
+	Shard&                      s = ShardFor(key);
+	std::lock_guard<std::mutex> lock(s.Lock);
+	PutLocked(s, key, val);
+}
+
+template <typename TKey, typename TVal, typename THash>
+bool ShardedCache<TKey, TVal, THash>::Erase(const TKey& key) {
+	Shard&                      s = ShardFor(key);
+	std::lock_guard<std::mutex> lock(s.Lock);
+	auto                        it = s.Index.find(key);
+	if (it == s.Index.end())
+		return false;
+	RemoveLocked(s, it->second);
+	return true;
+}
+
+template <typename TKey, typename TVal, typename THash>
+void ShardedCache<TKey, TVal, THash>::Clear() {
+	for (auto s : Shards) {
+		std::lock_guard<std::mutex> lock(s->Lock);
+		s->Slots.clear();
+		s->Free.clear();
+		s->Index.clear();
+		s->Hand  = 0;
+		s->Bytes = 0;
+	}
+}
+
+template <typename TKey, typename TVal, typename THash>
+typename ShardedCache<TKey, TVal, THash>::Stats ShardedCache<TKey, TVal, THash>::GetStats() const {
+	Stats st;
+	st.Hits      = Hits;
+	st.Misses    = Misses;
+	st.Evictions = Evictions;
+	for (auto s : Shards) {
+		std::lock_guard<std::mutex> lock(s->Lock);
+		st.Entries += s->Index.size();
+		st.Bytes += s->Bytes;
+	}
+	return st;
+}
+
+template <typename TKey, typename TVal, typename THash>
+Error ShardedCache<TKey, TVal, THash>::GetOrCompute(const TKey& key, TVal& val, std::function<Error(TVal& val)> compute) {
+	Shard&                  s = ShardFor(key);
+	std::shared_ptr<Flight> flight;
+	bool                    leader = false;
+	{
+		std::lock_guard<std::mutex> lock(s.Lock);
+		auto                        it = s.Index.find(key);
+		if (it != s.Index.end()) {
+			Slot& slot      = s.Slots[it->second];
+			slot.Referenced = true;
+			val             = slot.Val;
+			Hits++;
+			return Error();
+		}
+		Misses++;
+		auto f = s.InFlight.find(key);
+		if (f != s.InFlight.end()) {
+			flight = f->second;
+		} else {
+			flight = std::make_shared<Flight>();
+			s.InFlight.insert({key, flight});
+			leader = true;
+		}
+	}
+
+	if (!leader) {
+		std::unique_lock<std::mutex> lock(flight->Lock);
+		flight->CV.wait(lock, [&]() { return flight->Done; });
+		if (flight->Err.OK())
+			val = flight->Val;
+		return flight->Err;
+	}
+
+	// Compute outside of the shard lock, so that other keys in this shard are not held up
+	auto err = compute(val);
+	{
+		std::lock_guard<std::mutex> lock(s.Lock);
+		if (err.OK())
+			PutLocked(s, key, val);
+		s.InFlight.erase(key);
+	}
+	{
+		std::lock_guard<std::mutex> lock(flight->Lock);
+		flight->Done = true;
+		flight->Err  = err;
+		if (err.OK())
+			flight->Val = val;
+	}
+	flight->CV.notify_all();
+	return err;
+}
+
+template <typename TKey, typename TVal, typename THash>
+void ShardedCache<TKey, TVal, THash>::PutLocked(Shard& s, const TKey& key, const TVal& val) {
+	size_t bytes = SizeOf ? SizeOf(key, val) : 1;
+	auto   it    = s.Index.find(key);
+	if (it != s.Index.end()) {
+		Slot& slot = s.Slots[it->second];
+		s.Bytes    = s.Bytes - slot.Bytes + bytes;
+		slot.Val   = val;
+		slot.Bytes = bytes;
+	} else {
+		size_t i;
+		if (s.Free.size() != 0) {
+			i = s.Free.back();
+			s.Free.pop_back();
+		} else {
+			i = s.Slots.size();
+			s.Slots.push_back(Slot());
+		}
+		Slot& slot      = s.Slots[i];
+		slot.Key        = key;
+		slot.Val        = val;
+		slot.Bytes      = bytes;
+		slot.InUse      = true;
+		slot.Referenced = false;
+		s.Index.insert({key, i});
+		s.Bytes += bytes;
+	}
+	EvictLocked(s);
+}
+
+template <typename TKey, typename TVal, typename THash>
+void ShardedCache<TKey, TVal, THash>::EvictLocked(Shard& s) {
+	// Every slot is visited at most twice: once to clear its reference bit, and once to evict it
+	while (s.Bytes > MaxBytesPerShard && s.Index.size() != 0) {
+		if (s.Hand >= s.Slots.size())
+			s.Hand = 0;
+		Slot& slot = s.Slots[s.Hand];
+		if (slot.InUse) {
+			if (slot.Referenced) {
+				slot.Referenced = false;
+			} else {
+				RemoveLocked(s, s.Hand);
+				Evictions++;
+			}
+		}
+		s.Hand++;
+	}
+}
+
+template <typename TKey, typename TVal, typename THash>
+void ShardedCache<TKey, TVal, THash>::RemoveLocked(Shard& s, size_t i) {
+	Slot& slot = s.Slots[i];
+	s.Index.erase(slot.Key);
+	s.Bytes -= slot.Bytes;
+	// Release the memory held by the key and value now, rather than when the slot is reused
+	slot = Slot();
+	s.Free.push_back(i);
+}
+
+} // namespace imqs
@@ -0,0 +1,203 @@
+#include "pch.h"
+#include "JsonWriter.h"
+#include <rapidjson/internal/dtoa.h>
+#include <rapidjson/internal/itoa.h>
+
+namespace imqs {
+
+// Characters that must be escaped inside a JSON string. 'u' means \u00XX, zero means no escaping.
+static const char EscapeTable[256] = {
+	// clang-format off
+	'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'b', 't', 'n', 'u', 'f', 'r', 'u', 'u', // 00
+	'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', // 10
+	0,   0,   '"', 0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   // 20
+	0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   // 30
+	0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   // 40
+	0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   '\\', 0,  0,   0,   // 50
+	// clang-format on
+};
+
+JsonWriter::JsonWriter(io::Writer* out, bool pretty) : Out(out), Pretty(pretty) {
+}
+
+JsonWriter::~JsonWriter() {
+	Flush();
+}
+
+JsonWriter& JsonWriter::BeginObject() {
+	Begin('{', true);
+	return *this;
+}
+
+JsonWriter& JsonWriter::EndObject() {
+	End('}', true);
+	return *this;
+}
+
+JsonWriter& JsonWriter::BeginArray() {
+	Begin('[', false);
+	return *this;
+}
+
+JsonWriter& JsonWriter::EndArray() {
+	End(']', false);
+	return *this;
+}
+
+JsonWriter& JsonWriter::Key(const char* key, size_t len) {
+	BeginValue(true);
+	if (len == -1)
+		len = strlen(key);
+	WriteEscaped(key, len);
+	Put(':');
+	if (Pretty)
+		Put(' ');
+	AfterKey = true;
+	return *this;
+}
+
+JsonWriter& JsonWriter::String(const char* str, size_t len) {
+	BeginValue(false);
+	if (len == -1)
+		len = strlen(str);
+	WriteEscaped(str, len);
+	return *this;
+}
+
+JsonWriter& JsonWriter::Int(int64_t v) {
+	BeginValue(false);
+	char buf[24];
+	Put(buf, rapidjson::internal::i64toa(v, buf) - buf);
+	return *this;
+}
+
+JsonWriter& JsonWriter::UInt(uint64_t v) {
+	BeginValue(false);
+	char buf[24];
+	Put(buf, rapidjson::internal::u64toa(v, buf) - buf);
+	return *this;
+}
+
+JsonWriter& JsonWriter::Double(double v) {
+	BeginValue(false);
+	if (!std::isfinite(v)) {
+		Put("null", 4);
+		return *this;
+	}
+	// Grisu2, which produces the shortest string that parses back to the same double
+	char buf[32];
+	Put(buf, rapidjson::internal::dtoa(v, buf) - buf);
+	return *this;
+}
+
+JsonWriter& JsonWriter::Bool(bool v) {
+	BeginValue(false);
+	if (v)
+		Put("true", 4);
+	else
+		Put("false", 5);
+	return *this;
+}
+
+JsonWriter& JsonWriter::Null() {
+	BeginValue(false);
+	Put("null", 4);
+	return *this;
+}
+
+JsonWriter& JsonWriter::Raw(const char* json, size_t len) {
+	BeginValue(false);
+	Put(json, len);
+	return *this;
+}
+
+Error JsonWriter::Flush() {
+	FlushBuf();
+	return Err;
+}
+
+// Emit the comma and whitespace that precede a key, or a value
+void JsonWriter::BeginValue(bool isKey) {
+	if (AfterKey) {
+		IMQS_ASSERT(!isKey);
+		AfterKey = false;
+		return;
+	}
+	if (Levels.size() == 0)
+		return;
+	Level& level = Levels.back();
+	IMQS_ASSERT(level.IsObject == isKey); // Object members need a key, and array elements must not have one
+	if (!level.IsEmpty)
+		Put(',');
+	level.IsEmpty = false;
+	if (Pretty)
+		NewLine();
+}
+
+void JsonWriter::Begin(char open, bool isObject) {
+	BeginValue(false);
+	Put(open);
+	Level level;
+	level.IsObject = isObject;
+	Levels.push_back(level);
+}
+
+void JsonWriter::End(char close, bool isObject) {
+	IMQS_ASSERT(Levels.size() != 0 && Levels.back().IsObject == isObject && !AfterKey);
+	bool empty = Levels.back().IsEmpty;
+	Levels.pop_back();
+	if (Pretty && !empty)
+		NewLine();
+	Put(close);
+}
+
+void JsonWriter::NewLine() {
+	Put('\n');
+	for (size_t i = 0; i < Levels.size() * Indent; i++)
+		Put(' ');
+}
+
+void JsonWriter::WriteEscaped(const char* str, size_t len) {
+	Put('"');
+	size_t start = 0;
+	for (size_t i = 0; i < len; i++) {
+		char esc = EscapeTable[(uint8_t) str[i]];
+		if (esc == 0)
+			continue;
+		// Write out the run of characters that don't need escaping in one go
+		Put(str + start, i - start);
+		start = i + 1;
+		if (esc == 'u') {
+			const char* hex  = "0123456789abcdef";
+			char        u[6] = {'\\', 'u', '0', '0', hex[(uint8_t) str[i] >> 4], hex[str[i] & 15]};
+			Put(u, 6);
+		} else {
+			Put('\\');
+			Put(esc);
+		}
+	}
+	Put(str + start, len - start);
+	Put('"');
+}
+
+void JsonWriter::Put(const char* str, size_t len) {
+	if (len > BufSize - Len) {
+		FlushBuf();
+		if (len > BufSize) {
+			// Too big to be worth copying into our buffer
+			if (Err.OK())
+				Err = Out->Write(str, len);
+			return;
+		}
+	}
+	memcpy(Buf + Len, str, len);
+	Len += len;
+}
+
+void JsonWriter::FlushBuf() {
+	if (Len != 0 && Err.OK())
+		Err = Out->Write(Buf, Len);
+	Len = 0;
+}
+
+} // namespace imqs
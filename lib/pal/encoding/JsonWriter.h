@@ -0,0 +1,89 @@
+#pragma once
+
+#include "../io/io.h"
+
+namespace imqs {
+
+// JsonWriter streams JSON into an io::Writer, without building up a document first.
+// Use this instead of nlohmann::json or rapidjson::Document when producing large responses, where
+// the DOM would cost several times the size of the output.
+//
+// Output is staged in a small internal buffer, and written out whenever that buffer fills up,
+// as well as by Flush() and the destructor. Write errors are sticky: once a write has failed, all
+// further output is discarded, and Flush() returns the error.
+//
+// Compact and pretty output use the same layout as nlohmann::json::dump() and dump(4), but object keys
+// are written in the order that you write them, instead of being sorted. NaN and infinity are written as null.
+// Strings are expected to be UTF-8, and only quotes, backslashes and control characters are escaped.
+//
+//	io::StringWriter out(w.Body);
+//	JsonWriter       jw(&out);
+//	jw.BeginObject();
+//	jw.Key("width").Int(1920);
+//	jw.Key("photos").BeginArray();
+//	for (const auto& p : photos)
+//		jw.String(p);
+//	jw.EndArray();
+//	jw.EndObject();
+//	auto err = jw.Flush();
+class IMQS_PAL_API JsonWriter {
+public:
+	int Indent = 4; // Number of spaces per level, when pretty printing
+
+	JsonWriter(io::Writer* out, bool pretty = false);
+	~JsonWriter(); // Calls Flush()
+
+	JsonWriter(const JsonWriter&) = delete;
+	JsonWriter& operator=(const JsonWriter&) = delete;
+
+	JsonWriter& BeginObject();
+	JsonWriter& EndObject();
+	JsonWriter& BeginArray();
+	JsonWriter& EndArray();
+
+	// Inside an object, every value must be preceded by a key
+	JsonWriter& Key(const char* key, size_t len = -1);
+	JsonWriter& Key(const std::string& key) { return Key(key.data(), key.size()); }
+
+	JsonWriter& String(const char* str, size_t len = -1);
+	JsonWriter& String(const std::string& str) { return String(str.data(), str.size()); }
+	JsonWriter& Int(int64_t v);
+	JsonWriter& UInt(uint64_t v);
+	JsonWriter& Double(double v); // Shortest representation that round-trips
+	JsonWriter& Bool(bool v);
+	JsonWriter& Null();
+	JsonWriter& Raw(const char* json, size_t len); // Insert a value that is already encoded as JSON
+
+	Error Flush(); // Write any buffered output, and return the first write error, if any
+
+private:
+	struct Level {
+		bool IsObject = false;
+		bool IsEmpty  = true;
+	};
+
+	static const size_t BufSize = 8192;
+
+	io::Writer*        Out      = nullptr;
+	bool               Pretty   = false;
+	bool               AfterKey = false; // A key has been written, and we're waiting for its value
+	std::vector<Level> Levels;
+	Error              Err;
+	size_t             Len = 0;
+	char               Buf[BufSize];
+
+	void BeginValue(bool isKey);
+	void Begin(char open, bool isObject);
+	void End(char close, bool isObject);
+	void NewLine();
+	void WriteEscaped(const char* str, size_t len);
+	void Put(char c) {
+		if (Len == BufSize)
+			FlushBuf();
+		Buf[Len++] = c;
+	}
+	void Put(const char* str, size_t len);
+	void FlushBuf();
+};
+
+} // namespace imqs
@@ -1,6 +1,16 @@
 #include "pch.h"
 #include "csv.h"
 #include "../alloc.h"
+#include "../sync/TaskScheduler.h"
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+#define IMQS_CSV_SIMD 1
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
 
 namespace imqs {
 namespace csv {
@@ -74,6 +84,23 @@ Error Decoder::ReadLine(std::string& decoded, std::vector<size_t>& starts) {
 			if (end - s == 0)
 				break;
 		}
+		// Copy runs of ordinary characters in bulk, instead of pushing them one at a time
+		if (state == Raw || state == Quoted) {
+			const char* run = s;
+			if (state == Raw) {
+				while (run != end && *run != _sep && *run != '\r' && *run != '\n')
+					run++;
+			} else {
+				while (run != end && *run != _quote)
+					run++;
+			}
+			if (run != s) {
+				decoded.append(s, run - s);
+				s           = run;
+				anyConsumed = true;
+				continue;
+			}
+		}
 		anyConsumed = true;
 		char cp     = *s;
 		s++;
@@ -166,6 +193,294 @@ Error Decoder::ClearAndReadLine(std::string& decoded, std::vector<size_t>& start
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+// Bit i of each mask corresponds to byte i of a 64 byte block
+struct BlockMasks {
+	uint64_t Quote;
+	uint64_t Sep;
+	uint64_t NL;
+	uint64_t CR;
+};
+
+static inline uint64_t CharMask(const char* p, char c) {
+#if defined(__AVX2__)
+	__m256i  v  = _mm256_set1_epi8(c);
+	uint64_t lo = (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*) p), v));
+	uint64_t hi = (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*) (p + 32)), v));
+	return lo | (hi << 32);
+#elif defined(IMQS_CSV_SIMD)
+	__m128i  v = _mm_set1_epi8(c);
+	uint64_t m = 0;
+	for (int i = 0; i < 4; i++)
+		m |= (uint64_t)(uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (p + i * 16)), v)) << (i * 16);
+	return m;
+#else
+	uint64_t m = 0;
+	for (int i = 0; i < 64; i++)
+		m |= (uint64_t)(p[i] == c) << i;
+	return m;
+#endif
+}
+
+static inline void ClassifyBlock(const char* p, char sep, char quote, BlockMasks& m) {
+	m.Quote = CharMask(p, quote);
+	m.Sep   = CharMask(p, sep);
+	m.NL    = CharMask(p, '\n');
+	m.CR    = CharMask(p, '\r');
+}
+
+// Bit i of the result is the XOR of bits [0..i] of m. If m holds the positions of quotes, then the result
+// has a bit set for every byte from an opening quote up to (but excluding) its closing quote.
+static inline uint64_t PrefixXor(uint64_t m) {
+#if defined(__PCLMUL__)
+	// Carry-less multiplication by all ones is a prefix XOR in a single instruction
+	return (uint64_t) _mm_cvtsi128_si64(_mm_clmulepi64_si128(_mm_set_epi64x(0, (int64_t) m), _mm_set1_epi8((char) 0xff), 0));
+#else
+	m ^= m << 1;
+	m ^= m << 2;
+	m ^= m << 4;
+	m ^= m << 8;
+	m ^= m << 16;
+	m ^= m << 32;
+	return m;
+#endif
+}
+
+static inline int CountTrailingZeros(uint64_t m) {
+#ifdef _MSC_VER
+	unsigned long i;
+	_BitScanForward64(&i, m);
+	return (int) i;
+#else
+	return __builtin_ctzll(m);
+#endif
+}
+
+static inline int PopCount(uint64_t m) {
+#ifdef _MSC_VER
+	return (int) __popcnt64(m);
+#else
+	return __builtin_popcountll(m);
+#endif
+}
+
+// Emit base + the position of every set bit in m
+static inline void EmitBits(uint64_t m, int64_t base, std::vector<int64_t>& out) {
+	while (m != 0) {
+		out.push_back(base + CountTrailingZeros(m));
+		m &= m - 1;
+	}
+}
+
+// State that carries over from the end of one 64 byte block to the start of the next.
+// Every field is either 0 or 1, except for Inside, which is all zeros or all ones.
+struct Indexer::Carry {
+	uint64_t Inside      = 0; // Previous block ended inside quotes
+	uint64_t PrevOK      = 1; // Last byte of previous block may precede an opening quote (ie separator, newline, or quote)
+	uint64_t AfterCloser = 0; // Last byte of previous block was a closing quote
+	uint64_t AfterCR     = 0; // Last byte of previous block was an unquoted carriage return
+};
+
+// Index the bytes [begin, end) of buf, where buf is len bytes long. Record starts are only emitted after
+// newlines, so the caller is responsible for the first record. Returns false if the text contains quotes
+// that Decoder would interpret differently to our simple model, where every quote toggles quoted state.
+// Those are:
+// * An opening quote that is not at the start of a cell (Decoder treats it as a literal character)
+// * A closing quote that is not followed by a quote, separator, or line ending (Decoder discards the quote, and stays inside the cell)
+// * An unquoted carriage return that is not followed by a newline (Decoder swallows the next character)
+bool Indexer::IndexFast(const char* buf, size_t begin, size_t end, size_t len, Carry& c, std::vector<int64_t>& recordStarts, std::vector<int64_t>* separators) const {
+	for (size_t pos = begin; pos < end; pos += 64) {
+		size_t     n = std::min<size_t>(64, end - pos);
+		BlockMasks m;
+		if (n == 64) {
+			ClassifyBlock(buf + pos, Separator, Quote, m);
+		} else {
+			char tmp[64] = {0};
+			memcpy(tmp, buf + pos, n);
+			ClassifyBlock(tmp, Separator, Quote, m);
+		}
+		uint64_t valid = n == 64 ? ~(uint64_t) 0 : ((uint64_t) 1 << n) - 1;
+
+		uint64_t inside      = PrefixXor(m.Quote) ^ c.Inside;
+		uint64_t openers     = m.Quote & inside;
+		uint64_t closers     = m.Quote & ~inside;
+		uint64_t cr          = m.CR & ~inside;
+		uint64_t mayOpen     = m.Sep | m.NL | m.Quote;
+		uint64_t prevOK      = (mayOpen << 1) | c.PrevOK;
+		uint64_t afterCloser = (closers << 1) | c.AfterCloser;
+		uint64_t afterCR     = (cr << 1) | c.AfterCR;
+
+		uint64_t bad = (openers & ~prevOK) |
+		               (afterCloser & ~(m.Quote | m.Sep | m.NL | m.CR)) |
+		               (afterCR & ~m.NL);
+		if ((bad & valid) != 0)
+			return false;
+
+		// A record starts after every unquoted newline, except for a newline at the very end of the text
+		uint64_t nl = m.NL & ~inside & valid;
+		if (pos + 64 >= len)
+			nl &= ~((uint64_t) 1 << (len - 1 - pos));
+		EmitBits(nl, (int64_t) pos + 1, recordStarts);
+		if (separators)
+			EmitBits(m.Sep & ~inside & valid, (int64_t) pos, *separators);
+
+		c.Inside      = (uint64_t)((int64_t) inside >> 63);
+		c.PrevOK      = mayOpen >> 63;
+		c.AfterCloser = closers >> 63;
+		c.AfterCR     = cr >> 63;
+	}
+	return true;
+}
+
+// Byte-at-a-time version of IndexFast, with exactly the same state machine as Decoder::ReadLine
+void Indexer::IndexSlow(const char* buf, size_t len, std::vector<int64_t>& recordStarts, std::vector<int64_t>* separators) const {
+	enum States {
+		CellStart,
+		Raw,
+		Quoted,
+		DoubleQuoted,
+		CR,
+	} state = CellStart;
+
+	char _sep   = Separator;
+	char _quote = Quote;
+
+	if (len != 0)
+		recordStarts.push_back(0);
+
+	for (size_t i = 0; i < len; i++) {
+		char cp      = buf[i];
+		bool newline = false;
+		bool sep     = false;
+		switch (state) {
+		case CellStart:
+		case Raw:
+			if (cp == _sep)
+				sep = true;
+			else if (state == CellStart && cp == _quote)
+				state = Quoted;
+			else if (cp == '\r')
+				state = CR;
+			else if (cp == '\n')
+				newline = true;
+			else
+				state = Raw;
+			break;
+		case Quoted:
+			if (cp == _quote)
+				state = DoubleQuoted;
+			break;
+		case DoubleQuoted:
+			if (cp == _sep)
+				sep = true;
+			else if (cp == '\r')
+				state = CR;
+			else if (cp == '\n')
+				newline = true;
+			else
+				state = Quoted;
+			break;
+		case CR:
+			if (cp == '\n')
+				newline = true;
+			else
+				state = Raw;
+			break;
+		}
+		if (sep) {
+			state = CellStart;
+			if (separators)
+				separators->push_back(i);
+		} else if (newline) {
+			state = CellStart;
+			if (i + 1 < len)
+				recordStarts.push_back(i + 1);
+		}
+	}
+}
+
+void Indexer::Index(const char* buf, size_t len, std::vector<int64_t>& recordStarts, std::vector<int64_t>* separators) const {
+	size_t nRecords = recordStarts.size();
+	size_t nSeps    = separators ? separators->size() : 0;
+
+	// Chunks must be a multiple of the block size, so that only the final block is partial
+	size_t chunkSize = (ChunkSize + 63) & ~(size_t) 63;
+	size_t nchunks   = 1;
+	if (chunkSize != 0 && len > chunkSize)
+		nchunks = (len + chunkSize - 1) / chunkSize;
+
+	bool ok = true;
+	if (nchunks == 1) {
+		Carry c;
+		if (len != 0)
+			recordStarts.push_back(0);
+		ok = IndexFast(buf, 0, len, len, c, recordStarts, separators);
+	} else {
+		// The first pass counts the quotes in each chunk, which tells us whether each chunk starts inside quotes.
+		// This relies on every quote toggling quoted state, which the second pass verifies.
+		std::vector<size_t> quotes(nchunks);
+		sync::ParallelFor(0, nchunks, 1, [&](size_t first, size_t last) {
+			for (size_t k = first; k < last; k++) {
+				size_t begin = k * chunkSize;
+				size_t end   = std::min(begin + chunkSize, len);
+				size_t n     = 0;
+				size_t pos   = begin;
+				for (; pos + 64 <= end; pos += 64)
+					n += PopCount(CharMask(buf + pos, Quote));
+				for (; pos < end; pos++)
+					n += buf[pos] == Quote;
+				quotes[k] = n;
+			}
+		});
+
+		// Only the parity of the running quote count matters, so we never need the total (which could overflow)
+		std::vector<Carry> carries(nchunks);
+		bool               inside = false;
+		for (size_t k = 1; k < nchunks; k++) {
+			inside ^= (quotes[k - 1] & 1) != 0;
+			char prev = buf[k * chunkSize - 1];
+
+			carries[k].Inside      = inside ? ~(uint64_t) 0 : 0;
+			carries[k].PrevOK      = prev == Separator || prev == '\n' || prev == Quote;
+			carries[k].AfterCloser = !inside && prev == Quote;
+			carries[k].AfterCR     = !inside && prev == '\r';
+		}
+
+		std::vector<std::vector<int64_t>> chunkRecords(nchunks);
+		std::vector<std::vector<int64_t>> chunkSeps(nchunks);
+		std::atomic<bool>                 irregular(false);
+		sync::ParallelFor(0, nchunks, 1, [&](size_t first, size_t last) {
+			for (size_t k = first; k < last && !irregular; k++) {
+				size_t begin = k * chunkSize;
+				size_t end   = std::min(begin + chunkSize, len);
+				if (!IndexFast(buf, begin, end, len, carries[k], chunkRecords[k], separators ? &chunkSeps[k] : nullptr))
+					irregular = true;
+			}
+		});
+		ok = !irregular;
+
+		if (ok) {
+			recordStarts.push_back(0);
+			for (const auto& r : chunkRecords)
+				recordStarts.insert(recordStarts.end(), r.begin(), r.end());
+			if (separators) {
+				for (const auto& s : chunkSeps)
+					separators->insert(separators->end(), s.begin(), s.end());
+			}
+		}
+	}
+
+	if (!ok) {
+		recordStarts.resize(nRecords);
+		if (separators)
+			separators->resize(nSeps);
+		IndexSlow(buf, len, recordStarts, separators);
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
 Error Encoder::Write(io::Writer* w, const char* str, size_t len) {
 	bool needEscape = false;
 	if (len == -1)
@@ -48,6 +48,32 @@ private:
 	size_t      BufCap = 4096;
 };
 
+// Indexer finds the start of every record in CSV text that is entirely in memory (eg a memory mapped file),
+// without decoding any cells. Input is classified 64 bytes at a time with SIMD compares, and the bytes
+// that are inside quotes are found with a prefix-xor over the quote bits, so the cost is close to
+// that of a memory scan. Large buffers are split into chunks, which are indexed in parallel.
+//
+// The results are identical to reading the text line by line with Decoder. Text that does not use
+// quotes in the strict RFC 4180 manner (eg a quote in the middle of an unquoted cell) is detected,
+// and is then indexed by a byte-at-a-time scan that mirrors Decoder's state machine.
+class IMQS_PAL_API Indexer {
+public:
+	char   Separator = ',';
+	char   Quote     = '"';
+	size_t ChunkSize = 4 * 1024 * 1024; // Buffers larger than this are indexed by multiple threads. Zero disables threading.
+
+	// Append the offset of every record in buf to recordStarts. If len is not zero, then the first record
+	// starts at 0. A newline at the end of buf does not produce an extra empty record.
+	// If separators is not null, then the offset of every separator that is not inside quotes is appended to it.
+	void Index(const char* buf, size_t len, std::vector<int64_t>& recordStarts, std::vector<int64_t>* separators = nullptr) const;
+
+private:
+	struct Carry;
+
+	bool IndexFast(const char* buf, size_t begin, size_t end, size_t len, Carry& carry, std::vector<int64_t>& recordStarts, std::vector<int64_t>* separators) const;
+	void IndexSlow(const char* buf, size_t len, std::vector<int64_t>& recordStarts, std::vector<int64_t>* separators) const;
+};
+
 // Encoder encodes a single CSV cell.
 class IMQS_PAL_API Encoder {
 public:
@@ -45,31 +45,117 @@ void RingTreeFinder::WalkSetDepth(Ring* r, int level) {
 }
 
 void RingTreeFinder::Analyze() {
-	std::vector<Ring*> rstack;
+	size_t n = Rings.size();
+
+	// Rank the rings by area, and then by index. The parent of a ring is the enclosing ring with the lowest rank.
+	std::vector<size_t> order(n);
+	std::vector<size_t> rank(n);
+	for (size_t i = 0; i < n; i++)
+		order[i] = i;
+	std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+		return Rings[a]->Area < Rings[b]->Area || (Rings[a]->Area == Rings[b]->Area && a < b);
+	});
+	for (size_t i = 0; i < n; i++)
+		rank[order[i]] = i;
+
+	// Build a uniform grid over the bounds of all rings, with roughly one cell per ring. Every ring is listed
+	// in all of the cells that its bounds touch. Nested rings are the normal case here, and a large ring covers
+	// most of the grid, so listing it in every cell would cost O(n^2) memory. Instead, a ring whose bounds touch
+	// more than maxCellsPerRing cells goes into the 'large' list, which every query scans.
+	// Rings are inserted in order of rank, so every list is sorted by rank.
+	BBox2d all;
+	for (auto r : Rings) {
+		if (!r->Bounds.IsNull()) {
+			all.ExpandToFit(r->Bounds.X1, r->Bounds.Y1);
+			all.ExpandToFit(r->Bounds.X2, r->Bounds.Y2);
+		}
+	}
+	const int maxCells        = 1024;
+	const int maxCellsPerRing = 16;
+	int       gw              = 1;
+	int       gh              = 1;
+	double    w               = all.Width();
+	double    h               = all.Height();
+	if (n > 16 && !all.IsNull() && std::isfinite(w) && std::isfinite(h)) {
+		if (w > 0 && h > 0) {
+			gw = (int) std::min(ceil(sqrt((double) n * w / h)), (double) maxCells);
+			gh = (int) std::min(ceil((double) n / (double) gw), (double) maxCells);
+		} else if (w > 0) {
+			gw = (int) std::min(n, (size_t) maxCells);
+		} else if (h > 0) {
+			gh = (int) std::min(n, (size_t) maxCells);
+		}
+		gw = std::max(gw, 1);
+		gh = std::max(gh, 1);
+	}
+	double sx = w > 0 ? gw / w : 0;
+	double sy = h > 0 ? gh / h : 0;
+	// These are monotonic, and also map NaN to cell 0
+	auto cellX = [&](double x) -> int {
+		double c = (x - all.X1) * sx;
+		return c >= gw ? gw - 1 : (c > 0 ? (int) c : 0);
+	};
+	auto cellY = [&](double y) -> int {
+		double c = (y - all.Y1) * sy;
+		return c >= gh ? gh - 1 : (c > 0 ? (int) c : 0);
+	};
+
+	std::vector<std::vector<size_t>> grid(gw * gh);
+	std::vector<size_t>              large;
+	for (size_t k = 0; k < n; k++) {
+		const auto& b = Rings[order[k]]->Bounds;
+		if (b.IsNull())
+			continue;
+		int x1 = cellX(b.X1);
+		int y1 = cellY(b.Y1);
+		int x2 = cellX(b.X2);
+		int y2 = cellY(b.Y2);
+		if ((int64_t)(x2 - x1 + 1) * (int64_t)(y2 - y1 + 1) > maxCellsPerRing) {
+			large.push_back(k);
+			continue;
+		}
+		for (int y = y1; y <= y2; y++) {
+			for (int x = x1; x <= x2; x++)
+				grid[y * gw + x].push_back(k);
+		}
+	}
 
-	// Do initial N x N pass which discovers all the encircling rings of each other ring.
-	// We ask: is "i" a child of "j" ?
-	for (int i = 0; i < Rings.size(); i++) {
-		// Pick the ring from j that encloses our first vertex, and has the least area of all such enclosing rings.
-		int best_parent_index = -1;
-		for (int j = 0; j < Rings.size(); j++) {
-			if (i == j)
-				continue;
-			if (!Rings[i]->Bounds.PositiveUnion(Rings[j]->Bounds))
-				continue;
-			if (Rings[i]->Area >= Rings[j]->Area)
-				continue;
-
-			auto iptFirst   = Rings[i]->Vertices[0];
-			bool i_inside_j = PtInsidePoly(iptFirst.X, iptFirst.Y, Rings[j]->Vertices.size(), &Rings[j]->Vertices[0].X, 2);
-			if (i_inside_j) {
-				if (best_parent_index == -1 || Rings[j]->Area < Rings[best_parent_index]->Area)
-					best_parent_index = j;
+	// For every ring i, find the ring that encloses its first vertex, and has the least area of all such enclosing rings.
+	// An enclosing ring's bounds contain the first vertex, so it is either in the grid cell of the first vertex, or in
+	// the large list. Within each list, we can stop at the first hit, because all of the rings after it have a higher rank.
+	std::vector<Ring*> parents(n, nullptr);
+	for (size_t i = 0; i < n; i++) {
+		Ring* ri = Rings[i];
+		if (ri->Bounds.IsNull())
+			continue;
+		auto   iptFirst = ri->Vertices[0];
+		size_t best     = n;
+
+		auto search = [&](const std::vector<size_t>& list) {
+			for (auto k = std::upper_bound(list.begin(), list.end(), rank[i]); k != list.end() && *k < best; k++) {
+				Ring*       rj = Rings[order[*k]];
+				const auto& b  = rj->Bounds;
+				if (iptFirst.X < b.X1 || iptFirst.X > b.X2 || iptFirst.Y < b.Y1 || iptFirst.Y > b.Y2)
+					continue;
+				if (ri->Area >= rj->Area)
+					continue;
+				if (PtInsidePoly(iptFirst.X, iptFirst.Y, rj->Vertices.size(), &rj->Vertices[0].X, 2)) {
+					best = *k;
+					break;
+				}
 			}
-		}
-		if (best_parent_index != -1) {
-			Rings[best_parent_index]->Children.push_back(Rings[i]);
-			Rings[i]->Parent = Rings[best_parent_index];
+		};
+		search(grid[cellY(iptFirst.Y) * gw + cellX(iptFirst.X)]);
+		search(large);
+		if (best != n)
+			parents[i] = Rings[order[best]];
+	}
+
+	// Assign children in order of index
+	for (size_t i = 0; i < n; i++) {
+		if (parents[i]) {
+			parents[i]->Children.push_back(Rings[i]);
+			Rings[i]->Parent = parents[i];
 		}
 	}
 
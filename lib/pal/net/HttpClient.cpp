@@ -15,6 +15,7 @@ static StaticError ErrConnectionFailed("Connection Failed");
 static StaticError ErrTimeout("Timeout");
 static StaticError ErrTooManyRedirects("Too Many Redirects");
 static StaticError ErrNoHeadersInResponse("No Headers In Response");
+static StaticError ErrCancelled("Cancelled");
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -196,6 +197,8 @@ IMQS_PAL_API void Initialize() {
 }
 
 IMQS_PAL_API void Shutdown() {
+	// Pooled connections hold curl handles, which must be freed before curl itself
+	ConnectionPool::Global().Clear();
 	curl_global_cleanup();
 }
 
@@ -552,40 +555,54 @@ Error Response::ToError() const {
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+static Request MakeRequest(const std::string& method, const std::string& url, size_t bodyBytes, const void* body, const std::string& caCertsFilePath, const HeaderMap& headers) {
+	Request request;
+	request.Method = method;
+	if (bodyBytes)
+		request.Body.assign((const char*) body, bodyBytes);
+	request.Url        = url;
+	request.CACertFile = caCertsFilePath;
+
+	for (auto& it : headers)
+		request.Headers.push_back(HeaderItem(it.first, it.second));
+
+	return request;
+}
+
 Response Client::Get(const std::string& url, const HeaderMap& headers) {
-	Connection c;
-	return c.Get(url, headers);
+	return Perform("GET", url, 0, nullptr, "", headers);
 }
 
 Response Client::Post(const std::string& url, size_t bodyBytes, const void* body, const HeaderMap& headers) {
-	Connection c;
-	return c.Post(url, bodyBytes, body, headers);
+	return Perform("POST", url, bodyBytes, body, "", headers);
 }
 
 Response Client::Post(const std::string& url, const std::string& body, const HeaderMap& headers) {
-	Connection c;
-	return c.Post(url, body, headers);
+	return Perform("POST", url, body.size(), body.data(), "", headers);
 }
 
 Response Client::Post(const std::string& url, const HeaderMap& headers) {
-	Connection c;
-	return c.Post(url, 0, nullptr, headers);
+	return Perform("POST", url, 0, nullptr, "", headers);
 }
 
 Response Client::Perform(const std::string& method, const std::string& url, size_t bodyBytes, const void* body, const std::string& caCertsFilePath, const HeaderMap& headers) {
-	Connection c;
-	return c.Perform(method, url, bodyBytes, body, caCertsFilePath, headers);
+	return Perform(MakeRequest(method, url, bodyBytes, body, caCertsFilePath, headers));
 }
 
 void Client::Perform(const Request& request, Response& response) {
-	Connection c;
-	c.Perform(request, response);
+	auto& pool = ConnectionPool::Global();
+	auto  c    = pool.Acquire(request.Url);
+	c->Perform(request, response);
+	// If the transport failed, then the socket is probably dead, so don't keep it
+	if (response.Err.OK())
+		pool.Release(request.Url, c);
+	else
+		delete c;
 }
 
 Response Client::Perform(const Request& request) {
-	Response   response;
-	Connection c;
-	c.Perform(request, response);
+	Response response;
+	Perform(request, response);
 	return response;
 }
 
@@ -633,22 +650,18 @@ Response Connection::Post(const std::string& url, const HeaderMap& headers) {
 }
 
 Response Connection::Perform(const std::string& method, const std::string& url, size_t bodyBytes, const void* body, const std::string& caCertsFilePath, const HeaderMap& headers) {
-	Request request;
-	request.Method = method;
-	if (bodyBytes)
-		request.Body.assign((const char*) body, bodyBytes);
-	request.Url        = url;
-	request.CACertFile = caCertsFilePath;
-
-	for (auto& it : headers)
-		request.Headers.push_back(HeaderItem(it.first, it.second));
-
 	Response response;
-	Perform(request, response);
+	Perform(MakeRequest(method, url, bodyBytes, body, caCertsFilePath, headers), response);
 	return response;
 }
 
 void Connection::Perform(const Request& request, Response& response) {
+	void*    headers = Setup(request, response);
+	CURLcode res     = curl_easy_perform(CurlC);
+	Finish(res, response, headers);
+}
+
+void* Connection::Setup(const Request& request, Response& response) {
 	response = Response();
 	if (request.Method != "GET" &&
 	    request.Method != "HEAD" &&
@@ -663,7 +676,6 @@ void Connection::Perform(const Request& request, Response& response) {
 		IMQS_DIE_MSG((std::string("Client: Invalid HTTP verb ") + request.Method).c_str());
 	}
 
-	CURLcode res = CURLE_COULDNT_CONNECT;
 	if (CurlC == nullptr) {
 		CurlC = curl_easy_init();
 		if (CurlC == nullptr)
@@ -747,10 +759,13 @@ void Connection::Perform(const Request& request, Response& response) {
 	if (headers)
 		curl_easy_setopt(CurlC, CURLOPT_HTTPHEADER, headers);
 
-	// Fire off the request
-	res = curl_easy_perform(CurlC);
+	return headers;
+}
+
+void Connection::Finish(int curlResult, Response& response, void* _headers) {
+	curl_slist* headers = (curl_slist*) _headers;
 
-	switch (res) {
+	switch ((CURLcode) curlResult) {
 	case CURLE_OK: response.Err = Error(); break;
 	case CURLE_COULDNT_RESOLVE_PROXY: response.Err = ErrResolveProxyFailed; break;
 	case CURLE_COULDNT_RESOLVE_HOST: response.Err = ErrResolveHostFailed; break;
@@ -759,7 +774,7 @@ void Connection::Perform(const Request& request, Response& response) {
 	case CURLE_TOO_MANY_REDIRECTS: response.Err = ErrTooManyRedirects; break;
 	case CURLE_SSL_CACERT: response.Err = Error::Fmt("Invalid CA certificate for HTTPS"); break;
 	default:
-		response.Err = Error::Fmt("libcurl error %v", res);
+		response.Err = Error::Fmt("libcurl error %v", curlResult);
 		break;
 	}
 
@@ -840,5 +855,179 @@ size_t Connection::CurlMyHeaders(void* ptr, size_t size, size_t nmemb, void* dat
 	return tot;
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+ConnectionPool::ConnectionPool() {
+}
+
+ConnectionPool::~ConnectionPool() {
+	Clear();
+}
+
+ConnectionPool& ConnectionPool::Global() {
+	static ConnectionPool global;
+	return global;
+}
+
+std::string ConnectionPool::Key(const std::string& url) {
+	url::URL u;
+	if (!u.Decode(url.c_str()).OK())
+		return url;
+	std::string proto = strings::tolower(u.Proto);
+	int         port  = u.Port;
+	if (port == 0)
+		port = proto == "https" ? 443 : 80;
+	return tsf::fmt("%v://%v:%v", proto, strings::tolower(u.Host), port);
+}
+
+Connection* ConnectionPool::Acquire(const std::string& url) {
+	auto                        key = Key(url);
+	std::lock_guard<std::mutex> lock(Lock);
+	auto                        idle = Idle.getp(key);
+	if (idle && idle->size() != 0) {
+		// Take the most recently used connection, because it is the least likely to have been closed by the server
+		auto c = idle->back();
+		idle->pop_back();
+		return c;
+	}
+	return new Connection();
+}
+
+void ConnectionPool::Release(const std::string& url, Connection* c) {
+	if (c->IsCancelled()) {
+		delete c;
+		return;
+	}
+	auto                        key = Key(url);
+	std::lock_guard<std::mutex> lock(Lock);
+	auto&                       idle = Idle[key];
+	if (idle.size() >= MaxIdlePerHost) {
+		delete c;
+		return;
+	}
+	idle.push_back(c);
+}
+
+void ConnectionPool::Clear() {
+	std::lock_guard<std::mutex> lock(Lock);
+	for (auto& it : Idle) {
+		for (auto c : it.second)
+			delete c;
+	}
+	Idle.clear();
+}
+
+size_t ConnectionPool::NumIdle() {
+	std::lock_guard<std::mutex> lock(Lock);
+	size_t                      n = 0;
+	for (auto& it : Idle)
+		n += it.second.size();
+	return n;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+Batch::Batch() {
+	Cancelled = false;
+}
+
+Batch::~Batch() {
+	// Slots are never busy between calls to Run, so none of the easy handles are attached to the multi handle
+	for (auto s : Slots)
+		delete s;
+	if (Multi)
+		curl_multi_cleanup((CURLM*) Multi);
+}
+
+void Batch::Run(const std::vector<Request>& requests, std::function<void(size_t index, Response& response)> done) {
+	if (Multi == nullptr) {
+		Multi = curl_multi_init();
+		if (Multi == nullptr)
+			IMQS_DIE_MSG("curl_multi_init failed");
+	}
+	CURLM* multi = (CURLM*) Multi;
+
+	size_t maxActive = (size_t) std::max(MaxConcurrent, 1);
+	while (Slots.size() < std::min(maxActive, requests.size()))
+		Slots.push_back(new Slot());
+
+	size_t next    = 0;
+	size_t nactive = 0;
+	bool   stopped = false;
+	while (next < requests.size() || nactive != 0) {
+		if (Cancelled && !stopped) {
+			// Our curl callbacks will return zero, which aborts the transfers that are in flight
+			for (auto s : Slots)
+				s->Con.Cancel();
+			stopped = true;
+		}
+
+		// Requests that will never be started still get their callback, so that the caller sees exactly one result per request
+		if (stopped) {
+			for (; next < requests.size(); next++) {
+				Response resp;
+				resp.Err = ErrCancelled;
+				done(next, resp);
+			}
+		}
+
+		// Fill up the free slots
+		for (size_t i = 0; i < Slots.size() && next < requests.size() && nactive < maxActive; i++) {
+			Slot* s = Slots[i];
+			if (s->Busy)
+				continue;
+			s->Index   = next++;
+			s->Busy    = true;
+			s->Headers = s->Con.Setup(requests[s->Index], s->Resp);
+			curl_multi_add_handle(multi, (CURL*) s->Con.CurlC);
+			nactive++;
+		}
+
+		if (nactive == 0)
+			continue;
+
+		int running = 0;
+		curl_multi_perform(multi, &running);
+
+		CURLMsg* msg;
+		int      nleft = 0;
+		while ((msg = curl_multi_info_read(multi, &nleft)) != nullptr) {
+			if (msg->msg != CURLMSG_DONE)
+				continue;
+			for (auto s : Slots) {
+				if (!s->Busy || s->Con.CurlC != msg->easy_handle)
+					continue;
+				CURLcode res = msg->data.result;
+				curl_multi_remove_handle(multi, msg->easy_handle);
+				s->Con.Finish(res, s->Resp, s->Headers);
+				s->Headers = nullptr;
+				s->Busy    = false;
+				nactive--;
+				done(s->Index, s->Resp);
+				break;
+			}
+		}
+
+		// Sleep until there is activity on one of our sockets. The timeout bounds how long it takes us to notice Cancel().
+		if (running != 0)
+			curl_multi_wait(multi, nullptr, 0, 100, nullptr);
+	}
+}
+
+std::vector<Response> Batch::Run(const std::vector<Request>& requests) {
+	std::vector<Response> responses;
+	responses.resize(requests.size());
+	Run(requests, [&](size_t index, Response& response) {
+		responses[index] = std::move(response);
+	});
+	return responses;
+}
+
+void Batch::Cancel() {
+	Cancelled = true;
+}
+
 } // namespace http
 } // namespace imqs
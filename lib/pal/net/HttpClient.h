@@ -1,6 +1,7 @@
 #pragma once
 
 #include "../Time_.h"
+#include <functional>
 
 namespace imqs {
 namespace http {
@@ -232,14 +233,87 @@ public:
 	bool IsCancelled() const { return Cancelled; }
 
 private:
+	friend class Batch;
+
 	void*             CurlC           = nullptr;
 	uint8_t*          ReadPtr         = nullptr; // Only valid while a transfer is taking place
 	Response*         CurrentResponse = nullptr; // Only valid while a transfer is taking place
 	std::atomic<bool> Cancelled;
 
+	void* Setup(const Request& request, Response& response);        // Prepare CurlC for a transfer. Returns the header list, which must be passed to Finish.
+	void  Finish(int curlResult, Response& response, void* headers); // Populate response.Err, and release whatever Setup allocated
+
 	static size_t CurlMyRead(void* ptr, size_t size, size_t nmemb, void* data);
 	static size_t CurlMyWrite(void* ptr, size_t size, size_t nmemb, void* data);
 	static size_t CurlMyHeaders(void* ptr, size_t size, size_t nmemb, void* data);
 };
+
+// ConnectionPool holds idle Connections, keyed by scheme, host and port.
+// The static Client functions use the global pool, so that consecutive requests to the same
+// server reuse a kept-alive socket (and TLS session), instead of paying for a new handshake
+// every time. A pool is safe to use from multiple threads, but a Connection that has been
+// acquired belongs to the caller until it is released.
+class IMQS_PAL_API ConnectionPool {
+public:
+	size_t MaxIdlePerHost = 8; // Connections that are released beyond this limit are closed
+
+	ConnectionPool();
+	~ConnectionPool();
+
+	static ConnectionPool& Global();
+	static std::string     Key(const std::string& url); // Returns "scheme://host:port", with the default port filled in
+
+	Connection* Acquire(const std::string& url);                // Returns an idle connection to url's host, or a new connection
+	void        Release(const std::string& url, Connection* c); // Return a connection that came from Acquire. It is closed if it was cancelled.
+	void        Clear();                                        // Close all idle connections
+	size_t      NumIdle();
+
+private:
+	std::mutex                                        Lock;
+	ohash::map<std::string, std::vector<Connection*>> Idle;
+};
+
+// Batch performs many requests concurrently, on the calling thread, using libcurl's multi interface.
+// Up to MaxConcurrent transfers are in flight at once. Sockets are kept alive between requests, and
+// between calls to Run, so keep a Batch around if you are going to issue repeated batches to the same hosts.
+// A Batch may only be used by one thread at a time, with the exception of Cancel().
+//
+//	http::Batch batch;
+//	batch.Run(requests, [&](size_t i, http::Response& resp) {
+//		if (resp.Is200())
+//			Store(i, std::move(resp.Body));
+//	});
+class IMQS_PAL_API Batch {
+public:
+	int MaxConcurrent = 16;
+
+	Batch();
+	~Batch();
+
+	// Perform all requests. done(i, response) is called once for every request, in the order in which
+	// the requests complete. response may be moved from.
+	void Run(const std::vector<Request>& requests, std::function<void(size_t index, Response& response)> done);
+
+	// Perform all requests, and return the responses in the same order as requests
+	std::vector<Response> Run(const std::vector<Request>& requests);
+
+	// Abort the current Run, potentially from another thread. Transfers that are in flight are
+	// cancelled, and requests that have not started yet complete with an error. A cancelled Batch
+	// cannot be reused.
+	void Cancel();
+
+private:
+	struct Slot {
+		Connection Con;
+		Response   Resp;
+		size_t     Index   = 0;
+		void*      Headers = nullptr;
+		bool       Busy    = false;
+	};
+	void*              Multi = nullptr;
+	std::vector<Slot*> Slots;
+	std::atomic<bool>  Cancelled;
+};
+
 } // namespace http
 } // namespace imqs
\ No newline at end of file
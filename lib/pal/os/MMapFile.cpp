@@ -20,17 +20,20 @@ MMapFile::~MMapFile() {
 }
 
 Error MMapFile::Open(const std::string& filename) {
-	return OpenInternal(filename, false);
+	return OpenInternal(filename, false, 0);
 }
 
-Error MMapFile::Create(const std::string& filename) {
-	return OpenInternal(filename, true);
+Error MMapFile::Create(const std::string& filename, int64_t reserve) {
+	return OpenInternal(filename, true, reserve);
 }
 
-Error MMapFile::OpenInternal(const std::string& filename, bool create) {
+Error MMapFile::OpenInternal(const std::string& filename, bool create, int64_t reserve) {
 	Close();
 	Filename = filename;
 	IsWrite  = create;
+#ifndef _WIN32
+	ReservedSize = std::max<int64_t>(reserve, 0);
+#endif
 #ifdef _WIN32
 	DWORD access = create ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ;
 	DWORD share  = create ? 0 : FILE_SHARE_READ;
@@ -96,12 +99,23 @@ Error MMapFile::RecreateMapping(int64_t minSize) {
 	if (!Base)
 		return Error::Fmt("Failed to map %v bytes of file %v: %v", MappedSize, Filename, ErrorFrom_GetLastError().Message());
 #else
+	if (Base && newWriteSize <= ReservedSize) {
+		// The address space is already mapped, so we only need to grow the file
+		int e = ftruncate(FD, newWriteSize);
+		if (e != 0)
+			return Error::Fmt("Failed to fruncate mmap file %v: %v", Filename, ErrorFrom_errno().Message());
+		MappedSize = newWriteSize;
+		return Error();
+	}
 	if (Base) {
-		int e = munmap(Base, MappedSize);
+		int e = munmap(Base, std::max(MappedSize, ReservedSize));
 		if (e != 0)
 			return Error::Fmt("Failed to unmap %v: %v", Filename, ErrorFrom_errno().Message());
 		Base       = nullptr;
 		MappedSize = 0;
+		// We have outgrown our reservation, so double it
+		if (ReservedSize != 0)
+			ReservedSize *= 2;
 	}
 	if (IsWrite) {
 		MappedSize = newWriteSize;
@@ -117,14 +131,119 @@ Error MMapFile::RecreateMapping(int64_t minSize) {
 		MappedSize   = r;
 		CachedLength = r;
 	}
-	int prot = IsWrite ? PROT_READ | PROT_WRITE : PROT_READ;
-	Base     = (uint8_t*) mmap(nullptr, (size_t) MappedSize, prot, MAP_SHARED, FD, 0);
-	if (!Base) {
+	if (ReservedSize != 0)
+		return MapReserved(std::max(ReservedSize, MappedSize));
+	int   prot = IsWrite ? PROT_READ | PROT_WRITE : PROT_READ;
+	void* base = mmap(nullptr, (size_t) MappedSize, prot, MAP_SHARED, FD, 0);
+	if (base == MAP_FAILED) {
 		auto err     = Error::Fmt("Failed to map %v bytes of file %v: %v", MappedSize, Filename, ErrorFrom_errno().Message());
 		MappedSize   = 0;
 		CachedLength = 0;
 		return err;
 	}
+	Base = (uint8_t*) base;
+#endif
+	return Error();
+}
+
+#ifndef _WIN32
+// Map 'reserve' bytes of the file, starting at a 2 MB boundary, so that the kernel is able to use huge pages
+// for the mapping, if the filesystem supports it. Only the first MappedSize bytes are backed by the file,
+// and touching anything beyond that would raise SIGBUS, but WriteAt always grows the file before writing.
+Error MMapFile::MapReserved(int64_t reserve) {
+	const size_t align = 2 * 1024 * 1024;
+	size_t       size  = ((size_t) reserve + align - 1) & ~(align - 1);
+
+	// Reserve enough address space that we're guaranteed to find an aligned range of 'size' bytes inside it
+	void* raw = mmap(nullptr, size + align, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (raw == MAP_FAILED) {
+		MappedSize   = 0;
+		ReservedSize = 0;
+		return Error::Fmt("Failed to reserve %v bytes of address space for %v: %v", size, Filename, ErrorFrom_errno().Message());
+	}
+	uint8_t* start   = (uint8_t*) raw;
+	uint8_t* aligned = (uint8_t*) (((uintptr_t) start + align - 1) & ~(uintptr_t)(align - 1));
+
+	void* base = mmap(aligned, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, FD, 0);
+	if (base == MAP_FAILED) {
+		auto err = Error::Fmt("Failed to map %v bytes of file %v: %v", size, Filename, ErrorFrom_errno().Message());
+		munmap(raw, size + align);
+		MappedSize   = 0;
+		ReservedSize = 0;
+		return err;
+	}
+
+	// Release the unused address space on either side of the mapping
+	if (aligned != start)
+		munmap(start, aligned - start);
+	munmap(aligned + size, align - (aligned - start));
+
+	Base         = aligned;
+	ReservedSize = (int64_t) size;
+	return Error();
+}
+#endif
+
+Error MMapFile::Advise(MMapAdvice advice, int64_t offset, int64_t len) {
+	if (!Base)
+		return Error("File is not open");
+	if (len == -1 || offset + len > MappedSize)
+		len = MappedSize - offset;
+	if (offset < 0 || len <= 0)
+		return Error();
+#ifdef _WIN32
+	if (advice == MMapAdvice::WillNeed) {
+#if _WIN32_WINNT >= 0x0602
+		WIN32_MEMORY_RANGE_ENTRY range;
+		range.VirtualAddress = Base + offset;
+		range.NumberOfBytes  = (SIZE_T) len;
+		if (!PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0))
+			return Error::Fmt("Failed to prefetch %v: %v", Filename, ErrorFrom_GetLastError().Message());
+#endif
+	}
+#else
+	int madv = MADV_NORMAL;
+	switch (advice) {
+	case MMapAdvice::Normal: madv = MADV_NORMAL; break;
+	case MMapAdvice::Sequential: madv = MADV_SEQUENTIAL; break;
+	case MMapAdvice::Random: madv = MADV_RANDOM; break;
+	case MMapAdvice::WillNeed: madv = MADV_WILLNEED; break;
+	case MMapAdvice::DontNeed: madv = MADV_DONTNEED; break;
+	}
+	// madvise needs a page aligned address
+	int64_t page  = (int64_t) sysconf(_SC_PAGESIZE);
+	int64_t start = offset - offset % page;
+	if (madvise(Base + start, (size_t)(offset + len - start), madv) != 0)
+		return Error::Fmt("madvise failed on %v: %v", Filename, ErrorFrom_errno().Message());
+#ifdef POSIX_FADV_NORMAL
+	// madvise only controls read-ahead on page faults, so give the page cache the same hint
+	int fadv = POSIX_FADV_NORMAL;
+	switch (advice) {
+	case MMapAdvice::Normal: fadv = POSIX_FADV_NORMAL; break;
+	case MMapAdvice::Sequential: fadv = POSIX_FADV_SEQUENTIAL; break;
+	case MMapAdvice::Random: fadv = POSIX_FADV_RANDOM; break;
+	case MMapAdvice::WillNeed: fadv = POSIX_FADV_WILLNEED; break;
+	case MMapAdvice::DontNeed: fadv = POSIX_FADV_DONTNEED; break;
+	}
+	int e = posix_fadvise(FD, (off_t) offset, (off_t) len, fadv);
+	if (e != 0)
+		return Error::Fmt("posix_fadvise failed on %v: %v", Filename, ErrorFrom_errno(e).Message());
+#endif
+#endif
+	return Error();
+}
+
+Error MMapFile::Sync() {
+	if (!Base || !IsWrite)
+		return Error();
+#ifdef _WIN32
+	if (!FlushViewOfFile(Base, 0))
+		return Error::Fmt("Failed to flush %v: %v", Filename, ErrorFrom_GetLastError().Message());
+	if (!FlushFileBuffers(HFile))
+		return Error::Fmt("Failed to flush %v: %v", Filename, ErrorFrom_GetLastError().Message());
+#else
+	if (msync(Base, (size_t) MappedSize, MS_SYNC) != 0)
+		return Error::Fmt("Failed to sync %v: %v", Filename, ErrorFrom_errno().Message());
 #endif
 	return Error();
 }
@@ -232,9 +351,10 @@ Error MMapFile::Close() {
 	HFile    = INVALID_HANDLE_VALUE;
 	HMapping = nullptr;
 #else
+	// We don't msync here. munmap leaves the dirty pages in the page cache, and the kernel writes them out later.
 	if (Base)
-		munmap(Base, MappedSize);
-	if (FD != -1) {
+		munmap(Base, std::max(MappedSize, ReservedSize));
+	if (FD != -1 && IsWrite) {
 		int e      = ftruncate(FD, CachedLength);
 		int _errno = errno;
 		close(FD);
@@ -244,12 +364,15 @@ Error MMapFile::Close() {
 		}
 		if (e != 0)
 			err = Error::Fmt("Failed to truncate file %v to %v: %v", Filename, CachedLength, ErrorFrom_errno(_errno).Message());
+	} else if (FD != -1) {
+		close(FD);
 	}
 	FD = -1;
 #endif
 	Pos          = 0;
 	CachedLength = 0;
 	MappedSize   = 0;
+	ReservedSize = 0;
 	Base         = nullptr;
 	Filename     = "";
 	return err;
@@ -6,11 +6,24 @@
 namespace imqs {
 namespace os {
 
+// Access pattern hints for MMapFile::Advise
+enum class MMapAdvice {
+	Normal,     // Default read-ahead
+	Sequential, // Aggressive read-ahead. Pages can be dropped soon after they have been read.
+	Random,     // No read-ahead
+	WillNeed,   // Start reading the range into the page cache now, in the background
+	DontNeed,   // The range will not be needed soon, so its pages can be dropped from the page cache
+};
+
 // Memory mapped file
 // This provides a similar interface to File, but uses a memory
 // mapped file underneath.
 // When writing, we grow the file on demand, in chunks of up to 64 MB.
-// When closing, we truncate the file to the maximum written size.
+// Every time the file grows, it must be unmapped and mapped again, unless you reserve
+// address space up front, by passing 'reserve' to Create.
+// When closing, we truncate the file to the maximum written size. Close does not msync,
+// so dirty pages are written back by the OS in its own time. Call Sync if you need the
+// data to be on disk before you continue.
 class IMQS_PAL_API MMapFile : public io::Writer, public io::Reader, public io::Seeker {
 public:
 	MMapFile();
@@ -26,8 +39,19 @@ public:
 	Error ReadExactly(void* buf, size_t len);                // Returns ErrEOF if the precise number of bytes could not be read
 	Error ReadExactlyAt(int64_t pos, void* buf, size_t len); // Returns ErrEOF if the precise number of bytes could not be read. Does not alter seek position.
 
-	Error Open(const std::string& filename);   // Open a file for read-only access
-	Error Create(const std::string& filename); // Create a new file, or truncate an existing file
+	Error Open(const std::string& filename); // Open a file for read-only access
+
+	// Create a new file, or truncate an existing file.
+	// If reserve is not zero, then that many bytes of address space are mapped up front, aligned to 2 MB,
+	// so that the file can grow to that size without ever being remapped, and MemBase() does not change.
+	// Reservation is only supported on Posix systems, and is ignored on Windows.
+	Error Create(const std::string& filename, int64_t reserve = 0);
+
+	// Tell the OS how the range [offset, offset + len) will be accessed. If len is -1, then the range extends to the
+	// end of the file. This is only a hint, so the OS is free to ignore it. On Windows, only WillNeed has any effect.
+	Error Advise(MMapAdvice advice, int64_t offset = 0, int64_t len = -1);
+
+	Error Sync(); // Flush dirty pages to disk, and wait for them to be written
 
 	Error Length(int64_t& len) override { return io::Seeker::Length(len); }
 
@@ -42,7 +66,8 @@ private:
 	std::string Filename;
 	int64_t     Pos          = 0;
 	int64_t     CachedLength = 0;
-	int64_t     MappedSize   = 0;
+	int64_t     MappedSize   = 0; // Size of the file that is backing the mapping
+	int64_t     ReservedSize = 0; // Size of the mapping, if it is larger than MappedSize
 	uint8_t*    Base         = nullptr;
 #ifdef _WIN32
 	HANDLE HFile    = INVALID_HANDLE_VALUE;
@@ -51,8 +76,11 @@ private:
 	int FD = -1;
 #endif
 
-	Error OpenInternal(const std::string& filename, bool create);
+	Error OpenInternal(const std::string& filename, bool create, int64_t reserve);
 	Error RecreateMapping(int64_t minSize = 0);
+#ifndef _WIN32
+	Error MapReserved(int64_t reserve);
+#endif
 };
 
 } // namespace os
@@ -10,20 +10,22 @@
 
 #include "aligned_alloc.h"
 #include "algo/BinarySearch.h"
-#include "algo/CacheEviction.h"
 #include "algo/Diff.h"
 #include "archive/zip.h"
 #include "crypto/Rand.h"
 #include "compress/lz4.h"
 #include "compress/zlib.h"
 #include "containers/BitVector.h"
+#include "containers/BoundedQueue.h"
 #include "containers/cheapvec.h"
 #include "containers/HashBuilder.h"
 #include "containers/queue.h"
+#include "containers/ShardedCache.h"
 #include "containers/smallvec.h"
 #include "encoding/csv.h"
 #include "encoding/html.h"
 #include "encoding/json.h"
+#include "encoding/JsonWriter.h"
 #include "encoding/xml.h"
 #include "encoding/JsonSchemas.h"
 #include "geom/geom2d.h"
@@ -63,4 +65,5 @@
 #include "strings/utf.h"
 #include "sync/Event.h"
 #include "sync/sema.h"
+#include "sync/TaskScheduler.h"
 #include "Time_.h"
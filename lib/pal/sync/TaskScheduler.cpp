@@ -0,0 +1,282 @@
+#include "pch.h"
+#include "TaskScheduler.h"
+
+namespace imqs {
+namespace sync {
+
+// Number of times that an idle CPU worker looks for work, before parking
+static const int SpinCount = 50;
+
+static thread_local TaskScheduler* CurrentScheduler = nullptr;
+static thread_local void*          CurrentWorker    = nullptr;
+static thread_local bool           IsIOThread       = false;
+static thread_local size_t         StealSeed        = 0;
+
+TaskScheduler::TaskScheduler(int cpuThreads, int ioThreads) {
+	if (cpuThreads <= 0)
+		cpuThreads = std::max((int) std::thread::hardware_concurrency() - 1, 1);
+	if (ioThreads <= 0)
+		ioThreads = 8; // IO threads spend most of their time blocked, so this has nothing to do with the number of cores
+
+	Stop        = false;
+	NumQueued   = 0;
+	NumSleeping = 0;
+
+	for (int i = 0; i < cpuThreads; i++)
+		Workers.push_back(new Worker());
+	// Create all workers before starting any, because a worker can steal from any other worker
+	for (auto w : Workers)
+		w->Thread = std::thread([this, w]() { WorkerThread(w); });
+	for (int i = 0; i < ioThreads; i++)
+		IOThreads.push_back(std::thread([this]() { IOThread(); }));
+}
+
+TaskScheduler::~TaskScheduler() {
+	{
+		std::lock_guard<std::mutex> lock(SleepLock);
+		Stop = true;
+		SleepCV.notify_all();
+	}
+	{
+		std::lock_guard<std::mutex> lock(IOLock);
+		IOCV.notify_all();
+	}
+	for (auto w : Workers) {
+		w->Thread.join();
+		IMQS_ASSERT(w->Tasks.size() == 0);
+		delete w;
+	}
+	for (auto& t : IOThreads)
+		t.join();
+	IMQS_ASSERT(Inject.size() == 0);
+	IMQS_ASSERT(IOQueue.size() == 0);
+}
+
+TaskScheduler& TaskScheduler::Global() {
+	static TaskScheduler global;
+	return global;
+}
+
+void TaskScheduler::Submit(Task* t, TaskLane lane) {
+	if (lane == TaskLane::IO) {
+		std::lock_guard<std::mutex> lock(IOLock);
+		IOQueue.push_back(t);
+		IOCV.notify_one();
+		return;
+	}
+
+	if (CurrentScheduler == this && CurrentWorker != nullptr) {
+		Worker*                     self = (Worker*) CurrentWorker;
+		std::lock_guard<std::mutex> lock(self->Lock);
+		self->Tasks.push_back(t);
+	} else {
+		std::lock_guard<std::mutex> lock(InjectLock);
+		Inject.push_back(t);
+	}
+	NumQueued++;
+
+	// A worker registers as sleeping before its final look for work, and we publish the task
+	// before looking for sleepers, so at least one of us sees the other.
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (NumSleeping.load(std::memory_order_relaxed) != 0) {
+		std::lock_guard<std::mutex> lock(SleepLock);
+		SleepCV.notify_one();
+	}
+}
+
+TaskScheduler::Task* TaskScheduler::FindCPUTask(Worker* self) {
+	Task* t = nullptr;
+
+	// Our own deque, newest first
+	if (self) {
+		std::lock_guard<std::mutex> lock(self->Lock);
+		if (self->Tasks.size() != 0) {
+			t = self->Tasks.back();
+			self->Tasks.pop_back();
+		}
+	}
+
+	// Tasks from outside the pool, oldest first
+	if (!t) {
+		std::lock_guard<std::mutex> lock(InjectLock);
+		if (Inject.size() != 0) {
+			t = Inject.front();
+			Inject.pop_front();
+		}
+	}
+
+	// Steal the oldest task from another worker, starting at a different victim every time, so that
+	// thieves don't all pile onto the same worker
+	if (!t) {
+		size_t n     = Workers.size();
+		size_t start = StealSeed++;
+		for (size_t i = 0; i < n && !t; i++) {
+			Worker* victim = Workers[(start + i) % n];
+			if (victim == self)
+				continue;
+			std::lock_guard<std::mutex> lock(victim->Lock);
+			if (victim->Tasks.size() != 0) {
+				t = victim->Tasks.front();
+				victim->Tasks.pop_front();
+			}
+		}
+	}
+
+	if (t)
+		NumQueued--;
+	return t;
+}
+
+TaskScheduler::Task* TaskScheduler::FindIOTask() {
+	std::lock_guard<std::mutex> lock(IOLock);
+	if (IOQueue.size() == 0)
+		return nullptr;
+	Task* t = IOQueue.front();
+	IOQueue.pop_front();
+	return t;
+}
+
+bool TaskScheduler::RunOneTask() {
+	Task* t = FindCPUTask(CurrentScheduler == this ? (Worker*) CurrentWorker : nullptr);
+	// An IO thread that is waiting must also help with IO tasks, because the tasks that it is waiting
+	// for may be queued behind it on the IO lane, with every other IO thread waiting too.
+	if (!t && CurrentScheduler == this && IsIOThread)
+		t = FindIOTask();
+	if (!t)
+		return false;
+	Execute(t);
+	return true;
+}
+
+void TaskScheduler::Execute(Task* t) {
+	t->Func();
+	t->Group->TaskFinished();
+	delete t;
+}
+
+void TaskScheduler::WorkerThread(Worker* self) {
+	CurrentScheduler = this;
+	CurrentWorker    = self;
+	StealSeed        = std::hash<std::thread::id>()(std::this_thread::get_id());
+	while (true) {
+		Task* t = nullptr;
+		for (int i = 0; i < SpinCount && !t; i++) {
+			t = FindCPUTask(self);
+			if (!t)
+				std::this_thread::yield();
+		}
+		if (t) {
+			Execute(t);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(SleepLock);
+		NumSleeping++;
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		SleepCV.wait(lock, [this]() { return Stop || NumQueued.load() > 0; });
+		NumSleeping--;
+		if (Stop)
+			return;
+	}
+}
+
+void TaskScheduler::IOThread() {
+	CurrentScheduler = this;
+	IsIOThread       = true;
+	while (true) {
+		Task* t = nullptr;
+		{
+			std::unique_lock<std::mutex> lock(IOLock);
+			IOCV.wait(lock, [this]() { return Stop || IOQueue.size() != 0; });
+			if (IOQueue.size() == 0)
+				return;
+			t = IOQueue.front();
+			IOQueue.pop_front();
+		}
+		Execute(t);
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+TaskGroup::TaskGroup(TaskScheduler* scheduler) : Scheduler(scheduler) {
+	if (!Scheduler)
+		Scheduler = &TaskScheduler::Global();
+	Pending = 0;
+}
+
+TaskGroup::~TaskGroup() {
+	Wait();
+}
+
+void TaskGroup::Run(std::function<void()> f, TaskLane lane) {
+	auto t   = new TaskScheduler::Task();
+	t->Func  = std::move(f);
+	t->Group = this;
+	Pending++;
+	Scheduler->Submit(t, lane);
+}
+
+void TaskGroup::Wait() {
+	while (Pending.load() != 0) {
+		// Help out, instead of blocking a thread that could be doing useful work. This is also what
+		// makes it safe to wait from inside a task.
+		if (Scheduler->RunOneTask())
+			continue;
+		// Nothing to run, so our tasks are executing on other threads. Wake up
+		// periodically, in case those tasks spawn more work that we can help with.
+		std::unique_lock<std::mutex> lock(Lock);
+		Done.wait_for(lock, std::chrono::milliseconds(1), [this]() { return Pending.load() == 0; });
+	}
+	// Synchronize with the final TaskFinished, which may still be holding Lock, so that the
+	// caller can safely destroy us as soon as we return.
+	std::lock_guard<std::mutex> lock(Lock);
+}
+
+void TaskGroup::TaskFinished() {
+	std::lock_guard<std::mutex> lock(Lock);
+	if (--Pending == 0)
+		Done.notify_all();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+IMQS_PAL_API void ParallelFor(size_t begin, size_t end, size_t grain, std::function<void(size_t begin, size_t end)> f, TaskLane lane, TaskScheduler* scheduler) {
+	if (end <= begin)
+		return;
+	if (!scheduler)
+		scheduler = &TaskScheduler::Global();
+
+	size_t n        = end - begin;
+	size_t nThreads = (size_t)(lane == TaskLane::CPU ? scheduler->NumCPUThreads() : scheduler->NumIOThreads()) + 1; // +1 for the calling thread
+	if (grain == 0)
+		grain = std::max(n / (nThreads * 4), (size_t) 1);
+	size_t nChunks = (n + grain - 1) / grain;
+	if (nChunks == 1) {
+		f(begin, end);
+		return;
+	}
+
+	// Every helper task keeps taking chunks until there are none left, so we only need one task per thread
+	std::atomic<size_t> next;
+	next           = 0;
+	auto runChunks = [&]() {
+		for (size_t c = next++; c < nChunks; c = next++) {
+			size_t i = begin + c * grain;
+			f(i, std::min(i + grain, end));
+		}
+	};
+	TaskGroup g(scheduler);
+	size_t    nHelpers = std::min(nChunks, nThreads) - 1;
+	for (size_t i = 0; i < nHelpers; i++)
+		g.Run(runChunks, lane);
+	runChunks();
+	g.Wait();
+}
+
+} // namespace sync
+} // namespace imqs
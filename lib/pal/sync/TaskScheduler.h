@@ -0,0 +1,124 @@
+#pragma once
+
+#include <deque>
+#include <functional>
+
+namespace imqs {
+namespace sync {
+
+class TaskGroup;
+
+// Tasks that spend most of their time blocked on IO (disk, network) must use the IO lane, so that
+// they don't occupy the CPU workers, which are sized to the number of cores.
+enum class TaskLane {
+	CPU,
+	IO,
+};
+
+/* TaskScheduler is a shared pool of worker threads.
+
+The CPU lane is a work-stealing pool with one worker per core (minus one, because the thread
+that waits on a TaskGroup helps out by running tasks). Every worker has its own deque. A worker
+pushes and pops tasks at the back of its own deque (LIFO, which is cache friendly for nested
+parallelism), and when its deque is empty, it takes work from the injection queue (tasks that
+were submitted from non-worker threads), or steals from the front of another worker's deque.
+
+The IO lane is a plain FIFO served by its own threads. IO tasks never run on CPU workers, and
+vice versa, so a burst of blocking IO cannot starve compute, and compute cannot delay IO.
+
+Use Global() unless you have a good reason for a private pool. The whole point of this thing is
+that all of the parallel loops in a process share one right-sized pool, instead of oversubscribing
+the machine with their own threads.
+
+Normally you don't submit tasks directly. Instead, you use a TaskGroup, or ParallelFor.
+*/
+class IMQS_PAL_API TaskScheduler {
+public:
+	// Zero means choose automatically
+	TaskScheduler(int cpuThreads = 0, int ioThreads = 0);
+	~TaskScheduler(); // All task groups must have been waited on before destroying the scheduler
+
+	static TaskScheduler& Global();
+
+	int NumCPUThreads() const { return (int) Workers.size(); }
+	int NumIOThreads() const { return (int) IOThreads.size(); }
+
+private:
+	friend class TaskGroup;
+
+	struct Task {
+		std::function<void()> Func;
+		TaskGroup*            Group = nullptr;
+	};
+
+	struct Worker {
+		std::mutex        Lock;
+		std::deque<Task*> Tasks;
+		std::thread       Thread;
+	};
+
+	std::vector<Worker*>     Workers;
+	std::vector<std::thread> IOThreads;
+	std::atomic<bool>        Stop;
+
+	// CPU lane
+	std::mutex              InjectLock;
+	std::deque<Task*>       Inject;      // Tasks submitted from threads that are not CPU workers
+	std::atomic<int64_t>    NumQueued;   // Number of tasks in the injection queue and all worker deques
+	std::atomic<int>        NumSleeping; // Number of CPU workers that are parked, or about to park
+	std::mutex              SleepLock;
+	std::condition_variable SleepCV;
+
+	// IO lane
+	std::mutex              IOLock;
+	std::deque<Task*>       IOQueue;
+	std::condition_variable IOCV;
+
+	void  Submit(Task* t, TaskLane lane);
+	Task* FindCPUTask(Worker* self);
+	Task* FindIOTask();
+	bool  RunOneTask(); // Run a single task, if one is available. Used by threads that are waiting on a TaskGroup.
+	void  Execute(Task* t);
+	void  WorkerThread(Worker* self);
+	void  IOThread();
+};
+
+/* TaskGroup runs tasks on a TaskScheduler, and waits for them to finish.
+
+	sync::TaskGroup g;
+	for (auto& tile : tiles)
+		g.Run([&tile]() { tile.Render(); });
+	g.Wait();
+
+Wait() runs CPU tasks while it waits, and an IO thread that waits also runs IO tasks, so it is
+safe to wait on a group from inside a task of either lane. Without that, IO tasks that all wait
+on nested IO tasks would occupy every IO thread, and nothing would be left to run the nested tasks.
+The destructor waits for any tasks that are still running.
+*/
+class IMQS_PAL_API TaskGroup {
+public:
+	TaskGroup(TaskScheduler* scheduler = nullptr); // If scheduler is null, then use TaskScheduler::Global()
+	~TaskGroup();
+
+	void Run(std::function<void()> f, TaskLane lane = TaskLane::CPU);
+	void Wait();
+
+private:
+	friend class TaskScheduler;
+
+	TaskScheduler*          Scheduler = nullptr;
+	std::atomic<int64_t>    Pending;
+	std::mutex              Lock;
+	std::condition_variable Done;
+
+	void TaskFinished();
+};
+
+// Run f(i, end) over [begin, end) in chunks of at most 'grain' items, where f is called with the
+// sub-range [i, end) of one chunk. Chunks are handed out dynamically, so uneven work balances itself.
+// The calling thread participates. If grain is zero, then a grain is chosen that produces a few
+// chunks per thread.
+IMQS_PAL_API void ParallelFor(size_t begin, size_t end, size_t grain, std::function<void(size_t begin, size_t end)> f, TaskLane lane = TaskLane::CPU, TaskScheduler* scheduler = nullptr);
+
+} // namespace sync
+} // namespace imqs